@@ -9,11 +9,20 @@ HEADERS += $${SRC_DIR}/utils.hpp
 SOURCES += $${SRC_DIR}/utils.cpp
 HEADERS += $${SRC_DIR}/crypto.hpp
 SOURCES += $${SRC_DIR}/crypto.cpp
+HEADERS += $${SRC_DIR}/aes.hpp
+SOURCES += $${SRC_DIR}/aes.cpp
 HEADERS += $${SRC_DIR}/aesni.hpp
+HEADERS += $${SRC_DIR}/aessoft.hpp
+HEADERS += $${SRC_DIR}/bitslice.hpp
+HEADERS += $${SRC_DIR}/vaes.hpp
+HEADERS += $${SRC_DIR}/ghash.hpp
+HEADERS += $${SRC_DIR}/cpu.hpp
 HEADERS += $${SRC_DIR}/hash.hpp
+HEADERS += $${SRC_DIR}/hashbatch.hpp
 HEADERS += $${SRC_DIR}/bignum.hpp
 HEADERS += $${SRC_DIR}/openssl.hpp
 HEADERS += $${SRC_DIR}/random.hpp
+HEADERS += $${SRC_DIR}/gf2.hpp
 HEADERS += $${SRC_DIR}/cracker.hpp
 SOURCES += $${SRC_DIR}/cracker.cpp
 HEADERS += $${SRC_DIR}/converter.hpp
@@ -39,6 +48,9 @@ SOURCES += $${SRC_DIR}/set4.cpp
 HEADERS += $${SRC_DIR}/set5.hpp
 SOURCES += $${SRC_DIR}/set5.cpp
 
+HEADERS += $${SRC_DIR}/benchmark.hpp
+SOURCES += $${SRC_DIR}/benchmark.cpp
+
 include( setup.pri )
 # include( openssl.pri )
 linux: include( linux.pri )
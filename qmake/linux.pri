@@ -1,6 +1,5 @@
 
-QMAKE_CXXFLAGS += -maes
-QMAKE_CXXFLAGS_RELEASE += -msse2 -Ofast -march=native
+QMAKE_CXXFLAGS_RELEASE += -msse2 -Ofast
 QMAKE_LFLAGS_RELEASE += -flto
 
 LIBS += -lstdc++fs -lpthread -lrt
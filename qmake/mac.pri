@@ -1,6 +1,5 @@
-QMAKE_CXXFLAGS += -maes
 QMAKE_CXXFLAGS += -mmacosx-version-min=10.13 -Wshadow
-QMAKE_CXXFLAGS_RELEASE += -msse2 -Ofast -march=native
+QMAKE_CXXFLAGS_RELEASE += -msse2 -Ofast
 QMAKE_LFLAGS_RELEASE += -flto
 
 QMAKE_LFLAGS += -framework Security
@@ -2,6 +2,7 @@ OPENSSL_DIR = $${MAIN_DIR}/libs/openssl
 OPENSSL_BIN_DIR = $${OPENSSL_DIR}/bin/$${PLATFORM}/$${COMPILE_MODE}
 
 INCLUDEPATH += $${OPENSSL_DIR}/include
+DEFINES += WITH_OPENSSL
 
 win32 {
     LIBS += $${OPENSSL_BIN_DIR}/libssl.lib
@@ -0,0 +1,290 @@
+#include "aes.hpp"
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+
+#include "cpu.hpp"
+#include "aessoft.hpp"
+#include "bitslice.hpp"
+#include "vaes.hpp"
+#include "log.hpp"
+
+#ifdef WITH_OPENSSL
+#include "openssl.hpp"
+#endif
+
+namespace {
+
+using Backend = aes::Backend;
+using AesKey128 = aes::AesKey128;
+
+const uint8_t* encKeys( const AesKey128& key ) {
+    return reinterpret_cast<const uint8_t*>( key.enc );
+}
+
+const uint8_t* decKeys( const AesKey128& key ) {
+    return reinterpret_cast<const uint8_t*>( key.dec );
+}
+
+//! one function per mode, all with the aesni signatures
+struct Kernels {
+    Backend backend;
+    size_t ( *encryptECB )( const uint8_t*, uint8_t*, const size_t, const AesKey128& );
+    size_t ( *decryptECB )( const uint8_t*, uint8_t*, const size_t, const AesKey128& );
+    size_t ( *encryptCBC )( const uint8_t*, uint8_t*, const size_t, const AesKey128&, const uint8_t* );
+    void ( *encryptCBCBatch )( const aes::CBCJob*, const size_t );
+    size_t ( *decryptCBC )( const uint8_t*, uint8_t*, const size_t, const AesKey128&, const uint8_t* );
+    void ( *cryptCTR )( const uint8_t*, uint8_t*, const size_t, const AesKey128&, const uint64_t&, const uint64_t& );
+};
+
+const Kernels software = {
+    Backend::Software,
+    []( const uint8_t* in, uint8_t* out, const size_t length, const AesKey128 & key ) {
+        return aessoft::encryptAES128ECB( in, out, length, encKeys( key ) );
+    },
+    []( const uint8_t* in, uint8_t* out, const size_t length, const AesKey128 & key ) {
+        return aessoft::decryptAES128ECB( in, out, length, decKeys( key ) );
+    },
+    []( const uint8_t* in, uint8_t* out, const size_t length, const AesKey128 & key, const uint8_t* iv ) {
+        return aessoft::encryptAES128CBC( in, out, length, encKeys( key ), iv );
+    },
+    []( const aes::CBCJob * jobs, const size_t count ) {
+        for( size_t i = 0; i < count; ++i ) {
+            aessoft::encryptAES128CBC( jobs[i].in, jobs[i].out, jobs[i].length, encKeys( *jobs[i].key ), jobs[i].iv );
+        }
+    },
+    []( const uint8_t* in, uint8_t* out, const size_t length, const AesKey128 & key, const uint8_t* iv ) {
+        return aessoft::decryptAES128CBC( in, out, length, decKeys( key ), iv );
+    },
+    []( const uint8_t* in, uint8_t* out, const size_t length, const AesKey128 & key, const uint64_t & nonce, const uint64_t & counter ) {
+        aessoft::cryptAES128CTR( in, out, length, encKeys( key ), nonce, counter );
+    },
+};
+
+const Kernels bitsliced = {
+    Backend::Bitsliced,
+    bitslice::encryptAES128ECB,
+    bitslice::decryptAES128ECB,
+    bitslice::encryptAES128CBC,
+    bitslice::encryptAES128CBC,
+    bitslice::decryptAES128CBC,
+    bitslice::cryptAES128CTR,
+};
+
+const Kernels aesNi = {
+    Backend::AesNi,
+    aesni::encryptAES128ECB,
+    aesni::decryptAES128ECB,
+    aesni::encryptAES128CBC,
+    aesni::encryptAES128CBC,
+    aesni::decryptAES128CBC,
+    aesni::cryptAES128CTR,
+};
+
+// CBC encryption is serial, it stays with aesni
+const Kernels vAes256 = {
+    Backend::VAes256,
+    vaes::avx2::encryptAES128ECB,
+    vaes::avx2::decryptAES128ECB,
+    aesni::encryptAES128CBC,
+    aesni::encryptAES128CBC,
+    vaes::avx2::decryptAES128CBC,
+    vaes::avx2::cryptAES128CTR,
+};
+
+const Kernels vAes512 = {
+    Backend::VAes512,
+    vaes::avx512::encryptAES128ECB,
+    vaes::avx512::decryptAES128ECB,
+    aesni::encryptAES128CBC,
+    aesni::encryptAES128CBC,
+    vaes::avx512::decryptAES128CBC,
+    vaes::avx512::cryptAES128CTR,
+};
+
+#ifdef WITH_OPENSSL
+const Kernels openSSL = {
+    Backend::OpenSSL,
+    openssl::encryptAES128ECB,
+    openssl::decryptAES128ECB,
+    openssl::encryptAES128CBC,
+    openssl::encryptAES128CBC,
+    openssl::decryptAES128CBC,
+    []( const uint8_t* in, uint8_t* out, const size_t length, const AesKey128 & key, const uint64_t & nonce, const uint64_t & counter ) {
+        openssl::cryptAES128CTR( in, out, length, key, nonce, counter );
+    },
+};
+#endif
+
+const Kernels* kernelsFor( const Backend& backend ) {
+    const cpu::Features& cpu = cpu::features();
+
+    switch( backend ) {
+        case Backend::Software:
+            return &software;
+
+        case Backend::Bitsliced:
+            return &bitsliced;
+
+        case Backend::AesNi:
+            return cpu.aes ? &aesNi : nullptr;
+
+        case Backend::VAes256:
+            return cpu.aes && cpu.vaes && cpu.avx2 ? &vAes256 : nullptr;
+
+        case Backend::VAes512:
+            return cpu.aes && cpu.vaes && cpu.avx512f ? &vAes512 : nullptr;
+
+        case Backend::OpenSSL:
+#ifdef WITH_OPENSSL
+            return &openSSL;
+#else
+            return nullptr;
+#endif
+    }
+
+    return nullptr;
+}
+
+const std::vector<Backend> all = {
+    Backend::Software,
+    Backend::Bitsliced,
+    Backend::AesNi,
+    Backend::VAes256,
+    Backend::VAes512,
+    Backend::OpenSSL,
+};
+
+//! the fastest supported backend, unless overridden by CRYPTOPALS_AES
+//! the table based software backend leaks through the cache and is never chosen automatically
+const Kernels* startup() {
+    const Kernels* kernels = &bitsliced;
+
+    for( Backend backend : { Backend::AesNi, Backend::VAes256, Backend::VAes512 } ) {
+        if( const Kernels* supported = kernelsFor( backend ) ) {
+            kernels = supported;
+        }
+    }
+
+    if( const char* name = std::getenv( "CRYPTOPALS_AES" ) ) {
+        bool found = false;
+
+        for( Backend backend : all ) {
+            std::ostringstream os;
+            os << backend;
+
+            if( os.str() == name ) {
+                found = true;
+
+                if( const Kernels* supported = kernelsFor( backend ) ) {
+                    kernels = supported;
+                } else {
+                    LOG( "Error: AES backend " << name << " is not supported" );
+                }
+            }
+        }
+
+        if( !found ) {
+            LOG( "Error: Unknown AES backend " << name );
+        }
+    }
+
+    return kernels;
+}
+
+const Kernels*& active() {
+    static const Kernels* kernels = startup();
+    return kernels;
+}
+
+}
+
+aes::Backend aes::backend() {
+    return active()->backend;
+}
+
+bool aes::setBackend( const Backend& backend ) {
+    const Kernels* kernels = kernelsFor( backend );
+
+    if( !kernels ) {
+        LOG( "Error: AES backend " << backend << " is not supported" );
+        return false;
+    }
+
+    active() = kernels;
+    return true;
+}
+
+bool aes::isSupported( const Backend& backend ) {
+    return kernelsFor( backend ) != nullptr;
+}
+
+std::vector<aes::Backend> aes::supportedBackends() {
+    std::vector<Backend> rv;
+
+    for( Backend backend : all ) {
+        if( isSupported( backend ) ) {
+            rv.push_back( backend );
+        }
+    }
+
+    return rv;
+}
+
+std::ostream& aes::operator<<( std::ostream& os, const Backend& backend ) {
+    switch( backend ) {
+        case Backend::Software:
+            os << "software";
+            break;
+
+        case Backend::Bitsliced:
+            os << "bitsliced";
+            break;
+
+        case Backend::AesNi:
+            os << "aesni";
+            break;
+
+        case Backend::VAes256:
+            os << "vaes256";
+            break;
+
+        case Backend::VAes512:
+            os << "vaes512";
+            break;
+
+        case Backend::OpenSSL:
+            os << "openssl";
+            break;
+    }
+
+    return os;
+}
+
+size_t aes::encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const AesKey128& key ) {
+    return active()->encryptECB( plaintext, ciphertext, length, key );
+}
+
+size_t aes::decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const AesKey128& key ) {
+    return active()->decryptECB( ciphertext, plaintext, length, key );
+}
+
+size_t aes::encryptAES128CBC( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length,
+                              const AesKey128& key, const uint8_t* iv ) {
+    return active()->encryptCBC( plaintext, ciphertext, length, key, iv );
+}
+
+void aes::encryptAES128CBC( const CBCJob* jobs, const size_t count ) {
+    active()->encryptCBCBatch( jobs, count );
+}
+
+size_t aes::decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length,
+                              const AesKey128& key, const uint8_t* iv ) {
+    return active()->decryptCBC( ciphertext, plaintext, length, key, iv );
+}
+
+void aes::cryptAES128CTR( const uint8_t* in, uint8_t* out, const size_t length,
+                          const AesKey128& key, const uint64_t& nonce, const uint64_t& counter ) {
+    active()->cryptCTR( in, out, length, key, nonce, counter );
+}
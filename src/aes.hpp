@@ -0,0 +1,54 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "aesni.hpp"
+
+//! AES-128 kernels dispatched at runtime to the fastest implementation this CPU supports,
+//! same interfaces as the aesni kernels
+namespace aes {
+
+using AesKey128 = aesni::AesKey128;
+using CBCJob = aesni::CBCJob;
+
+enum class Backend {
+    Software,  //!< portable table based reference, see aessoft.hpp
+    Bitsliced, //!< portable and constant time, 8 blocks at a time, see bitslice.hpp
+    AesNi,     //!< one block per instruction, 8 in flight
+    VAes256,   //!< VAES on AVX2 registers, 2 blocks per instruction
+    VAes512,   //!< VAES on AVX-512 registers, 4 blocks per instruction
+    OpenSSL,   //!< EVP, only with WITH_OPENSSL and never chosen automatically
+};
+
+//! \returns the backend in use, chosen once on first use: the fastest one supported, bitsliced without AES-NI
+//! or the one named by the environment variable CRYPTOPALS_AES, e.g. CRYPTOPALS_AES=aesni
+Backend backend();
+
+//! switches to \p backend for all following calls, not thread safe
+//! \returns false and keeps the current backend, if \p backend is not supported
+bool setBackend( const Backend& backend );
+
+bool isSupported( const Backend& backend );
+
+//! \returns all backends usable on this machine, slowest first
+std::vector<Backend> supportedBackends();
+
+std::ostream& operator<<( std::ostream& os, const Backend& backend );
+
+size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const AesKey128& key );
+size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const AesKey128& key );
+
+//! \p plaintext and \p ciphertext may be the same
+size_t encryptAES128CBC( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length,
+                         const AesKey128& key, const uint8_t* iv );
+void encryptAES128CBC( const CBCJob* jobs, const size_t count );
+//! \p ciphertext and \p plaintext may be the same
+size_t decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length,
+                         const AesKey128& key, const uint8_t* iv );
+
+//! \p in and \p out may be the same
+void cryptAES128CTR( const uint8_t* in, uint8_t* out, const size_t length,
+                     const AesKey128& key, const uint64_t& nonce, const uint64_t& counter = 0 );
+
+}
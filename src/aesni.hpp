@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
-#include <vector>
 #include <wmmintrin.h>
 
+#include "cpu.hpp"
+#include "aessoft.hpp"
+
 namespace {
 
 // via
@@ -22,64 +26,61 @@ inline __m128i AES_128_ASSIST( __m128i temp1, __m128i temp2 ) {
     return temp1;
 }
 
-std::vector<__m128i> AES_128_Key_Expansion( const __m128i* userkey ) {
-    std::vector<__m128i> key( 20 );
-
+//! expands \p userkey into 11 encryption round keys \p enc
+//! and 11 decryption round keys \p dec for the equivalent inverse cipher
+CPU_TARGET( "aes" )
+inline void AES_128_Key_Expansion( const uint8_t* userkey, __m128i* enc, __m128i* dec ) {
     __m128i temp1, temp2;
-    temp1 = _mm_loadu_si128( userkey );
-    key[0] = temp1;
+    temp1 = _mm_loadu_si128( ( const __m128i* )userkey );
+    enc[0] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x1 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[1] = temp1;
+    enc[1] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x2 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[2] = temp1;
+    enc[2] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x4 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[3] = temp1;
+    enc[3] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x8 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[4] = temp1;
+    enc[4] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x10 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[5] = temp1;
+    enc[5] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x20 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[6] = temp1;
+    enc[6] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x40 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[7] = temp1;
+    enc[7] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x80 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[8] = temp1;
+    enc[8] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x1b );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[9] = temp1;
+    enc[9] = temp1;
 
     temp2 = _mm_aeskeygenassist_si128( temp1, 0x36 );
     temp1 = AES_128_ASSIST( temp1, temp2 );
-    key[10] = temp1;
+    enc[10] = temp1;
 
-    key[11] = _mm_aesimc_si128( key[9] );
-    key[12] = _mm_aesimc_si128( key[8] );
-    key[13] = _mm_aesimc_si128( key[7] );
-    key[14] = _mm_aesimc_si128( key[6] );
-    key[15] = _mm_aesimc_si128( key[5] );
-    key[16] = _mm_aesimc_si128( key[4] );
-    key[17] = _mm_aesimc_si128( key[3] );
-    key[18] = _mm_aesimc_si128( key[2] );
-    key[19] = _mm_aesimc_si128( key[1] );
+    dec[0] = enc[10];
+
+    for( size_t i = 1; i < 10; ++i ) {
+        dec[i] = _mm_aesimc_si128( enc[10 - i] );
+    }
 
-    return key;
+    dec[10] = enc[0];
 }
 
 }
@@ -89,48 +90,397 @@ namespace aesni {
 const size_t blockSize = 16;
 const size_t rounds = 10;
 
-inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const uint8_t* userkey ) {
-    size_t j = 0;
-    size_t blocks = length / 16;
-    __m128i tmp;
+//! AES-128 key with expanded encryption and decryption round keys,
+//! expand once and reuse it for any number of blocks
+struct AesKey128 {
+    AesKey128() = default;
+    explicit AesKey128( const uint8_t* userkey ) {
+        if( cpu::features().aes ) {
+            AES_128_Key_Expansion( userkey, enc, dec );
+        } else {
+            aessoft::expandKey128( userkey, reinterpret_cast<uint8_t*>( enc ), reinterpret_cast<uint8_t*>( dec ) );
+        }
+    }
 
-    std::vector<__m128i> key = AES_128_Key_Expansion( ( __m128i* )userkey );
+    //! \returns the raw 16 byte key, which is the first round key
+    const uint8_t* data() const {
+        return reinterpret_cast<const uint8_t*>( &enc[0] );
+    }
 
-    for( size_t i = 0; i < blocks; ++i ) {
-        tmp = _mm_loadu_si128( &( ( __m128i* )plaintext )[i] );
-        tmp = _mm_xor_si128( tmp, key[0] );
+    alignas( 16 ) __m128i enc[rounds + 1];
+    alignas( 16 ) __m128i dec[rounds + 1];
+};
+
+CPU_TARGET( "aes" )
+inline __m128i encryptBlock( __m128i tmp, const AesKey128& key ) {
+    tmp = _mm_xor_si128( tmp, key.enc[0] );
+
+    for( size_t j = 1; j < rounds; j++ ) {
+        tmp = _mm_aesenc_si128( tmp, key.enc[j] );
+    }
+
+    return _mm_aesenclast_si128( tmp, key.enc[rounds] );
+}
+
+CPU_TARGET( "aes" )
+inline __m128i decryptBlock( __m128i tmp, const AesKey128& key ) {
+    tmp = _mm_xor_si128( tmp, key.dec[0] );
 
-        for( j = 1; j < rounds; j++ ) {
-            tmp = _mm_aesenc_si128( tmp, key[j] );
+    for( size_t j = 1; j < rounds; j++ ) {
+        tmp = _mm_aesdec_si128( tmp, key.dec[j] );
+    }
+
+    return _mm_aesdeclast_si128( tmp, key.dec[rounds] );
+}
+
+//! encrypts \p N independent blocks round by round,
+//! so the aesenc latency of one block is hidden behind the others.
+//! The loops are unrolled explicitly, rolled ones keep \p b on the stack in builds without -Ofast.
+template<size_t N>
+CPU_TARGET( "aes" )
+inline void encryptBlocks( __m128i* b, const AesKey128& key ) {
+    #pragma GCC unroll 16
+    for( size_t k = 0; k < N; ++k ) {
+        b[k] = _mm_xor_si128( b[k], key.enc[0] );
+    }
+
+    #pragma GCC unroll 16
+    for( size_t j = 1; j < rounds; j++ ) {
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < N; ++k ) {
+            b[k] = _mm_aesenc_si128( b[k], key.enc[j] );
         }
+    }
 
-        tmp = _mm_aesenclast_si128( tmp, key[j] );
-        _mm_storeu_si128( &( ( __m128i* )ciphertext )[i], tmp );
+    #pragma GCC unroll 16
+    for( size_t k = 0; k < N; ++k ) {
+        b[k] = _mm_aesenclast_si128( b[k], key.enc[rounds] );
+    }
+}
+
+//! decrypts \p N independent blocks round by round
+template<size_t N>
+CPU_TARGET( "aes" )
+inline void decryptBlocks( __m128i* b, const AesKey128& key ) {
+    #pragma GCC unroll 16
+    for( size_t k = 0; k < N; ++k ) {
+        b[k] = _mm_xor_si128( b[k], key.dec[0] );
+    }
+
+    #pragma GCC unroll 16
+    for( size_t j = 1; j < rounds; j++ ) {
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < N; ++k ) {
+            b[k] = _mm_aesdec_si128( b[k], key.dec[j] );
+        }
+    }
+
+    #pragma GCC unroll 16
+    for( size_t k = 0; k < N; ++k ) {
+        b[k] = _mm_aesdeclast_si128( b[k], key.dec[rounds] );
+    }
+}
+
+//! blocks in flight in the pipelined kernels
+const size_t parallel = 8;
+
+CPU_TARGET( "aes" )
+inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const AesKey128& key ) {
+    size_t blocks = length / blockSize;
+    const __m128i* in = ( const __m128i* )plaintext;
+    __m128i* out = ( __m128i* )ciphertext;
+    size_t pipelined = blocks - blocks % parallel;
+    __m128i b[parallel];
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            b[k] = _mm_loadu_si128( &in[i + k] );
+        }
+
+        encryptBlocks<parallel>( b, key );
+
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            _mm_storeu_si128( &out[i + k], b[k] );
+        }
+    }
+
+    // tail
+    for( size_t i = pipelined; i < blocks; ++i ) {
+        _mm_storeu_si128( &out[i], encryptBlock( _mm_loadu_si128( &in[i] ), key ) );
     }
 
     return length;
 }
 
-inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const uint8_t* userkey ) {
-    size_t j = 0;
-    size_t blocks = length / 16;
-    __m128i tmp;
+CPU_TARGET( "aes" )
+inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const AesKey128& key ) {
+    size_t blocks = length / blockSize;
+    const __m128i* in = ( const __m128i* )ciphertext;
+    __m128i* out = ( __m128i* )plaintext;
+    size_t pipelined = blocks - blocks % parallel;
+    __m128i b[parallel];
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            b[k] = _mm_loadu_si128( &in[i + k] );
+        }
+
+        decryptBlocks<parallel>( b, key );
+
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            _mm_storeu_si128( &out[i + k], b[k] );
+        }
+    }
+
+    // tail
+    for( size_t i = pipelined; i < blocks; ++i ) {
+        _mm_storeu_si128( &out[i], decryptBlock( _mm_loadu_si128( &in[i] ), key ) );
+    }
+
+    return length;
+}
 
-    std::vector<__m128i> key = AES_128_Key_Expansion( ( __m128i* )userkey );
+//! CBC encrypts \p length bytes, \p iv is the block before \p plaintext.
+//! Each block depends on the one before, so this is latency bound.
+//! \p plaintext and \p ciphertext may be the same.
+CPU_TARGET( "aes" )
+inline size_t encryptAES128CBC( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length,
+                                const AesKey128& key, const uint8_t* iv ) {
+    size_t blocks = length / blockSize;
+    const __m128i* in = ( const __m128i* )plaintext;
+    __m128i* out = ( __m128i* )ciphertext;
+    __m128i previous = _mm_loadu_si128( ( const __m128i* )iv );
 
     for( size_t i = 0; i < blocks; ++i ) {
-        tmp = _mm_loadu_si128( &( ( __m128i* )ciphertext )[i] );
-        tmp = _mm_xor_si128( tmp, key[10] );
+        previous = encryptBlock( _mm_xor_si128( _mm_loadu_si128( &in[i] ), previous ), key );
+        _mm_storeu_si128( &out[i], previous );
+    }
+
+    return length;
+}
+
+//! one independent CBC message for the interleaved batch encryption
+struct CBCJob {
+    const uint8_t* in;
+    uint8_t* out;
+    //! a non zero multiple of the block size, pad before, e.g. with crypto::padPKCS7()
+    size_t length;
+    const AesKey128* key;
+    const uint8_t* iv;
+};
+
+//! CBC encrypts \p count independent messages. Up to 8 block chains run interleaved
+//! through the AES pipeline, a finished lane picks up the next message.
+CPU_TARGET( "aes" )
+inline void encryptAES128CBC( const CBCJob* jobs, const size_t count ) {
+    for( size_t i = 0; i < count; ++i ) {
+        assert( jobs[i].length && jobs[i].length % blockSize == 0 );
+    }
+
+    // idle lanes encrypt this block in place, so the round loops need no branches
+    alignas( 16 ) __m128i idle[parallel];
+    const uint8_t* in[parallel];
+    uint8_t* out[parallel];
+    size_t step[parallel];
+    size_t left[parallel];
+    const __m128i* keys[parallel];
+    __m128i b[parallel];
+    size_t next = 0;
+    size_t active = 0;
+
+    // next message for lane \p k or idle, without asserts empty ones are skipped
+    auto assign = [&]( const size_t & k ) {
+        while( next < count && jobs[next].length < blockSize ) {
+            ++next;
+        }
 
-        for( j = 1; j < rounds; j++ ) {
-            tmp = _mm_aesdec_si128( tmp, key[10 + j] );
+        if( next == count ) {
+            in[k] = ( const uint8_t* )&idle[k];
+            out[k] = ( uint8_t* )&idle[k];
+            step[k] = 0;
+            left[k] = 0;
+            return;
         }
 
-        tmp = _mm_aesdeclast_si128( tmp, key[0] );
-        _mm_storeu_si128( &( ( __m128i* )plaintext )[i], tmp );
+        const CBCJob& job = jobs[next++];
+        in[k] = job.in;
+        out[k] = job.out;
+        step[k] = blockSize;
+        left[k] = job.length / blockSize;
+        keys[k] = job.key->enc;
+        b[k] = _mm_loadu_si128( ( const __m128i* )job.iv );
+        ++active;
+    };
+
+    if( !count ) {
+        return;
+    }
+
+    #pragma GCC unroll 16
+    for( size_t k = 0; k < parallel; ++k ) {
+        keys[k] = jobs[0].key->enc;
+        assign( k );
+    }
+
+    while( active ) {
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            b[k] = _mm_xor_si128( b[k], _mm_loadu_si128( ( const __m128i* )in[k] ) );
+            b[k] = _mm_xor_si128( b[k], keys[k][0] );
+            in[k] += step[k];
+        }
+
+        #pragma GCC unroll 16
+        for( size_t j = 1; j < rounds; j++ ) {
+            #pragma GCC unroll 16
+            for( size_t k = 0; k < parallel; ++k ) {
+                b[k] = _mm_aesenc_si128( b[k], keys[k][j] );
+            }
+        }
+
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            b[k] = _mm_aesenclast_si128( b[k], keys[k][rounds] );
+            _mm_storeu_si128( ( __m128i* )out[k], b[k] );
+            out[k] += step[k];
+        }
+
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            if( left[k] && !--left[k] ) {
+                --active;
+                assign( k );
+            }
+        }
+    }
+}
+
+//! CBC decrypts \p length bytes, \p iv is the ciphertext block before \p ciphertext.
+//! Blocks don't depend on each other, so they run through the pipelined kernel
+//! and get XORed with the shifted ciphertext. \p ciphertext and \p plaintext may be the same.
+CPU_TARGET( "aes" )
+inline size_t decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length,
+                                const AesKey128& key, const uint8_t* iv ) {
+    size_t blocks = length / blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    const __m128i* in = ( const __m128i* )ciphertext;
+    __m128i* out = ( __m128i* )plaintext;
+    __m128i previous = _mm_loadu_si128( ( const __m128i* )iv );
+    __m128i b[parallel];
+    __m128i c[parallel];
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            c[k] = _mm_loadu_si128( &in[i + k] );
+            b[k] = c[k];
+        }
+
+        decryptBlocks<parallel>( b, key );
+
+        _mm_storeu_si128( &out[i], _mm_xor_si128( b[0], previous ) );
+
+        for( size_t k = 1; k < parallel; ++k ) {
+            _mm_storeu_si128( &out[i + k], _mm_xor_si128( b[k], c[k - 1] ) );
+        }
+
+        previous = c[parallel - 1];
+    }
+
+    // tail
+    for( size_t i = pipelined; i < blocks; ++i ) {
+        __m128i current = _mm_loadu_si128( &in[i] );
+        _mm_storeu_si128( &out[i], _mm_xor_si128( decryptBlock( current, key ), previous ) );
+        previous = current;
     }
 
     return length;
 }
 
+//! XORs \p length bytes of \p in with the CTR keystream into \p out, \p in and \p out may be the same.
+//! Counter blocks are the little endian \p nonce followed by the little endian block counter,
+//! starting at \p counter. A partial last block uses only the needed keystream bytes, no padding.
+CPU_TARGET( "aes" )
+inline void cryptAES128CTR( const uint8_t* in, uint8_t* out, const size_t length,
+                            const AesKey128& key, const uint64_t& nonce, const uint64_t& counter = 0 ) {
+    size_t blocks = length / blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    const __m128i* src = ( const __m128i* )in;
+    __m128i* dst = ( __m128i* )out;
+
+    const __m128i one = _mm_set_epi64x( 1, 0 );
+    __m128i ctr = _mm_set_epi64x( static_cast<long long>( counter ), static_cast<long long>( nonce ) );
+    __m128i b[parallel];
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            b[k] = ctr;
+            ctr = _mm_add_epi64( ctr, one );
+        }
+
+        encryptBlocks<parallel>( b, key );
+
+        #pragma GCC unroll 16
+        for( size_t k = 0; k < parallel; ++k ) {
+            _mm_storeu_si128( &dst[i + k], _mm_xor_si128( b[k], _mm_loadu_si128( &src[i + k] ) ) );
+        }
+    }
+
+    for( size_t i = pipelined; i < blocks; ++i ) {
+        __m128i stream = encryptBlock( ctr, key );
+        ctr = _mm_add_epi64( ctr, one );
+        _mm_storeu_si128( &dst[i], _mm_xor_si128( stream, _mm_loadu_si128( &src[i] ) ) );
+    }
+
+    size_t rest = length % blockSize;
+
+    if( rest ) {
+        alignas( 16 ) uint8_t stream[blockSize];
+        _mm_store_si128( ( __m128i* )stream, encryptBlock( ctr, key ) );
+
+        for( size_t i = length - rest, j = 0; i < length; ++i, ++j ) {
+            out[i] = in[i] ^ stream[j];
+        }
+    }
+}
+
+//! one block after the other, latency bound, used as benchmark reference
+CPU_TARGET( "aes" )
+inline size_t encryptAES128ECBSerial( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const AesKey128& key ) {
+    size_t blocks = length / blockSize;
+
+    for( size_t i = 0; i < blocks; ++i ) {
+        __m128i tmp = _mm_loadu_si128( &( ( const __m128i* )plaintext )[i] );
+        _mm_storeu_si128( &( ( __m128i* )ciphertext )[i], encryptBlock( tmp, key ) );
+    }
+
+    return length;
+}
+
+//! one block after the other, latency bound, used as benchmark reference
+CPU_TARGET( "aes" )
+inline size_t decryptAES128ECBSerial( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const AesKey128& key ) {
+    size_t blocks = length / blockSize;
+
+    for( size_t i = 0; i < blocks; ++i ) {
+        __m128i tmp = _mm_loadu_si128( &( ( const __m128i* )ciphertext )[i] );
+        _mm_storeu_si128( &( ( __m128i* )plaintext )[i], decryptBlock( tmp, key ) );
+    }
+
+    return length;
+}
+
+inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const uint8_t* userkey ) {
+    return encryptAES128ECB( plaintext, ciphertext, length, AesKey128( userkey ) );
+}
+
+inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const uint8_t* userkey ) {
+    return decryptAES128ECB( ciphertext, plaintext, length, AesKey128( userkey ) );
+}
+
 }
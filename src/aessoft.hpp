@@ -0,0 +1,285 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+//! portable byte oriented AES-128 for CPUs without AES-NI,
+//! same round key layout as aesni::AesKey128
+//! \note the S-box lookups in the rounds are indexed by secret data, they are not constant time,
+//! see bitslice.hpp for that. The key schedule computes the S-box without lookups
+namespace aessoft {
+
+const size_t blockSize = 16;
+const size_t rounds = 10;
+
+const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+const uint8_t inverseSbox[256] = {
+    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+    0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+    0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+    0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+    0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+    0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+    0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+    0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+    0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+    0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+    0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d,
+};
+
+//! multiplies \p a by x in GF(2^8)
+inline uint8_t xtime( const uint8_t& a ) {
+    return static_cast<uint8_t>( ( a << 1 ) ^ ( ( a >> 7 ) * 0x1b ) );
+}
+
+//! multiplies \p a by \p b in GF(2^8) without branches
+inline uint8_t multiply( uint8_t a, uint8_t b ) {
+    uint8_t product = 0;
+
+    for( size_t i = 0; i < 8; ++i, b >>= 1 ) {
+        product ^= a & static_cast<uint8_t>( -( b & 1 ) );
+        a = xtime( a );
+    }
+
+    return product;
+}
+
+//! the S-box computed without lookups, for the key schedule which must not leak the key through the cache
+inline uint8_t substitute( const uint8_t& x ) {
+    // the inverse is x^254, with 0 mapping to 0
+    uint8_t x2 = multiply( x, x );
+    uint8_t x3 = multiply( x2, x );
+    uint8_t x12 = multiply( multiply( x3, x3 ), multiply( x3, x3 ) );
+    uint8_t x15 = multiply( x12, x3 );
+    uint8_t x240 = x15;
+
+    for( size_t i = 0; i < 4; ++i ) {
+        x240 = multiply( x240, x240 );
+    }
+
+    uint8_t inverse = multiply( multiply( x240, x12 ), x2 );
+    auto rotate = [inverse]( const unsigned & n ) {
+        return static_cast<uint8_t>( ( inverse << n ) | ( inverse >> ( 8 - n ) ) );
+    };
+
+    return inverse ^ rotate( 1 ) ^ rotate( 2 ) ^ rotate( 3 ) ^ rotate( 4 ) ^ 0x63;
+}
+
+// the state is column major, byte 4 * column + row
+
+inline void subShiftRows( uint8_t* s ) {
+    uint8_t t[blockSize];
+
+    for( size_t c = 0; c < 4; ++c ) {
+        for( size_t r = 0; r < 4; ++r ) {
+            t[4 * c + r] = sbox[s[4 * ( ( c + r ) % 4 ) + r]];
+        }
+    }
+
+    std::memcpy( s, t, blockSize );
+}
+
+inline void inverseSubShiftRows( uint8_t* s ) {
+    uint8_t t[blockSize];
+
+    for( size_t c = 0; c < 4; ++c ) {
+        for( size_t r = 0; r < 4; ++r ) {
+            t[4 * ( ( c + r ) % 4 ) + r] = inverseSbox[s[4 * c + r]];
+        }
+    }
+
+    std::memcpy( s, t, blockSize );
+}
+
+inline void mixColumns( uint8_t* s ) {
+    for( size_t c = 0; c < 4; ++c ) {
+        uint8_t* col = s + 4 * c;
+        uint8_t all = col[0] ^ col[1] ^ col[2] ^ col[3];
+        uint8_t first = col[0];
+
+        for( size_t r = 0; r < 4; ++r ) {
+            uint8_t next = r < 3 ? col[r + 1] : first;
+            col[r] ^= all ^ xtime( col[r] ^ next );
+        }
+    }
+}
+
+//! InvMixColumns as a cheap preprocessing step followed by MixColumns
+inline void inverseMixColumns( uint8_t* s ) {
+    for( size_t c = 0; c < 4; ++c ) {
+        uint8_t* col = s + 4 * c;
+        uint8_t u = xtime( xtime( col[0] ^ col[2] ) );
+        uint8_t v = xtime( xtime( col[1] ^ col[3] ) );
+        col[0] ^= u;
+        col[1] ^= v;
+        col[2] ^= u;
+        col[3] ^= v;
+    }
+
+    mixColumns( s );
+}
+
+inline void addRoundKey( uint8_t* s, const uint8_t* roundKey ) {
+    for( size_t i = 0; i < blockSize; ++i ) {
+        s[i] ^= roundKey[i];
+    }
+}
+
+//! expands \p userkey into 11 encryption round keys \p enc
+//! and 11 decryption round keys \p dec for the equivalent inverse cipher, 176 bytes each
+inline void expandKey128( const uint8_t* userkey, uint8_t* enc, uint8_t* dec ) {
+    static const uint8_t rcon[rounds] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+
+    std::memcpy( enc, userkey, blockSize );
+
+    for( size_t i = 4; i < 4 * ( rounds + 1 ); ++i ) {
+        uint8_t* word = enc + 4 * i;
+        const uint8_t* previous = word - 4;
+
+        if( i % 4 == 0 ) {
+            word[0] = substitute( previous[1] ) ^ rcon[i / 4 - 1];
+            word[1] = substitute( previous[2] );
+            word[2] = substitute( previous[3] );
+            word[3] = substitute( previous[0] );
+        } else {
+            std::memcpy( word, previous, 4 );
+        }
+
+        for( size_t j = 0; j < 4; ++j ) {
+            word[j] ^= word[j - 16];
+        }
+    }
+
+    std::memcpy( dec, enc + rounds * blockSize, blockSize );
+
+    for( size_t i = 1; i < rounds; ++i ) {
+        std::memcpy( dec + i * blockSize, enc + ( rounds - i ) * blockSize, blockSize );
+        inverseMixColumns( dec + i * blockSize );
+    }
+
+    std::memcpy( dec + rounds * blockSize, enc, blockSize );
+}
+
+inline void encryptBlock( const uint8_t* in, uint8_t* out, const uint8_t* enc ) {
+    uint8_t s[blockSize];
+    std::memcpy( s, in, blockSize );
+    addRoundKey( s, enc );
+
+    for( size_t j = 1; j < rounds; ++j ) {
+        subShiftRows( s );
+        mixColumns( s );
+        addRoundKey( s, enc + j * blockSize );
+    }
+
+    subShiftRows( s );
+    addRoundKey( s, enc + rounds * blockSize );
+    std::memcpy( out, s, blockSize );
+}
+
+//! equivalent inverse cipher, the same steps as aesdec and aesdeclast
+inline void decryptBlock( const uint8_t* in, uint8_t* out, const uint8_t* dec ) {
+    uint8_t s[blockSize];
+    std::memcpy( s, in, blockSize );
+    addRoundKey( s, dec );
+
+    for( size_t j = 1; j < rounds; ++j ) {
+        inverseSubShiftRows( s );
+        inverseMixColumns( s );
+        addRoundKey( s, dec + j * blockSize );
+    }
+
+    inverseSubShiftRows( s );
+    addRoundKey( s, dec + rounds * blockSize );
+    std::memcpy( out, s, blockSize );
+}
+
+inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const uint8_t* enc ) {
+    for( size_t i = 0; i + blockSize <= length; i += blockSize ) {
+        encryptBlock( plaintext + i, ciphertext + i, enc );
+    }
+
+    return length;
+}
+
+inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const uint8_t* dec ) {
+    for( size_t i = 0; i + blockSize <= length; i += blockSize ) {
+        decryptBlock( ciphertext + i, plaintext + i, dec );
+    }
+
+    return length;
+}
+
+//! \p plaintext and \p ciphertext may be the same
+inline size_t encryptAES128CBC( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length,
+                                const uint8_t* enc, const uint8_t* iv ) {
+    uint8_t previous[blockSize];
+    std::memcpy( previous, iv, blockSize );
+
+    for( size_t i = 0; i + blockSize <= length; i += blockSize ) {
+        addRoundKey( previous, plaintext + i );
+        encryptBlock( previous, previous, enc );
+        std::memcpy( ciphertext + i, previous, blockSize );
+    }
+
+    return length;
+}
+
+//! \p ciphertext and \p plaintext may be the same
+inline size_t decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length,
+                                const uint8_t* dec, const uint8_t* iv ) {
+    uint8_t previous[blockSize];
+    uint8_t current[blockSize];
+    std::memcpy( previous, iv, blockSize );
+
+    for( size_t i = 0; i + blockSize <= length; i += blockSize ) {
+        std::memcpy( current, ciphertext + i, blockSize );
+        decryptBlock( current, plaintext + i, dec );
+        addRoundKey( plaintext + i, previous );
+        std::memcpy( previous, current, blockSize );
+    }
+
+    return length;
+}
+
+//! same counter layout as aesni::cryptAES128CTR
+inline void cryptAES128CTR( const uint8_t* in, uint8_t* out, const size_t length,
+                            const uint8_t* enc, const uint64_t& nonce, uint64_t counter = 0 ) {
+    uint8_t block[blockSize];
+    uint8_t stream[blockSize];
+    std::memcpy( block, &nonce, sizeof( nonce ) );
+
+    for( size_t i = 0; i < length; i += blockSize, ++counter ) {
+        std::memcpy( block + sizeof( nonce ), &counter, sizeof( counter ) );
+        encryptBlock( block, stream, enc );
+
+        for( size_t j = 0; j < blockSize && i + j < length; ++j ) {
+            out[i + j] = in[i + j] ^ stream[j];
+        }
+    }
+}
+
+}
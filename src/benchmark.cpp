@@ -0,0 +1,495 @@
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <sstream>
+
+#include "utils.hpp"
+#include "aes.hpp"
+#include "aesni.hpp"
+#include "cpu.hpp"
+#include "crypto.hpp"
+#include "cracker.hpp"
+#include "hash.hpp"
+#include "hashbatch.hpp"
+#include "random.hpp"
+#include "stopwatch.hpp"
+#include "log.hpp"
+
+#ifdef WITH_OPENSSL
+#include "openssl.hpp"
+#endif
+
+namespace {
+
+//! runs \p func once for warmup and then \p runs times
+//! \returns the best throughput for \p bytes per run in GB/s
+double throughput( const std::function<void()>& func, const size_t& bytes, const size_t& runs = 5 ) {
+    StopWatch sw;
+    StopWatch::ns_type best = -1;
+
+    func();
+
+    for( size_t i = 0; i < runs; ++i ) {
+        sw.start();
+        func();
+        StopWatch::ns_type ns = sw.stop();
+
+        if( best < 0 || ns < best ) {
+            best = ns;
+        }
+    }
+
+    return static_cast<double>( bytes ) / static_cast<double>( std::max<StopWatch::ns_type>( best, 1 ) );
+}
+
+void report( const std::string& name, const double& gbps ) {
+    LOG( utils::format( "%-32s %7.2f GB/s", name.c_str(), gbps ) );
+}
+
+struct Timing {
+    double ns = 0;
+    double cycles = 0;
+};
+
+//! runs \p func once for warmup and then \p runs times
+//! \returns the time and time stamp counter cycles of the fastest run
+Timing measure( const std::function<void()>& func, const size_t& runs ) {
+    StopWatch sw;
+    Timing best;
+
+    func();
+
+    for( size_t i = 0; i < runs; ++i ) {
+        uint64_t start = cpu::cycles();
+        sw.start();
+        func();
+        StopWatch::ns_type ns = sw.stop();
+        uint64_t cycles = cpu::cycles() - start;
+
+        if( i == 0 || ns < best.ns ) {
+            best.ns = static_cast<double>( std::max<StopWatch::ns_type>( ns, 1 ) );
+            best.cycles = static_cast<double>( cycles );
+        }
+    }
+
+    return best;
+}
+
+std::string sizeName( const size_t& size ) {
+    if( size >= 1024 * 1024 ) {
+        return std::to_string( size / 1024 / 1024 ) + " MiB";
+    } else if( size >= 1024 ) {
+        return std::to_string( size / 1024 ) + " KiB";
+    }
+
+    return std::to_string( size ) + " B";
+}
+
+//! hashes each of \p messages on its own with the compression \p Ctx is built on
+template<class Ctx>
+void hashEach( std::span<const std::span<const uint8_t>> messages, uint8_t* digests, const typename Ctx::Magics& magics ) {
+    Ctx ctx;
+
+    for( size_t i = 0; i < messages.size(); ++i ) {
+        ctx.init( magics );
+        ctx.update( messages[i] );
+        ctx.final( digests + Ctx::digestSize * i );
+    }
+}
+
+//! one way of hashing a number of messages of the same size
+struct HashPath {
+    std::string name;
+    std::function<void( std::span<const std::span<const uint8_t>>, uint8_t* )> hash;
+    //! the digest of one message, each of the batch is compared with it
+    std::function<Bytes( const Bytes& )> reference;
+    //! larger messages are skipped
+    size_t maxSize = std::numeric_limits<size_t>::max();
+};
+
+}
+
+void benchmarkAES() {
+    Bytes key = randombuffer::get( aesni::blockSize );
+    aesni::AesKey128 expanded( key.data() );
+
+    for( size_t size : { 4 * 1024 * 1024, 64 * 1024 * 1024 } ) {
+        LOG( "AES-128, " << size / 1024 / 1024 << " MiB" );
+        Bytes plain = randombuffer::get( size );
+        Bytes serial( size );
+        Bytes pipelined( size );
+        Bytes decrypted( size );
+
+        report( "aesni encrypt serial", throughput( [&] {
+            aesni::encryptAES128ECBSerial( plain.data(), serial.data(), size, expanded );
+        }, size ) );
+        report( "aesni encrypt pipelined", throughput( [&] {
+            aesni::encryptAES128ECB( plain.data(), pipelined.data(), size, expanded );
+        }, size ) );
+        CHECK( serial == pipelined );
+
+        report( "aesni decrypt serial", throughput( [&] {
+            aesni::decryptAES128ECBSerial( pipelined.data(), decrypted.data(), size, expanded );
+        }, size ) );
+        report( "aesni decrypt pipelined", throughput( [&] {
+            aesni::decryptAES128ECB( pipelined.data(), decrypted.data(), size, expanded );
+        }, size ) );
+        CHECK( plain == decrypted );
+
+        Bytes ctr( size );
+        report( "aesni CTR", throughput( [&] {
+            aesni::cryptAES128CTR( plain.data(), ctr.data(), size, expanded, 42 );
+        }, size ) );
+        aesni::cryptAES128CTR( ctr.data(), decrypted.data(), size, expanded, 42 );
+        CHECK( plain == decrypted );
+
+#ifdef WITH_OPENSSL
+        Bytes ossl( size );
+        report( "openssl encrypt", throughput( [&] {
+            openssl::encryptAES128ECB( plain.data(), ossl.data(), size, key.data() );
+        }, size ) );
+        CHECK( ossl == pipelined );
+
+        report( "openssl decrypt", throughput( [&] {
+            openssl::decryptAES128ECB( pipelined.data(), decrypted.data(), size, key.data() );
+        }, size ) );
+        CHECK( plain == decrypted );
+
+        report( "openssl CTR", throughput( [&] {
+            openssl::cryptAES128CTR( plain.data(), decrypted.data(), size, expanded, 42 );
+        }, size ) );
+        CHECK( ctr == decrypted );
+#else
+        LOG( "openssl not linked, build with openssl.pri to compare" );
+#endif
+
+        // every backend the runtime dispatch can pick on this machine
+        aes::Backend initial = aes::backend();
+        LOG( "dispatch uses " << initial );
+
+        for( aes::Backend backend : aes::supportedBackends() ) {
+            // the portable fallbacks would take minutes on the big buffer
+            if( ( backend == aes::Backend::Software || backend == aes::Backend::Bitsliced ) && size > 4 * 1024 * 1024 ) {
+                continue;
+            }
+
+            aes::setBackend( backend );
+            std::ostringstream name;
+            name << backend;
+            Bytes encrypted( size );
+
+            report( name.str() + " encrypt", throughput( [&] {
+                aes::encryptAES128ECB( plain.data(), encrypted.data(), size, expanded );
+            }, size ) );
+            CHECK( encrypted == pipelined );
+
+            report( name.str() + " decrypt", throughput( [&] {
+                aes::decryptAES128ECB( pipelined.data(), decrypted.data(), size, expanded );
+            }, size ) );
+            CHECK( plain == decrypted );
+
+            report( name.str() + " CBC decrypt", throughput( [&] {
+                aes::decryptAES128CBC( pipelined.data(), decrypted.data(), size, expanded, key.data() );
+            }, size ) );
+
+            report( name.str() + " CTR", throughput( [&] {
+                aes::cryptAES128CTR( plain.data(), encrypted.data(), size, expanded, 42 );
+            }, size ) );
+            CHECK( encrypted == ctr );
+        }
+
+        aes::setBackend( initial );
+
+        // authenticated in one pass against CTR followed by a MAC pass
+        Bytes iv = randombuffer::get( 12 );
+        Bytes sealed;
+        report( "GCM encrypt", throughput( [&] {
+            sealed = crypto::encryptAES128GCM( plain, expanded, iv );
+        }, size ) );
+        report( "GCM decrypt", throughput( [&] {
+            decrypted = crypto::decryptAES128GCM( sealed, expanded, iv );
+        }, size ) );
+        CHECK( plain == decrypted );
+
+        report( "CTR + HMAC-SHA1", throughput( [&] {
+            aes::cryptAES128CTR( plain.data(), ctr.data(), size, expanded, 42 );
+            crypto::hmacSha1( ctr, key );
+        }, size ) );
+    }
+
+    // many small independent CBC records
+    const size_t records = 10000;
+    std::vector<Bytes> texts;
+    std::vector<Bytes> ivs;
+    std::vector<crypto::AesKey128> keys;
+    size_t total = 0;
+
+    for( size_t i = 0; i < records; ++i ) {
+        texts.push_back( randombuffer::get( crypto::randSize( 0, 1024 ) ) );
+        ivs.push_back( crypto::genKey() );
+        keys.emplace_back( crypto::genKey().data() );
+        total += texts.back().size();
+    }
+
+    LOG( "AES-128 CBC, " << records << " records, " << total / 1024 << " KiB" );
+
+    // padded records, encrypted in place
+    std::vector<Bytes> single;
+    std::vector<Bytes> batch;
+
+    for( size_t i = 0; i < records; ++i ) {
+        single.push_back( crypto::padPKCS7( texts[i] ) );
+        batch.push_back( single.back() );
+    }
+
+    // per call overhead, e.g. the EVP context setup, dominates small records
+    aes::Backend initial = aes::backend();
+
+    for( aes::Backend backend : aes::supportedBackends() ) {
+        aes::setBackend( backend );
+        std::ostringstream name;
+        name << backend << " CBC encrypt one by one";
+
+        report( name.str(), throughput( [&] {
+            for( size_t i = 0; i < records; ++i ) {
+                aes::encryptAES128CBC( single[i].data(), batch[i].data(), single[i].size(), keys[i], ivs[i].data() );
+            }
+        }, total ) );
+    }
+
+    aes::setBackend( initial );
+    batch = single;
+    std::vector<aesni::CBCJob> jobs;
+
+    for( size_t i = 0; i < records; ++i ) {
+        jobs.push_back( { batch[i].data(), batch[i].data(), batch[i].size(), &keys[i], ivs[i].data() } );
+    }
+
+    report( "aesni CBC encrypt one by one", throughput( [&] {
+        for( size_t i = 0; i < records; ++i ) {
+            aesni::encryptAES128CBC( single[i].data(), single[i].data(), single[i].size(), keys[i], ivs[i].data() );
+        }
+    }, total ) );
+    report( "aesni CBC encrypt interleaved", throughput( [&] {
+        aesni::encryptAES128CBC( jobs.data(), jobs.size() );
+    }, total ) );
+
+    // both ran in place over and over, so check one interleaved run on fresh copies against single records
+    for( size_t i = 0; i < records; ++i ) {
+        single[i] = crypto::encryptAES128CBC( texts[i], keys[i], ivs[i] );
+        batch[i] = crypto::padPKCS7( texts[i] );
+        jobs[i] = { batch[i].data(), batch[i].data(), batch[i].size(), &keys[i], ivs[i].data() };
+    }
+
+    aesni::encryptAES128CBC( jobs.data(), jobs.size() );
+    CHECK( single == batch );
+
+    // the same through crypto::
+    batch = crypto::encryptAES128CBC( texts, keys, ivs );
+
+    for( size_t i = 0; i < records; ++i ) {
+        CHECK_EQ( crypto::decryptAES128CBC( batch[i], keys[i], ivs[i] ), texts[i] );
+    }
+
+    batch = crypto::encryptAES128CBC( texts, expanded, ivs );
+
+    for( size_t i = 0; i < records; ++i ) {
+        CHECK_EQ( crypto::decryptAES128CBC( batch[i], expanded, ivs[i] ), texts[i] );
+    }
+}
+
+void benchmarkMersenne() {
+    const size_t words = 16 * 1024 * 1024;
+    const size_t size = words * sizeof( uint32_t );
+    std::vector<uint32_t> out( words );
+    LOG( "Mersenne, " << size / 1024 / 1024 << " MiB" );
+
+    Mersenne single( 42 );
+    report( "get", throughput( [&] {
+        for( uint32_t& word : out ) {
+            word = single.get();
+        }
+    }, size ) );
+
+    Mersenne bulk( 42 );
+    std::vector<uint32_t> filled( words );
+    report( "fill", throughput( [&] {
+        bulk.fill( filled.data(), filled.size() );
+    }, size ) );
+    CHECK( out == filled );
+
+    Bytes plain = randombuffer::get( size );
+    Bytes encrypted( size );
+    report( "Mersenne CTR", throughput( [&] {
+        crypto::cryptMersenneCTR( plain, 42, encrypted.data() );
+    }, size ) );
+    CHECK_EQ( crypto::decryptMersenneCTR( encrypted, 42 ), plain );
+
+    // a seed which isn't in the range, so all of them are tried
+    const uint32_t seeds = 1 << 22;
+    Mersenne seeded( seeds );
+    std::vector<cracker::KnownOutput> known = { { 0, seeded.get() } };
+    double rate = throughput( [&] {
+        CHECK( !cracker::findMersenneSeed( known, 0, seeds - 1 ) );
+    }, seeds, 1 );
+    LOG( utils::format( "%-32s %7.2f Mseeds/s", "seed search", rate * 1000 ) );
+}
+
+void benchmarkHash() {
+    const size_t runs = 5;
+    // bytes per run, small messages are hashed this many times over to be measurable
+    const size_t budget = 4 * 1024 * 1024;
+    const std::vector<size_t> sizes = { 0, 16, 64, 100, 256, 1024, 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024, 64 * 1024 * 1024 };
+
+    Bytes data = randombuffer::get( sizes.back() );
+    Bytes key = crypto::genKey();
+    crypto::HmacSha1Key sha1Key( key );
+    crypto::HmacSha256Key sha256Key( key );
+    const cpu::Features& features = cpu::features();
+
+    using Sha1Scalar = hash::MDCtx<5, true, hash::sha1BlocksScalar>;
+    using Sha1ShaNi = hash::MDCtx<5, true, hash::sha1BlocksShaNi>;
+    using Sha256Scalar = hash::MDCtx<8, true, hash::sha256BlocksScalar>;
+    using Sha256ShaNi = hash::MDCtx<8, true, hash::sha256BlocksShaNi>;
+
+    auto sha1 = []( const Bytes & message ) {
+        return hash::sha1( message );
+    };
+    auto md4 = []( const Bytes & message ) {
+        return hash::md4( message );
+    };
+    auto sha256 = []( const Bytes & message ) {
+        return hash::sha256( message );
+    };
+    auto hmacSha1 = [&]( const Bytes & message ) {
+        return crypto::hmacSha1( message, key );
+    };
+    auto hmacSha256 = [&]( const Bytes & message ) {
+        return crypto::hmacSha256( message, key );
+    };
+
+    // the lanes only pay off for many short messages
+    const size_t batchSize = 64 * 1024;
+    std::vector<HashPath> paths;
+
+    paths.push_back( { "sha1 scalar", []( auto messages, uint8_t* digests ) {
+        hashEach<Sha1Scalar>( messages, digests, hash::SHA1_MAGICS );
+    }, sha1 } );
+
+    if( features.sha && features.sse41 ) {
+        paths.push_back( { "sha1 sha-ni", []( auto messages, uint8_t* digests ) {
+            hashEach<Sha1ShaNi>( messages, digests, hash::SHA1_MAGICS );
+        }, sha1 } );
+    }
+
+    if( features.avx2 ) {
+        paths.push_back( { "sha1 avx2 x8", []( auto messages, uint8_t* digests ) {
+            hash::detail::batch<5, true, 8>( hash::detail::sha1Lanes8, messages, digests, hash::SHA1_MAGICS, 0 );
+        }, sha1, batchSize } );
+    }
+
+    if( features.avx512f ) {
+        paths.push_back( { "sha1 avx512 x16", []( auto messages, uint8_t* digests ) {
+            hash::detail::batch<5, true, 16>( hash::detail::sha1Lanes16, messages, digests, hash::SHA1_MAGICS, 0 );
+        }, sha1, batchSize } );
+    }
+
+    paths.push_back( { "md4", []( auto messages, uint8_t* digests ) {
+        hashEach<hash::Md4Ctx>( messages, digests, hash::MD4_MAGICS );
+    }, md4 } );
+
+    if( features.avx2 ) {
+        paths.push_back( { "md4 avx2 x8", []( auto messages, uint8_t* digests ) {
+            hash::detail::batch<4, false, 8>( hash::detail::md4Lanes8, messages, digests, hash::MD4_MAGICS, 0 );
+        }, md4, batchSize } );
+    }
+
+    if( features.avx512f ) {
+        paths.push_back( { "md4 avx512 x16", []( auto messages, uint8_t* digests ) {
+            hash::detail::batch<4, false, 16>( hash::detail::md4Lanes16, messages, digests, hash::MD4_MAGICS, 0 );
+        }, md4, batchSize } );
+    }
+
+    paths.push_back( { "sha256 scalar", []( auto messages, uint8_t* digests ) {
+        hashEach<Sha256Scalar>( messages, digests, hash::SHA256_MAGICS );
+    }, sha256 } );
+
+    if( features.sha && features.sse41 ) {
+        paths.push_back( { "sha256 sha-ni", []( auto messages, uint8_t* digests ) {
+            hashEach<Sha256ShaNi>( messages, digests, hash::SHA256_MAGICS );
+        }, sha256 } );
+    }
+
+    // the plain call hashes the key pads on every message, the precomputed key only once
+    paths.push_back( { "hmac-sha1", [&]( auto messages, uint8_t* digests ) {
+        for( size_t i = 0; i < messages.size(); ++i ) {
+            Bytes mac = crypto::hmacSha1( Bytes( messages[i].begin(), messages[i].end() ), key );
+            std::copy( mac.begin(), mac.end(), digests + mac.size() * i );
+        }
+    }, hmacSha1, 1024 * 1024 } );
+    paths.push_back( { "hmac-sha1 key", [&]( auto messages, uint8_t* digests ) {
+        for( size_t i = 0; i < messages.size(); ++i ) {
+            sha1Key.mac( messages[i], digests + crypto::HmacSha1Key::macSize * i );
+        }
+    }, hmacSha1 } );
+    paths.push_back( { "hmac-sha256 key", [&]( auto messages, uint8_t* digests ) {
+        for( size_t i = 0; i < messages.size(); ++i ) {
+            sha256Key.mac( messages[i], digests + crypto::HmacSha256Key::macSize * i );
+        }
+    }, hmacSha256 } );
+
+    LOG( "Hash, best of " << runs << " runs after a warmup run, cycles of the time stamp counter" );
+    std::ostringstream json;
+    json << "{\n  \"runs\": " << runs << ",\n  \"results\": [";
+    bool first = true;
+
+    for( size_t size : sizes ) {
+        // every message at its own offset, so the lanes neither share input nor cache lines
+        size_t count = std::max<size_t>( 1, budget / std::max<size_t>( size, 64 ) );
+        std::vector<std::span<const uint8_t>> messages;
+
+        for( size_t i = 0; i < count; ++i ) {
+            messages.emplace_back( data.data() + ( i * 64 ) % ( data.size() - size + 1 ), size );
+        }
+
+        Bytes digests( 32 * count );
+
+        for( const HashPath& path : paths ) {
+            if( size > path.maxSize ) {
+                continue;
+            }
+
+            Timing timing = measure( [&] {
+                path.hash( messages, digests.data() );
+            }, runs );
+
+            // all digests, a mixed up lane shows up in one of them
+            for( size_t i = 0; i < count; ++i ) {
+                Bytes expected = path.reference( Bytes( messages[i].begin(), messages[i].end() ) );
+                CHECK( std::equal( expected.begin(), expected.end(), digests.begin() + expected.size() * i ) );
+            }
+
+            double bytes = static_cast<double>( size ) * count;
+            double perSecond = count * 1e9 / timing.ns;
+            double cyclesPerMessage = timing.cycles / count;
+            // empty messages have no cost per byte, only per message
+            std::string cyclesPerByte = size ? utils::format( "%.3f", timing.cycles / bytes ) : "null";
+
+            LOG( utils::format( "%-20s %8s %12.0f msgs/s %9s cycles/B %10.0f cycles/msg %7.2f GB/s",
+                                path.name.c_str(), sizeName( size ).c_str(), perSecond,
+                                size ? cyclesPerByte.c_str() : "-", cyclesPerMessage, bytes / timing.ns ) );
+
+            json << ( first ? "" : "," ) << "\n    { \"name\": \"" << path.name << "\", \"size\": " << size
+                 << ", \"messages\": " << count << ", \"cycles_per_byte\": " << cyclesPerByte
+                 << utils::format( ", \"messages_per_second\": %.1f, \"cycles_per_message\": %.1f, \"gbps\": %.4f }",
+                                   perSecond, cyclesPerMessage, bytes / timing.ns );
+            first = false;
+        }
+    }
+
+    json << "\n  ]\n}\n";
+    utils::toFile( "hash_benchmark.json", bytes( json.str() ) );
+    LOG( "results written to hash_benchmark.json" );
+}
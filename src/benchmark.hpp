@@ -0,0 +1,12 @@
+#pragma once
+
+// AES-128 ECB and CTR throughput of the serial and pipelined AES-NI loops, OpenSSL
+// and every backend of the runtime dispatch, single and batched CBC encryption of small records
+void benchmarkAES();
+
+// Mersenne twister output word by word and in bulk, Mersenne CTR
+void benchmarkMersenne();
+
+// SHA-1, MD4, SHA-256 and their HMACs from empty to 64 MiB messages in cycles/byte and messages/s,
+// scalar, SHA-NI and multi-buffer compression, results also written to hash_benchmark.json
+void benchmarkHash();
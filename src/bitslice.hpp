@@ -0,0 +1,580 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "aesni.hpp"
+
+//! constant time AES-128 without AES-NI: no table lookups and no branches on secret data
+//! the state of 4 blocks is bitsliced into 8 64-bit words, word i holds bit i of all 64 bytes,
+//! two such states are processed together, 8 blocks at a time
+//! same interfaces as the aesni kernels, using the encryption round keys of aesni::AesKey128
+namespace bitslice {
+
+const size_t blockSize = 16;
+const size_t rounds = 10;
+//! blocks per bitsliced state
+const size_t lanes = 4;
+//! states processed together
+const size_t states = 2;
+const size_t parallel = lanes * states;
+
+using State = uint64_t[8];
+
+//! S-box circuit by Boyar and Peralta, 113 gates, on bit i of every byte in \p q[i]
+inline void subBytes( uint64_t* q ) {
+    uint64_t x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4], x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+    // top linear transformation
+    uint64_t y14 = x3 ^ x5;
+    uint64_t y13 = x0 ^ x6;
+    uint64_t y9 = x0 ^ x3;
+    uint64_t y8 = x0 ^ x5;
+    uint64_t t0 = x1 ^ x2;
+    uint64_t y1 = t0 ^ x7;
+    uint64_t y4 = y1 ^ x3;
+    uint64_t y12 = y13 ^ y14;
+    uint64_t y2 = y1 ^ x0;
+    uint64_t y5 = y1 ^ x6;
+    uint64_t y3 = y5 ^ y8;
+    uint64_t t1 = x4 ^ y12;
+    uint64_t y15 = t1 ^ x5;
+    uint64_t y20 = t1 ^ x1;
+    uint64_t y6 = y15 ^ x7;
+    uint64_t y10 = y15 ^ t0;
+    uint64_t y11 = y20 ^ y9;
+    uint64_t y7 = x7 ^ y11;
+    uint64_t y17 = y10 ^ y11;
+    uint64_t y19 = y10 ^ y8;
+    uint64_t y16 = t0 ^ y11;
+    uint64_t y21 = y13 ^ y16;
+    uint64_t y18 = x0 ^ y16;
+
+    // non-linear section, the inversion in GF(2^8)
+    uint64_t t2 = y12 & y15;
+    uint64_t t3 = y3 & y6;
+    uint64_t t4 = t3 ^ t2;
+    uint64_t t5 = y4 & x7;
+    uint64_t t6 = t5 ^ t2;
+    uint64_t t7 = y13 & y16;
+    uint64_t t8 = y5 & y1;
+    uint64_t t9 = t8 ^ t7;
+    uint64_t t10 = y2 & y7;
+    uint64_t t11 = t10 ^ t7;
+    uint64_t t12 = y9 & y11;
+    uint64_t t13 = y14 & y17;
+    uint64_t t14 = t13 ^ t12;
+    uint64_t t15 = y8 & y10;
+    uint64_t t16 = t15 ^ t12;
+    uint64_t t17 = t4 ^ t14;
+    uint64_t t18 = t6 ^ t16;
+    uint64_t t19 = t9 ^ t14;
+    uint64_t t20 = t11 ^ t16;
+    uint64_t t21 = t17 ^ y20;
+    uint64_t t22 = t18 ^ y19;
+    uint64_t t23 = t19 ^ y21;
+    uint64_t t24 = t20 ^ y18;
+
+    uint64_t t25 = t21 ^ t22;
+    uint64_t t26 = t21 & t23;
+    uint64_t t27 = t24 ^ t26;
+    uint64_t t28 = t25 & t27;
+    uint64_t t29 = t28 ^ t22;
+    uint64_t t30 = t23 ^ t24;
+    uint64_t t31 = t22 ^ t26;
+    uint64_t t32 = t31 & t30;
+    uint64_t t33 = t32 ^ t24;
+    uint64_t t34 = t23 ^ t33;
+    uint64_t t35 = t27 ^ t33;
+    uint64_t t36 = t24 & t35;
+    uint64_t t37 = t36 ^ t34;
+    uint64_t t38 = t27 ^ t36;
+    uint64_t t39 = t29 & t38;
+    uint64_t t40 = t25 ^ t39;
+
+    uint64_t t41 = t40 ^ t37;
+    uint64_t t42 = t29 ^ t33;
+    uint64_t t43 = t29 ^ t40;
+    uint64_t t44 = t33 ^ t37;
+    uint64_t t45 = t42 ^ t41;
+    uint64_t z0 = t44 & y15;
+    uint64_t z1 = t37 & y6;
+    uint64_t z2 = t33 & x7;
+    uint64_t z3 = t43 & y16;
+    uint64_t z4 = t40 & y1;
+    uint64_t z5 = t29 & y7;
+    uint64_t z6 = t42 & y11;
+    uint64_t z7 = t45 & y17;
+    uint64_t z8 = t41 & y10;
+    uint64_t z9 = t44 & y12;
+    uint64_t z10 = t37 & y3;
+    uint64_t z11 = t33 & y4;
+    uint64_t z12 = t43 & y13;
+    uint64_t z13 = t40 & y5;
+    uint64_t z14 = t29 & y2;
+    uint64_t z15 = t42 & y9;
+    uint64_t z16 = t45 & y14;
+    uint64_t z17 = t41 & y8;
+
+    // bottom linear transformation, including the affine constant 0x63
+    uint64_t t46 = z15 ^ z16;
+    uint64_t t47 = z10 ^ z11;
+    uint64_t t48 = z5 ^ z13;
+    uint64_t t49 = z9 ^ z10;
+    uint64_t t50 = z2 ^ z12;
+    uint64_t t51 = z2 ^ z5;
+    uint64_t t52 = z7 ^ z8;
+    uint64_t t53 = z0 ^ z3;
+    uint64_t t54 = z6 ^ z7;
+    uint64_t t55 = z16 ^ z17;
+    uint64_t t56 = z12 ^ t48;
+    uint64_t t57 = t50 ^ t53;
+    uint64_t t58 = z4 ^ t46;
+    uint64_t t59 = z3 ^ t54;
+    uint64_t t60 = t46 ^ t57;
+    uint64_t t61 = z14 ^ t57;
+    uint64_t t62 = t52 ^ t58;
+    uint64_t t63 = t49 ^ t58;
+    uint64_t t64 = z4 ^ t59;
+    uint64_t t65 = t61 ^ t62;
+    uint64_t t66 = z1 ^ t63;
+    uint64_t s0 = t59 ^ t63;
+    uint64_t s6 = t56 ^ ~t62;
+    uint64_t s7 = t48 ^ ~t60;
+    uint64_t t67 = t64 ^ t65;
+    uint64_t s3 = t53 ^ t66;
+    uint64_t s4 = t51 ^ t66;
+    uint64_t s5 = t47 ^ t65;
+    uint64_t s1 = t64 ^ ~s3;
+    uint64_t s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+//! inverse affine transformation including the constant, the S-box is affine( inverse( x ) )
+inline void inverseAffine( uint64_t* q ) {
+    uint64_t q0 = ~q[0], q1 = ~q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = ~q[5], q6 = ~q[6], q7 = q[7];
+    q[7] = q1 ^ q4 ^ q6;
+    q[6] = q0 ^ q3 ^ q5;
+    q[5] = q7 ^ q2 ^ q4;
+    q[4] = q6 ^ q1 ^ q3;
+    q[3] = q5 ^ q0 ^ q2;
+    q[2] = q4 ^ q7 ^ q1;
+    q[1] = q3 ^ q6 ^ q0;
+    q[0] = q2 ^ q5 ^ q7;
+}
+
+//! the inverse S-box reuses the forward circuit: inverse( x ) = affine^-1( S( x ) )
+inline void inverseSubBytes( uint64_t* q ) {
+    inverseAffine( q );
+    subBytes( q );
+    inverseAffine( q );
+}
+
+// each word holds 16 bits per row, 4 lanes of the same column next to each other
+
+inline void shiftRows( uint64_t* q ) {
+    for( size_t i = 0; i < 8; ++i ) {
+        uint64_t x = q[i];
+        q[i] = ( x & 0x000000000000FFFFull )
+               | ( ( x & 0x00000000FFF00000ull ) >> 4 )
+               | ( ( x & 0x00000000000F0000ull ) << 12 )
+               | ( ( x & 0x0000FF0000000000ull ) >> 8 )
+               | ( ( x & 0x000000FF00000000ull ) << 8 )
+               | ( ( x & 0xF000000000000000ull ) >> 12 )
+               | ( ( x & 0x0FFF000000000000ull ) << 4 );
+    }
+}
+
+inline void inverseShiftRows( uint64_t* q ) {
+    for( size_t i = 0; i < 8; ++i ) {
+        uint64_t x = q[i];
+        q[i] = ( x & 0x000000000000FFFFull )
+               | ( ( x & 0x000000000FFF0000ull ) << 4 )
+               | ( ( x & 0x00000000F0000000ull ) >> 12 )
+               | ( ( x & 0x000000FF00000000ull ) << 8 )
+               | ( ( x & 0x0000FF0000000000ull ) >> 8 )
+               | ( ( x & 0x000F000000000000ull ) << 12 )
+               | ( ( x & 0xFFF0000000000000ull ) >> 4 );
+    }
+}
+
+//! swaps the two row pairs of every column
+inline uint64_t rotate32( const uint64_t& x ) {
+    return ( x << 32 ) | ( x >> 32 );
+}
+
+inline void mixColumns( uint64_t* q ) {
+    uint64_t r[8];
+
+    // next row of the same column
+    for( size_t i = 0; i < 8; ++i ) {
+        r[i] = ( q[i] >> 16 ) | ( q[i] << 48 );
+    }
+
+    // col[r] ^= all ^ xtime( col[r] ^ next ), the reduction by 0x1b feeds bit 7 into bits 0, 1, 3 and 4
+    uint64_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+    q[0] = q7 ^ r[7] ^ r[0] ^ rotate32( q0 ^ r[0] );
+    q[1] = q0 ^ r[0] ^ q7 ^ r[7] ^ r[1] ^ rotate32( q1 ^ r[1] );
+    q[2] = q1 ^ r[1] ^ r[2] ^ rotate32( q2 ^ r[2] );
+    q[3] = q2 ^ r[2] ^ q7 ^ r[7] ^ r[3] ^ rotate32( q3 ^ r[3] );
+    q[4] = q3 ^ r[3] ^ q7 ^ r[7] ^ r[4] ^ rotate32( q4 ^ r[4] );
+    q[5] = q4 ^ r[4] ^ r[5] ^ rotate32( q5 ^ r[5] );
+    q[6] = q5 ^ r[5] ^ r[6] ^ rotate32( q6 ^ r[6] );
+    q[7] = q6 ^ r[6] ^ r[7] ^ rotate32( q7 ^ r[7] );
+}
+
+//! multiplies every byte by x in GF(2^8)
+inline void xtime( uint64_t* q ) {
+    uint64_t q7 = q[7];
+    q[7] = q[6];
+    q[6] = q[5];
+    q[5] = q[4];
+    q[4] = q[3] ^ q7;
+    q[3] = q[2] ^ q7;
+    q[2] = q[1];
+    q[1] = q[0] ^ q7;
+    q[0] = q7;
+}
+
+//! the same preprocessing as aessoft::inverseMixColumns followed by MixColumns
+inline void inverseMixColumns( uint64_t* q ) {
+    uint64_t t[8];
+
+    for( size_t i = 0; i < 8; ++i ) {
+        t[i] = q[i] ^ rotate32( q[i] );
+    }
+
+    xtime( t );
+    xtime( t );
+
+    for( size_t i = 0; i < 8; ++i ) {
+        q[i] ^= t[i];
+    }
+
+    mixColumns( q );
+}
+
+inline void addRoundKey( uint64_t* q, const uint64_t* roundKey ) {
+    for( size_t i = 0; i < 8; ++i ) {
+        q[i] ^= roundKey[i];
+    }
+}
+
+//! transposes the 8x8 bit matrices formed by the same byte of all 8 words
+inline void ortho( uint64_t* q ) {
+    auto swap = []( uint64_t & x, uint64_t & y, const uint64_t & low, const unsigned & shift ) {
+        uint64_t a = x;
+        uint64_t b = y;
+        x = ( a & low ) | ( ( b & low ) << shift );
+        y = ( ( a >> shift ) & low ) | ( b & ~low );
+    };
+
+    for( size_t i = 0; i < 8; i += 2 ) {
+        swap( q[i], q[i + 1], 0x5555555555555555ull, 1 );
+    }
+
+    for( size_t i : { 0, 1, 4, 5 } ) {
+        swap( q[i], q[i + 2], 0x3333333333333333ull, 2 );
+    }
+
+    for( size_t i = 0; i < 4; ++i ) {
+        swap( q[i], q[i + 4], 0x0F0F0F0F0F0F0F0Full, 4 );
+    }
+}
+
+//! spreads the 16 bytes \p in of one block over \p q0 and \p q1, bytes of the same column next to each other
+inline void interleaveIn( uint64_t& q0, uint64_t& q1, const uint8_t* in ) {
+    uint32_t w[4];
+    std::memcpy( w, in, blockSize );
+    uint64_t x[4];
+
+    for( size_t i = 0; i < 4; ++i ) {
+        x[i] = w[i];
+        x[i] |= x[i] << 16;
+        x[i] &= 0x0000FFFF0000FFFFull;
+        x[i] |= x[i] << 8;
+        x[i] &= 0x00FF00FF00FF00FFull;
+    }
+
+    q0 = x[0] | ( x[2] << 8 );
+    q1 = x[1] | ( x[3] << 8 );
+}
+
+inline void interleaveOut( uint8_t* out, const uint64_t& q0, const uint64_t& q1 ) {
+    uint64_t x[4] = {
+        q0 & 0x00FF00FF00FF00FFull,
+        q1 & 0x00FF00FF00FF00FFull,
+        ( q0 >> 8 ) & 0x00FF00FF00FF00FFull,
+        ( q1 >> 8 ) & 0x00FF00FF00FF00FFull,
+    };
+    uint32_t w[4];
+
+    for( size_t i = 0; i < 4; ++i ) {
+        x[i] |= x[i] >> 8;
+        x[i] &= 0x0000FFFF0000FFFFull;
+        w[i] = static_cast<uint32_t>( x[i] ) | static_cast<uint32_t>( x[i] >> 16 );
+    }
+
+    std::memcpy( out, w, blockSize );
+}
+
+//! bitslices \p count <= lanes blocks from \p in, missing blocks are zero
+inline void load( uint64_t* q, const uint8_t* in, const size_t& count = lanes ) {
+    static const uint8_t zero[blockSize] = {};
+
+    for( size_t i = 0; i < lanes; ++i ) {
+        interleaveIn( q[i], q[i + 4], i < count ? in + i * blockSize : zero );
+    }
+
+    ortho( q );
+}
+
+//! writes the first \p count blocks of \p q to \p out
+inline void store( uint8_t* out, uint64_t* q, const size_t& count = lanes ) {
+    ortho( q );
+
+    for( size_t i = 0; i < count; ++i ) {
+        interleaveOut( out + i * blockSize, q[i], q[i + 4] );
+    }
+}
+
+//! bitsliced round keys, every round key repeated for all lanes
+struct RoundKeys {
+    explicit RoundKeys( const aesni::AesKey128& key ) {
+        const uint8_t* enc = reinterpret_cast<const uint8_t*>( key.enc );
+        uint8_t repeated[lanes * blockSize];
+
+        for( size_t j = 0; j <= rounds; ++j ) {
+            for( size_t i = 0; i < lanes; ++i ) {
+                std::memcpy( repeated + i * blockSize, enc + j * blockSize, blockSize );
+            }
+
+            load( q[j], repeated );
+        }
+    }
+
+    State q[rounds + 1];
+};
+
+//! encrypts \p N states in place, interleaving the rounds
+template<size_t N>
+inline void encryptStates( State* q, const RoundKeys& keys ) {
+    for( size_t i = 0; i < N; ++i ) {
+        addRoundKey( q[i], keys.q[0] );
+    }
+
+    for( size_t j = 1; j < rounds; ++j ) {
+        for( size_t i = 0; i < N; ++i ) {
+            subBytes( q[i] );
+            shiftRows( q[i] );
+            mixColumns( q[i] );
+            addRoundKey( q[i], keys.q[j] );
+        }
+    }
+
+    for( size_t i = 0; i < N; ++i ) {
+        subBytes( q[i] );
+        shiftRows( q[i] );
+        addRoundKey( q[i], keys.q[rounds] );
+    }
+}
+
+//! the straight inverse cipher, it works with the encryption round keys
+template<size_t N>
+inline void decryptStates( State* q, const RoundKeys& keys ) {
+    for( size_t i = 0; i < N; ++i ) {
+        addRoundKey( q[i], keys.q[rounds] );
+    }
+
+    for( size_t j = rounds - 1; j > 0; --j ) {
+        for( size_t i = 0; i < N; ++i ) {
+            inverseShiftRows( q[i] );
+            inverseSubBytes( q[i] );
+            addRoundKey( q[i], keys.q[j] );
+            inverseMixColumns( q[i] );
+        }
+    }
+
+    for( size_t i = 0; i < N; ++i ) {
+        inverseShiftRows( q[i] );
+        inverseSubBytes( q[i] );
+        addRoundKey( q[i], keys.q[0] );
+    }
+}
+
+//! en- or decrypts \p count <= parallel blocks from \p in to \p out, which may be the same
+template<bool Decrypt>
+inline void cryptBlocks( const uint8_t* in, uint8_t* out, const size_t& count, const RoundKeys& keys ) {
+    State q[states];
+
+    for( size_t i = 0; i < states; ++i ) {
+        size_t first = std::min( count, i * lanes );
+        load( q[i], in + first * blockSize, std::min( count - first, lanes ) );
+    }
+
+    if( Decrypt ) {
+        decryptStates<states>( q, keys );
+    } else {
+        encryptStates<states>( q, keys );
+    }
+
+    for( size_t i = 0; i < states; ++i ) {
+        size_t first = std::min( count, i * lanes );
+        store( out + first * blockSize, q[i], std::min( count - first, lanes ) );
+    }
+}
+
+inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const aesni::AesKey128& key ) {
+    RoundKeys keys( key );
+    size_t blocks = length / blockSize;
+
+    for( size_t i = 0; i < blocks; i += parallel ) {
+        cryptBlocks<false>( plaintext + i * blockSize, ciphertext + i * blockSize, std::min( blocks - i, parallel ), keys );
+    }
+
+    return length;
+}
+
+inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const aesni::AesKey128& key ) {
+    RoundKeys keys( key );
+    size_t blocks = length / blockSize;
+
+    for( size_t i = 0; i < blocks; i += parallel ) {
+        cryptBlocks<true>( ciphertext + i * blockSize, plaintext + i * blockSize, std::min( blocks - i, parallel ), keys );
+    }
+
+    return length;
+}
+
+//! CBC encryption is serial, every block fills only one lane
+//! \p plaintext and \p ciphertext may be the same
+inline size_t encryptAES128CBC( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length,
+                                const aesni::AesKey128& key, const uint8_t* iv ) {
+    RoundKeys keys( key );
+    uint8_t previous[blockSize];
+    std::memcpy( previous, iv, blockSize );
+
+    for( size_t i = 0; i + blockSize <= length; i += blockSize ) {
+        for( size_t j = 0; j < blockSize; ++j ) {
+            previous[j] ^= plaintext[i + j];
+        }
+
+        State q;
+        load( q, previous, 1 );
+        encryptStates<1>( &q, keys );
+        store( previous, q, 1 );
+        std::memcpy( ciphertext + i, previous, blockSize );
+    }
+
+    return length;
+}
+
+//! independent messages share the lanes, one block of each per step
+inline void encryptAES128CBC( const aesni::CBCJob* jobs, const size_t count ) {
+    for( size_t first = 0; first < count; first += parallel ) {
+        size_t n = std::min( count - first, parallel );
+        const aesni::CBCJob* job = jobs + first;
+
+        // bitsliced round keys are per state, jobs with different keys go one by one
+        bool sameKey = true;
+
+        for( size_t i = 1; i < n; ++i ) {
+            sameKey &= job[i].key == job[0].key;
+        }
+
+        if( !sameKey ) {
+            for( size_t i = 0; i < n; ++i ) {
+                bitslice::encryptAES128CBC( job[i].in, job[i].out, job[i].length, *job[i].key, job[i].iv );
+            }
+
+            continue;
+        }
+
+        RoundKeys keys( *job[0].key );
+        uint8_t chain[parallel * blockSize];
+        size_t longest = 0;
+
+        for( size_t i = 0; i < n; ++i ) {
+            std::memcpy( chain + i * blockSize, job[i].iv, blockSize );
+            longest = std::max( longest, job[i].length / blockSize * blockSize );
+        }
+
+        for( size_t offset = 0; offset < longest; offset += blockSize ) {
+            for( size_t i = 0; i < n; ++i ) {
+                if( offset < job[i].length / blockSize * blockSize ) {
+                    for( size_t j = 0; j < blockSize; ++j ) {
+                        chain[i * blockSize + j] ^= job[i].in[offset + j];
+                    }
+                }
+            }
+
+            cryptBlocks<false>( chain, chain, n, keys );
+
+            for( size_t i = 0; i < n; ++i ) {
+                if( offset < job[i].length / blockSize * blockSize ) {
+                    std::memcpy( job[i].out + offset, chain + i * blockSize, blockSize );
+                }
+            }
+        }
+    }
+}
+
+//! \p ciphertext and \p plaintext may be the same
+inline size_t decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length,
+                                const aesni::AesKey128& key, const uint8_t* iv ) {
+    RoundKeys keys( key );
+    size_t blocks = length / blockSize;
+    uint8_t previous[blockSize];
+    uint8_t batch[parallel * blockSize];
+    std::memcpy( previous, iv, blockSize );
+
+    for( size_t i = 0; i < blocks; i += parallel ) {
+        size_t n = std::min( blocks - i, parallel );
+        // keep the ciphertext, the output may overwrite it
+        std::memcpy( batch, ciphertext + i * blockSize, n * blockSize );
+        cryptBlocks<true>( batch, plaintext + i * blockSize, n, keys );
+
+        for( size_t k = 0; k < n * blockSize; ++k ) {
+            plaintext[i * blockSize + k] ^= k < blockSize ? previous[k] : batch[k - blockSize];
+        }
+
+        std::memcpy( previous, batch + ( n - 1 ) * blockSize, blockSize );
+    }
+
+    return length;
+}
+
+//! same counter layout as aesni::cryptAES128CTR, \p in and \p out may be the same
+inline void cryptAES128CTR( const uint8_t* in, uint8_t* out, const size_t length,
+                            const aesni::AesKey128& key, const uint64_t& nonce, const uint64_t& counter = 0 ) {
+    RoundKeys keys( key );
+    uint8_t stream[parallel * blockSize];
+    uint64_t next = counter;
+
+    for( size_t i = 0; i < length; i += parallel * blockSize ) {
+        size_t n = std::min( length - i, parallel * blockSize );
+
+        for( size_t b = 0; b * blockSize < n; ++b, ++next ) {
+            std::memcpy( stream + b * blockSize, &nonce, sizeof( nonce ) );
+            std::memcpy( stream + b * blockSize + sizeof( nonce ), &next, sizeof( next ) );
+        }
+
+        cryptBlocks<false>( stream, stream, ( n + blockSize - 1 ) / blockSize, keys );
+
+        for( size_t k = 0; k < n; ++k ) {
+            out[i + k] = in[i + k] ^ stream[k];
+        }
+    }
+}
+
+}
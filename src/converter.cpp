@@ -1,6 +1,6 @@
 #include "converter.hpp"
 
-#include <map>
+#include <algorithm>
 
 uint8_t converter::parseHex( const char& hex ) {
     if( hex >= '0' && hex <= '9' ) {
@@ -18,27 +18,30 @@ uint8_t converter::parseHex( const char& hex ) {
     return 0;
 }
 
-Bytes converter::hexToBinary( const std::string& hex ) {
+size_t converter::hexToBinary( std::string_view hex, uint8_t* out ) {
     size_t size   = hex.size() / 2;
-    Bytes binary( size, 0 );
 
     for( size_t i = 0; i < size; ++i ) {
         uint8_t higher = static_cast<uint8_t>( parseHex( hex[2 * i + 0] ) );
         uint8_t lower  = static_cast<uint8_t>( parseHex( hex[2 * i + 1] ) );
-        binary[i] =  lower + 16 * higher;
+        out[i] =  lower + 16 * higher;
     }
 
     if( hex.size() % 2 ) {
         uint8_t lower  = static_cast<uint8_t>( parseHex( hex.back() ) );
-        binary.emplace_back( lower );
+        out[size++] = lower;
     }
 
-    return binary;
+    return size;
 }
 
-std::string converter::binaryToBase64( const Bytes& binary ) {
+Bytes converter::hexToBinary( std::string_view hex ) {
+    Bytes binary( ( hex.size() + 1 ) / 2, 0 );
+    hexToBinary( hex, binary.data() );
+    return binary;
+}
 
-    if( binary.empty() ) { return std::string(); }
+size_t converter::binaryToBase64( ByteView binary, char* base64 ) {
 
     static const char table64[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
@@ -47,8 +50,6 @@ std::string converter::binaryToBase64( const Bytes& binary ) {
     size_t size64 = steps * 4;
     size_t rest   = size % 3;
 
-    std::string base64( size64 + ( rest ? 4 : 0 ), '\0' );
-
     for( size_t i = 0; i < steps; ++i ) {
         int a = ( ( ( binary[3 * i + 0] ) & 0b11111100 ) >> 2 );
         int b = ( ( ( binary[3 * i + 0] ) & 0b00000011 ) << 4 ) +
@@ -85,40 +86,50 @@ std::string converter::binaryToBase64( const Bytes& binary ) {
         }
     }
 
+    return size64 + ( rest ? 4 : 0 );
+}
+
+std::string converter::binaryToBase64( ByteView binary ) {
+    std::string base64( ( binary.size() + 2 ) / 3 * 4, '\0' );
+    binaryToBase64( binary, base64.data() );
     return base64;
 }
 
-Bytes converter::base64ToBinary( const std::string& base64 ) {
-    static const std::map<char, uint8_t> table64 = {
-        { 'A',  0 }, { 'B',  1 }, { 'C',  2 }, { 'D',  3 }, { 'E',  4 }, { 'F',  5 }, { 'G',  6 }, { 'H',  7 },
-        { 'I',  8 }, { 'J',  9 }, { 'K', 10 }, { 'L', 11 }, { 'M', 12 }, { 'N', 13 }, { 'O', 14 }, { 'P', 15 },
-        { 'Q', 16 }, { 'R', 17 }, { 'S', 18 }, { 'T', 19 }, { 'U', 20 }, { 'V', 21 }, { 'W', 22 }, { 'X', 23 },
-        { 'Y', 24 }, { 'Z', 25 }, { 'a', 26 }, { 'b', 27 }, { 'c', 28 }, { 'd', 29 }, { 'e', 30 }, { 'f', 31 },
-        { 'g', 32 }, { 'h', 33 }, { 'i', 34 }, { 'j', 35 }, { 'k', 36 }, { 'l', 37 }, { 'm', 38 }, { 'n', 39 },
-        { 'o', 40 }, { 'p', 41 }, { 'q', 42 }, { 'r', 43 }, { 's', 44 }, { 't', 45 }, { 'u', 46 }, { 'v', 47 },
-        { 'w', 48 }, { 'x', 49 }, { 'y', 50 }, { 'z', 51 }, { '0', 52 }, { '1', 53 }, { '2', 54 }, { '3', 55 },
-        { '4', 56 }, { '5', 57 }, { '6', 58 }, { '7', 59 }, { '8', 60 }, { '9', 61 }, { '+', 62 }, { '/', 63 },
-    };
+namespace {
+
+//! maps base64 chars to their 6 bit value, 64 marks padding, everything else decodes as 0
+struct Table64 {
+    Table64() {
+        const char chars[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+        for( uint8_t i = 0; i < 64; ++i ) {
+            values[static_cast<uint8_t>( chars[i] )] = i;
+        }
+
+        values[static_cast<uint8_t>( '=' )] = 64;
+    }
+    uint8_t values[256] = {};
+};
+
+}
+
+size_t converter::base64ToBinary( std::string_view base64, uint8_t* binary ) {
+    static const Table64 table64;
 
     size_t size64 = base64.size();
     size_t steps  = size64 / 4;
     size_t size   = size64 * 3 / 4;
-    Bytes binary( size );
 
-    if( size == 0 ) { return binary; }
+    if( size == 0 ) { return 0; }
 
     size_t padding = 0;
 
     auto get6Bit = [&padding]( const char c ) -> uint8_t {
-        if( c == '=' ) { ++padding; return 0; }
+        uint8_t value = table64.values[static_cast<uint8_t>( c )];
 
-        auto it = table64.find( c );
+        if( value == 64 ) { ++padding; return 0; }
 
-        if( it != table64.end() ) {
-            return it->second;
-        }
-
-        return 0;
+        return value;
     };
 
     for( size_t i = 0; i < steps; ++i ) {
@@ -135,33 +146,39 @@ Bytes converter::base64ToBinary( const std::string& base64 ) {
     }
 
     // remove padding
-    while( padding-- ) {
-        binary.pop_back();
-    }
+    return size - std::min( padding, size );
+}
 
+Bytes converter::base64ToBinary( std::string_view base64 ) {
+    Bytes binary( base64.size() * 3 / 4 );
+    binary.resize( base64ToBinary( base64, binary.data() ) );
     return binary;
-
 }
 
-std::string converter::hexToBase64( const std::string& hex ) {
+std::string converter::hexToBase64( std::string_view hex ) {
     Bytes binary = hexToBinary( hex );
     std::string base64 = binaryToBase64( binary );
     return base64;
 }
 
-std::string converter::binaryToHex( const Bytes& bytes ) {
+size_t converter::binaryToHex( ByteView bytes, char* out ) {
     static const char table16[17] = "0123456789abcdef";
 
-    std::string rv( 2 * bytes.size(), '\0' );
     size_t pos = 0;
 
     for( const uint8_t byte : bytes ) {
         int a = ( byte & 0b11110000 ) >> 4;
         int b = ( byte & 0b00001111 );
-        rv[2 * pos + 0] = table16[a];
-        rv[2 * pos + 1] = table16[b];
+        out[2 * pos + 0] = table16[a];
+        out[2 * pos + 1] = table16[b];
         ++pos;
     }
 
+    return 2 * pos;
+}
+
+std::string converter::binaryToHex( ByteView bytes ) {
+    std::string rv( 2 * bytes.size(), '\0' );
+    binaryToHex( bytes, rv.data() );
     return rv;
 }
@@ -1,13 +1,26 @@
 #pragma once
 
+#include <string_view>
+
 #include "types.hpp"
 
 namespace converter {
 uint8_t parseHex( const char& hex );
-Bytes hexToBinary( const std::string& hex );
-std::string binaryToHex( const Bytes& bytes );
+Bytes hexToBinary( std::string_view hex );
+std::string binaryToHex( ByteView bytes );
+
+std::string binaryToBase64( ByteView binary );
+Bytes base64ToBinary( std::string_view base64 );
+std::string hexToBase64( std::string_view hex );
+
+// caller provided buffers, \returns the number of bytes written to \p out
 
-std::string binaryToBase64( const Bytes& binary );
-Bytes base64ToBinary( const std::string& base64 );
-std::string hexToBase64( const std::string& hex );
+//! \p out holds ( hex.size() + 1 ) / 2 bytes
+size_t hexToBinary( std::string_view hex, uint8_t* out );
+//! \p out holds 2 * bytes.size() chars
+size_t binaryToHex( ByteView bytes, char* out );
+//! \p out holds ( binary.size() + 2 ) / 3 * 4 chars
+size_t binaryToBase64( ByteView binary, char* out );
+//! \p out holds base64.size() * 3 / 4 bytes
+size_t base64ToBinary( std::string_view base64, uint8_t* out );
 }
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+
+#if defined( _MSC_VER ) && !defined( __clang__ )
+#include <intrin.h>
+//! MSVC allows all intrinsics everywhere
+#define CPU_TARGET( features )
+#else
+#include <cpuid.h>
+//! compiles a function for \p features, which the caller has to check with cpu::features() first
+#define CPU_TARGET( features ) __attribute__( ( target( features ) ) )
+#endif
+
+namespace cpu {
+
+//! instruction set extensions usable on this machine, CPU and OS support checked
+struct Features {
+    bool aes = false;
+    bool pclmul = false;
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool avx = false;
+    bool avx2 = false;
+    bool avx512f = false;
+    bool avx512bw = false;
+    bool vaes = false;
+    bool vpclmul = false;
+    bool sha = false;
+};
+
+namespace detail {
+
+inline void cpuid( const uint32_t& leaf, const uint32_t& subleaf, uint32_t regs[4] ) {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    int r[4];
+    __cpuidex( r, static_cast<int>( leaf ), static_cast<int>( subleaf ) );
+
+    for( int i = 0; i < 4; ++i ) {
+        regs[i] = static_cast<uint32_t>( r[i] );
+    }
+
+#else
+    regs[0] = regs[1] = regs[2] = regs[3] = 0;
+    __get_cpuid_count( leaf, subleaf, &regs[0], &regs[1], &regs[2], &regs[3] );
+#endif
+}
+
+//! \returns the register state the OS saves on context switches
+inline uint64_t xgetbv() {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    return _xgetbv( 0 );
+#else
+    uint32_t eax, edx;
+    __asm__( "xgetbv" : "=a"( eax ), "=d"( edx ) : "c"( 0 ) );
+    return ( static_cast<uint64_t>( edx ) << 32 ) | eax;
+#endif
+}
+
+inline Features detect() {
+    Features f;
+    uint32_t regs[4];
+
+    cpuid( 0, 0, regs );
+    uint32_t maxLeaf = regs[0];
+
+    if( maxLeaf < 1 ) {
+        return f;
+    }
+
+    cpuid( 1, 0, regs );
+    f.aes    = regs[2] & ( 1u << 25 );
+    f.pclmul = regs[2] & ( 1u << 1 );
+    f.ssse3  = regs[2] & ( 1u << 9 );
+    f.sse41  = regs[2] & ( 1u << 19 );
+
+    // AVX registers need to be enabled by the OS
+    bool osxsave = regs[2] & ( 1u << 27 );
+    uint64_t xcr0 = osxsave ? xgetbv() : 0;
+    bool ymm = ( xcr0 & 0x06 ) == 0x06;
+    bool zmm = ( xcr0 & 0xe6 ) == 0xe6;
+
+    f.avx = ymm && ( regs[2] & ( 1u << 28 ) );
+
+    if( maxLeaf < 7 ) {
+        return f;
+    }
+
+    cpuid( 7, 0, regs );
+    f.avx2     = f.avx && ( regs[1] & ( 1u << 5 ) );
+    f.avx512f  = zmm && f.avx2 && ( regs[1] & ( 1u << 16 ) );
+    f.avx512bw = f.avx512f && ( regs[1] & ( 1u << 30 ) );
+    f.sha      = regs[1] & ( 1u << 29 );
+    f.vaes     = f.avx && ( regs[2] & ( 1u << 9 ) );
+    f.vpclmul  = f.avx && ( regs[2] & ( 1u << 10 ) );
+
+    return f;
+}
+
+}
+
+//! \returns the time stamp counter, which ticks at the nominal clock rate whatever the current one is
+inline uint64_t cycles() {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+    return __rdtsc();
+#else
+    uint32_t eax, edx;
+    __asm__ __volatile__( "rdtsc" : "=a"( eax ), "=d"( edx ) );
+    return ( static_cast<uint64_t>( edx ) << 32 ) | eax;
+#endif
+}
+
+//! \returns the features of this machine, detected on first use
+inline const Features& features() {
+    static const Features detected = detail::detect();
+    return detected;
+}
+
+}
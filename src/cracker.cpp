@@ -1,7 +1,368 @@
 #include "cracker.hpp"
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <numeric>
+#include <thread>
+
+#include <immintrin.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cpu.hpp"
+#include "random.hpp"
+#include "utils.hpp"
 #include "log.hpp"
 
+namespace {
+
+// std::seed_seq{ seed }.generate() into the 624 words of Mersenne( seed ), names as in [rand.util.seedseq]
+namespace seedseq {
+
+const size_t n = Mersenne::size;
+const size_t t = 11;
+const size_t p = ( n - t ) / 2;
+const size_t q = p + t;
+const uint32_t fill = 0x8b8b8b8b;
+const uint32_t multiplier1 = 1664525;
+const uint32_t multiplier2 = 1566083941;
+
+}
+
+//! "MTSI" at the start of a SeedIndex file
+const uint32_t indexMagic = 0x4953544d;
+const uint32_t indexVersion = 1;
+
+//! seeds per kernel call, a multiple of the seeds per SIMD iteration
+const size_t block = 4096;
+//! seeds per job, the granularity of cancellation
+const uint64_t seedsPerJob = 16 * block;
+
+inline size_t wrap( const size_t& i ) {
+    return i < seedseq::n ? i : i - seedseq::n;
+}
+
+inline uint32_t mix( const uint32_t& x ) {
+    return x ^ ( x >> 27 );
+}
+
+//! the seed independent part of seeding for some outputs: the words after the first step, which doesn't read the seed yet,
+//! and the steps of the second pass up to the last write to a word the outputs depend on
+struct Seeding {
+    explicit Seeding( const std::vector<size_t>& indices ) : indices( indices ) {
+        using namespace seedseq;
+        initial.fill( fill );
+        uint32_t r1 = multiplier1 * mix( initial[0] ^ initial[p] ^ initial[n - 1] );
+        initial[p] += r1;
+        initial[q] += r1 + 1;
+        initial[0] = r1 + 1;
+
+        for( size_t index : indices ) {
+            // step k of the second pass writes k, k + p and k + q
+            for( size_t i : reads( index ) ) {
+                steps = std::max( { steps, i + 1, wrap( i + n - p ) + 1, wrap( i + n - q ) + 1 } );
+            }
+        }
+    }
+
+    //! the seeded words twisting word \p j reads, j, j + 1 and j + 397 or the twisted j - 227 for j >= 227
+    static std::vector<size_t> reads( const size_t& j ) {
+        std::vector<size_t> words = { j, j + 1 };
+        size_t ahead = j + Mersenne::shift;
+
+        if( ahead < seedseq::n ) {
+            words.push_back( ahead );
+        } else {
+            std::vector<size_t> twisted = reads( ahead - seedseq::n );
+            words.insert( words.end(), twisted.begin(), twisted.end() );
+        }
+
+        return words;
+    }
+
+    std::vector<size_t> indices;
+    std::array<uint32_t, seedseq::n> initial;
+    size_t steps = 0;
+};
+
+//! writes the outputs of Mersenne( seed ) for the \p block seeds from \p from to \p out, row by row for each index
+using Kernel = void( * )( const Seeding& seeding, const uint64_t& from, uint32_t* out );
+
+//! word \p j of the first twist of Mersenne( seed ) from its seeded words \p b
+uint32_t twisted( const uint32_t* b, const size_t& j ) {
+    size_t ahead = j + Mersenne::shift;
+    return Mersenne::twist( b[j], b[j + 1], ahead < seedseq::n ? b[ahead] : twisted( b, ahead - seedseq::n ) );
+}
+
+void outputsScalar( const Seeding& seeding, const uint64_t& from, uint32_t* out ) {
+    using namespace seedseq;
+    std::array<uint32_t, n> b;
+
+    for( size_t s = 0; s < block; ++s ) {
+        b = seeding.initial;
+
+        for( size_t k = 1; k < n; ++k ) {
+            uint32_t r1 = multiplier1 * mix( b[k] ^ b[wrap( k + p )] ^ b[k - 1] );
+            uint32_t r2 = r1 + static_cast<uint32_t>( k == 1 ? 1 + from + s : k );
+            b[wrap( k + p )] += r1;
+            b[wrap( k + q )] += r2;
+            b[k] = r2;
+        }
+
+        for( size_t k = 0; k < seeding.steps; ++k ) {
+            uint32_t r3 = multiplier2 * mix( b[k] + b[wrap( k + p )] + b[k ? k - 1 : n - 1] );
+            uint32_t r4 = r3 - static_cast<uint32_t>( k );
+            b[wrap( k + p )] ^= r3;
+            b[wrap( k + q )] ^= r4;
+            b[k] = r4;
+        }
+
+        for( size_t o = 0; o < seeding.indices.size(); ++o ) {
+            out[o * block + s] = Mersenne::scramble( twisted( b.data(), seeding.indices[o] ) );
+        }
+    }
+}
+
+//! the zero masking shifts with all lanes are the plain ones, without the undefined source GCC 12 warns about
+CPU_TARGET( "avx512f" )
+inline __m512i shiftRight512( const __m512i& x, const unsigned& bits ) {
+    return _mm512_maskz_srli_epi32( 0xffff, x, bits );
+}
+
+CPU_TARGET( "avx512f" )
+inline __m512i shiftLeft512( const __m512i& x, const unsigned& bits ) {
+    return _mm512_maskz_slli_epi32( 0xffff, x, bits );
+}
+
+CPU_TARGET( "avx512f" )
+inline __m512i mix512( const __m512i& x ) {
+    return _mm512_xor_si512( x, shiftRight512( x, 27 ) );
+}
+
+CPU_TARGET( "avx512f" )
+inline __m512i twist512( const __m512i& current, const __m512i& next, const __m512i& ahead ) {
+    __m512i y = _mm512_ternarylogic_epi32( _mm512_set1_epi32( Mersenne::upper ), current, next, 0xca );
+    __m512i odd = _mm512_sub_epi32( _mm512_setzero_si512(), _mm512_and_si512( y, _mm512_set1_epi32( 1 ) ) );
+    __m512i v = _mm512_xor_si512( ahead, shiftRight512( y, 1 ) );
+    return _mm512_xor_si512( v, _mm512_and_si512( odd, _mm512_set1_epi32( Mersenne::matrix ) ) );
+}
+
+//! twisted() for the group \p g of \p b
+template<size_t Groups>
+CPU_TARGET( "avx512f" )
+__m512i twisted512( const __m512i( *b )[Groups], const size_t& g, const size_t& j ) {
+    size_t ahead = j + Mersenne::shift;
+    return twist512( b[j][g], b[j + 1][g], ahead < seedseq::n ? b[ahead][g] : twisted512( b, g, ahead - seedseq::n ) );
+}
+
+CPU_TARGET( "avx512f" )
+inline __m512i scramble512( __m512i a ) {
+    a = _mm512_xor_si512( a, shiftRight512( a, 11 ) );
+    a = _mm512_xor_si512( a, _mm512_and_si512( shiftLeft512( a, 7 ), _mm512_set1_epi32( 0x9D2C5680 ) ) );
+    a = _mm512_xor_si512( a, _mm512_and_si512( shiftLeft512( a, 15 ), _mm512_set1_epi32( 0xEFC60000 ) ) );
+    return _mm512_xor_si512( a, shiftRight512( a, 18 ) );
+}
+
+//! outputsScalar() for 16 seeds per register, \p Groups registers interleaved to hide the latency of the multiplications
+template<size_t Groups>
+CPU_TARGET( "avx512f" )
+void outputsAVX512( const Seeding& seeding, const uint64_t& from, uint32_t* out ) {
+    using namespace seedseq;
+    const size_t lanes = 16;
+    alignas( 64 ) __m512i b[n][Groups];
+
+    for( size_t s = 0; s < block; s += lanes * Groups ) {
+        for( size_t i = 0; i < n; ++i ) {
+            for( size_t g = 0; g < Groups; ++g ) {
+                b[i][g] = _mm512_set1_epi32( seeding.initial[i] );
+            }
+        }
+
+        // the seed is added in the second step, the others add k
+        for( size_t k = 1; k < n; ++k ) {
+            size_t kp = wrap( k + p );
+            size_t kq = wrap( k + q );
+
+            for( size_t g = 0; g < Groups; ++g ) {
+                __m512i add = k == 1 ? _mm512_add_epi32( _mm512_set1_epi32( static_cast<uint32_t>( from + s + g * lanes + 1 ) ),
+                                                         _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) )
+                              : _mm512_set1_epi32( static_cast<uint32_t>( k ) );
+                __m512i x = _mm512_ternarylogic_epi32( b[k][g], b[kp][g], b[k - 1][g], 0x96 );
+                __m512i r1 = _mm512_mullo_epi32( mix512( x ), _mm512_set1_epi32( multiplier1 ) );
+                __m512i r2 = _mm512_add_epi32( r1, add );
+                b[kp][g] = _mm512_add_epi32( b[kp][g], r1 );
+                b[kq][g] = _mm512_add_epi32( b[kq][g], r2 );
+                b[k][g] = r2;
+            }
+        }
+
+        for( size_t k = 0; k < seeding.steps; ++k ) {
+            size_t kp = wrap( k + p );
+            size_t kq = wrap( k + q );
+            size_t previous = k ? k - 1 : n - 1;
+
+            for( size_t g = 0; g < Groups; ++g ) {
+                __m512i x = _mm512_add_epi32( _mm512_add_epi32( b[k][g], b[kp][g] ), b[previous][g] );
+                __m512i r3 = _mm512_mullo_epi32( mix512( x ), _mm512_set1_epi32( multiplier2 ) );
+                __m512i r4 = _mm512_sub_epi32( r3, _mm512_set1_epi32( static_cast<uint32_t>( k ) ) );
+                b[kp][g] = _mm512_xor_si512( b[kp][g], r3 );
+                b[kq][g] = _mm512_xor_si512( b[kq][g], r4 );
+                b[k][g] = r4;
+            }
+        }
+
+        for( size_t o = 0; o < seeding.indices.size(); ++o ) {
+            for( size_t g = 0; g < Groups; ++g ) {
+                _mm512_storeu_si512( out + o * block + s + g * lanes, scramble512( twisted512<Groups>( b, g, seeding.indices[o] ) ) );
+            }
+        }
+    }
+}
+
+CPU_TARGET( "avx2" )
+inline __m256i mix256( const __m256i& x ) {
+    return _mm256_xor_si256( x, _mm256_srli_epi32( x, 27 ) );
+}
+
+CPU_TARGET( "avx2" )
+inline __m256i twist256( const __m256i& current, const __m256i& next, const __m256i& ahead ) {
+    __m256i y = _mm256_or_si256( _mm256_and_si256( current, _mm256_set1_epi32( Mersenne::upper ) ),
+                                 _mm256_and_si256( next, _mm256_set1_epi32( Mersenne::lower ) ) );
+    __m256i odd = _mm256_sub_epi32( _mm256_setzero_si256(), _mm256_and_si256( y, _mm256_set1_epi32( 1 ) ) );
+    __m256i v = _mm256_xor_si256( ahead, _mm256_srli_epi32( y, 1 ) );
+    return _mm256_xor_si256( v, _mm256_and_si256( odd, _mm256_set1_epi32( Mersenne::matrix ) ) );
+}
+
+template<size_t Groups>
+CPU_TARGET( "avx2" )
+__m256i twisted256( const __m256i( *b )[Groups], const size_t& g, const size_t& j ) {
+    size_t ahead = j + Mersenne::shift;
+    return twist256( b[j][g], b[j + 1][g], ahead < seedseq::n ? b[ahead][g] : twisted256( b, g, ahead - seedseq::n ) );
+}
+
+CPU_TARGET( "avx2" )
+inline __m256i scramble256( __m256i a ) {
+    a = _mm256_xor_si256( a, _mm256_srli_epi32( a, 11 ) );
+    a = _mm256_xor_si256( a, _mm256_and_si256( _mm256_slli_epi32( a, 7 ), _mm256_set1_epi32( 0x9D2C5680 ) ) );
+    a = _mm256_xor_si256( a, _mm256_and_si256( _mm256_slli_epi32( a, 15 ), _mm256_set1_epi32( 0xEFC60000 ) ) );
+    return _mm256_xor_si256( a, _mm256_srli_epi32( a, 18 ) );
+}
+
+//! outputsAVX512() with 8 seeds per register
+template<size_t Groups>
+CPU_TARGET( "avx2" )
+void outputsAVX2( const Seeding& seeding, const uint64_t& from, uint32_t* out ) {
+    using namespace seedseq;
+    const size_t lanes = 8;
+    alignas( 32 ) __m256i b[n][Groups];
+
+    for( size_t s = 0; s < block; s += lanes * Groups ) {
+        for( size_t i = 0; i < n; ++i ) {
+            for( size_t g = 0; g < Groups; ++g ) {
+                b[i][g] = _mm256_set1_epi32( seeding.initial[i] );
+            }
+        }
+
+        for( size_t k = 1; k < n; ++k ) {
+            size_t kp = wrap( k + p );
+            size_t kq = wrap( k + q );
+
+            for( size_t g = 0; g < Groups; ++g ) {
+                __m256i add = k == 1 ? _mm256_add_epi32( _mm256_set1_epi32( static_cast<uint32_t>( from + s + g * lanes + 1 ) ),
+                                                         _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) )
+                              : _mm256_set1_epi32( static_cast<uint32_t>( k ) );
+                __m256i x = _mm256_xor_si256( _mm256_xor_si256( b[k][g], b[kp][g] ), b[k - 1][g] );
+                __m256i r1 = _mm256_mullo_epi32( mix256( x ), _mm256_set1_epi32( multiplier1 ) );
+                __m256i r2 = _mm256_add_epi32( r1, add );
+                b[kp][g] = _mm256_add_epi32( b[kp][g], r1 );
+                b[kq][g] = _mm256_add_epi32( b[kq][g], r2 );
+                b[k][g] = r2;
+            }
+        }
+
+        for( size_t k = 0; k < seeding.steps; ++k ) {
+            size_t kp = wrap( k + p );
+            size_t kq = wrap( k + q );
+            size_t previous = k ? k - 1 : n - 1;
+
+            for( size_t g = 0; g < Groups; ++g ) {
+                __m256i x = _mm256_add_epi32( _mm256_add_epi32( b[k][g], b[kp][g] ), b[previous][g] );
+                __m256i r3 = _mm256_mullo_epi32( mix256( x ), _mm256_set1_epi32( multiplier2 ) );
+                __m256i r4 = _mm256_sub_epi32( r3, _mm256_set1_epi32( static_cast<uint32_t>( k ) ) );
+                b[kp][g] = _mm256_xor_si256( b[kp][g], r3 );
+                b[kq][g] = _mm256_xor_si256( b[kq][g], r4 );
+                b[k][g] = r4;
+            }
+        }
+
+        for( size_t o = 0; o < seeding.indices.size(); ++o ) {
+            for( size_t g = 0; g < Groups; ++g ) {
+                _mm256_storeu_si256( reinterpret_cast<__m256i*>( out + o * block + s + g * lanes ),
+                                     scramble256( twisted256<Groups>( b, g, seeding.indices[o] ) ) );
+            }
+        }
+    }
+}
+
+Kernel kernel() {
+    return cpu::features().avx512f ? outputsAVX512<4> : cpu::features().avx2 ? outputsAVX2<4> : outputsScalar;
+}
+
+//! calls \p job( from, to, out ) for [ \p first, \p last ] in blocks on all cores, with \p out the outputs for \p indices,
+//! until \p job or \p cancel return true
+void forSeeds( const std::vector<size_t>& indices, const uint32_t& first, const uint32_t& last, const std::atomic_bool* cancel,
+               const std::function<bool( const uint64_t& from, const uint64_t& to, const uint32_t* out )>& job ) {
+    Seeding seeding( indices );
+    Kernel outputs = kernel();
+    const uint64_t end = static_cast<uint64_t>( last ) + 1;
+    std::atomic<uint64_t> next = first;
+    std::atomic_bool done = false;
+
+    // jobs from the front, so an early stop ends all threads soon
+    auto work = [&] {
+        std::vector<uint32_t> out( indices.size() * block );
+
+        while( !done && !( cancel && *cancel ) ) {
+            uint64_t from = next.fetch_add( seedsPerJob );
+
+            for( uint64_t to = std::min( from + seedsPerJob, end ); from < to && !done; from += block ) {
+                outputs( seeding, from, out.data() );
+
+                if( job( from, std::min<uint64_t>( from + block, to ), out.data() ) ) {
+                    done = true;
+                }
+            }
+
+            if( from >= end ) {
+                break;
+            }
+        }
+    };
+
+    size_t threads = std::clamp<size_t>( std::thread::hardware_concurrency(), 1, ( end - first + seedsPerJob - 1 ) / seedsPerJob );
+    std::vector<std::thread> workers;
+
+    for( size_t i = 1; i < threads; ++i ) {
+        workers.emplace_back( work );
+    }
+
+    work();
+
+    for( std::thread& worker : workers ) {
+        worker.join();
+    }
+}
+
+}
+
 cracker::GuessedKey cracker::guessKey( const Bytes& text ) {
     float best = 0.f;
     uint8_t bestKey = 0;
@@ -56,13 +417,11 @@ cracker::GuessedSize cracker::guessBlockSize( const cracker::BlockEncryptFunc& e
 
         for( size_t j = 0; j < blocks - 2; ++j ) {
 
-            Bytes first( encrypted.cbegin() + ( j + 0 ) * guess.blockSize,
-                         encrypted.cbegin() + ( j + 1 ) * guess.blockSize );
-            Bytes second( encrypted.cbegin() + ( j + 1 ) * guess.blockSize,
-                          encrypted.cbegin() + ( j + 2 ) * guess.blockSize );
+            ByteView first  = ByteView( encrypted ).subspan( ( j + 0 ) * guess.blockSize, guess.blockSize );
+            ByteView second = ByteView( encrypted ).subspan( ( j + 1 ) * guess.blockSize, guess.blockSize );
 
             // then rest is suffix
-            if( first == second ) {
+            if( std::equal( first.begin(), first.end(), second.begin() ) ) {
                 suffixStart = i;
                 sizePrevious = encrypted.size();
                 // max suffix size
@@ -117,16 +476,10 @@ std::optional<crypto::Encrypted::Type> cracker::detectECBorCBC( const Bytes& enc
     size_t blockcount = encrypted.size() / blockSize;
     size_t center = blockcount / 2;
 
-    size_t from1 = ( center - 1 ) * blockSize;
-    size_t to1 = ( center ) * blockSize;
-    size_t from2 = to1;
-    size_t to2 = ( center + 1 ) * blockSize;
-    Bytes::const_iterator start = encrypted.cbegin();
-
     // center blocks should decrypt the same with ECB -> their Hamming distance is 0
-    Bytes centerLeft  = Bytes( start + from1, start + to1 );
-    Bytes centerRight = Bytes( start + from2, start + to2 );
-    size_t dist = utils::hammingDistance<Bytes>( centerLeft, centerRight );
+    ByteView centerLeft  = ByteView( encrypted ).subspan( ( center - 1 ) * blockSize, blockSize );
+    ByteView centerRight = ByteView( encrypted ).subspan( ( center ) * blockSize, blockSize );
+    size_t dist = utils::hammingDistance( centerLeft, centerRight );
 
     if( dist == 0 ) {
         guess = crypto::Encrypted::Type::ECB;
@@ -137,3 +490,198 @@ std::optional<crypto::Encrypted::Type> cracker::detectECBorCBC( const Bytes& enc
 #endif
     return guess;
 }
+
+std::vector<cracker::KnownOutput> cracker::knownOutputs( const size_t& offset, ByteView keystream ) {
+    std::vector<KnownOutput> known;
+    const size_t wordSize = sizeof( uint32_t );
+
+    // the keystream is the little endian outputs
+    for( size_t i = 0; i < keystream.size(); ++i ) {
+        size_t index = ( offset + i ) / wordSize;
+        size_t shift = 8 * ( ( offset + i ) % wordSize );
+
+        if( known.empty() || known.back().index != index ) {
+            known.push_back( { index, 0, 0 } );
+        }
+
+        known.back().value |= static_cast<uint32_t>( keystream[i] ) << shift;
+        known.back().mask |= 0xffu << shift;
+    }
+
+    // full words first, they reject more seeds
+    std::stable_sort( known.begin(), known.end(), []( const KnownOutput & a, const KnownOutput & b ) {
+        return std::popcount( a.mask ) > std::popcount( b.mask );
+    } );
+    return known;
+}
+
+std::optional<uint32_t> cracker::findMersenneSeed( const std::vector<KnownOutput>& known, const uint32_t& first,
+        const uint32_t& last, const std::atomic_bool* cancel ) {
+    if( known.empty() || first > last ) {
+        LOG( "Error: Nothing to search for" );
+        return {};
+    }
+
+    std::vector<size_t> indices;
+
+    for( const KnownOutput& output : known ) {
+        if( output.index >= Mersenne::size - 1 ) {
+            LOG( "Error: Output " << output.index << " is beyond the first twist" );
+            return {};
+        }
+
+        indices.push_back( output.index );
+    }
+
+    std::optional<uint32_t> seed;
+    std::mutex m;
+
+    forSeeds( indices, first, last, cancel, [&]( const uint64_t & from, const uint64_t & to, const uint32_t * out ) {
+        for( size_t s = 0; s < to - from; ++s ) {
+            bool match = true;
+
+            for( size_t o = 0; o < known.size() && match; ++o ) {
+                match = ( ( out[o * block + s] ^ known[o].value ) & known[o].mask ) == 0;
+            }
+
+            if( match ) {
+                std::unique_lock<std::mutex> lock( m );
+                seed = static_cast<uint32_t>( from + s );
+                return true;
+            }
+        }
+
+        return false;
+    } );
+
+    return seed;
+}
+
+cracker::SeedIndex::SeedIndex( const uint32_t& first, const uint32_t& last ) {
+    if( first > last ) {
+        LOG( "Error: Empty seed range" );
+        return;
+    }
+
+    auto computed = std::make_shared<std::vector<Entry>>( static_cast<uint64_t>( last ) - first + 1 );
+    std::vector<Entry>& sorted = *computed;
+
+    forSeeds( { 0 }, first, last, nullptr, [&]( const uint64_t & from, const uint64_t & to, const uint32_t * out ) {
+        for( size_t s = 0; s < to - from; ++s ) {
+            sorted[from - first + s] = { out[s], static_cast<uint32_t>( from + s ) };
+        }
+
+        return false;
+    } );
+
+    std::sort( sorted.begin(), sorted.end(), []( const Entry & a, const Entry & b ) {
+        return a.output < b.output || ( a.output == b.output && a.seed < b.seed );
+    } );
+
+    header = { indexMagic, indexVersion, first, last, sorted.size() };
+    entries = sorted.data();
+    storage = computed;
+}
+
+cracker::SeedIndex::SeedIndex( const std::string& filename ) {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<const void> file;
+
+#ifdef _WIN32
+    auto read = std::make_shared<Bytes>( utils::fromFile( filename ) );
+    data = read->data();
+    size = read->size();
+    file = read;
+#else
+    int fd = open( filename.c_str(), O_RDONLY );
+    struct stat st = {};
+
+    if( fd < 0 || fstat( fd, &st ) != 0 || st.st_size < static_cast<off_t>( sizeof( Header ) ) ) {
+        LOG( "Error: Could not open " << filename );
+
+        if( fd >= 0 ) {
+            close( fd );
+        }
+
+        return;
+    }
+
+    size = st.st_size;
+    void* mapped = mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+
+    if( mapped == MAP_FAILED ) {
+        LOG( "Error: Could not map " << filename );
+        return;
+    }
+
+    data = static_cast<const uint8_t*>( mapped );
+    file = std::shared_ptr<const void>( mapped, [size]( const void* p ) {
+        munmap( const_cast<void*>( p ), size );
+    } );
+#endif
+
+    Header read;
+
+    if( size < sizeof( Header ) ) {
+        LOG( "Error: " << filename << " is no seed index" );
+        return;
+    }
+
+    std::memcpy( &read, data, sizeof( Header ) );
+
+    if( read.magic != indexMagic || read.version != indexVersion || read.first > read.last
+            || read.count != static_cast<uint64_t>( read.last ) - read.first + 1 || size != sizeof( Header ) + read.count * sizeof( Entry ) ) {
+        LOG( "Error: " << filename << " is no seed index" );
+        return;
+    }
+
+    header = read;
+    entries = reinterpret_cast<const Entry*>( data + sizeof( Header ) );
+    storage = file;
+}
+
+bool cracker::SeedIndex::save( const std::string& filename ) const {
+    std::ofstream file( filename.c_str(), std::ios::binary | std::ios::out );
+
+    if( !file ) {
+        LOG( "Error: Could not open " << filename );
+        return false;
+    }
+
+    file.write( reinterpret_cast<const char*>( &header ), sizeof( Header ) );
+    file.write( reinterpret_cast<const char*>( entries ), header.count * sizeof( Entry ) );
+    return file.good();
+}
+
+std::vector<uint32_t> cracker::SeedIndex::seeds( const uint32_t& output ) const {
+    return seeds( std::vector<uint32_t> { output } ).front();
+}
+
+std::vector<std::vector<uint32_t>> cracker::SeedIndex::seeds( const std::vector<uint32_t>& outputs ) const {
+    std::vector<std::vector<uint32_t>> found( outputs.size() );
+    std::vector<size_t> order( outputs.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::sort( order.begin(), order.end(), [&outputs]( const size_t & a, const size_t & b ) {
+        return outputs[a] < outputs[b];
+    } );
+
+    auto less = []( const Entry & entry, const uint32_t& output ) {
+        return entry.output < output;
+    };
+
+    // the next output can't be before the previous one
+    const Entry* low = entries;
+    const Entry* end = entries + header.count;
+
+    for( size_t i : order ) {
+        low = std::lower_bound( low, end, outputs[i], less );
+
+        for( const Entry* e = low; e != end && e->output == outputs[i]; ++e ) {
+            found[i].push_back( e->seed );
+        }
+    }
+
+    return found;
+}
@@ -1,7 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+
 #include "utils.hpp"
 #include "crypto.hpp"
+#include "hash.hpp"
 
 namespace cracker {
 
@@ -22,4 +29,144 @@ GuessedSize guessBlockSize( const BlockEncryptFunc& encryptFunc );
 
 std::optional<crypto::Encrypted::Type> detectECBorCBC( const Bytes& encrypted, const size_t& blockSize );
 
+//! output \p index of a freshly seeded Mersenne, only the bits in \p mask are known
+struct KnownOutput {
+    size_t index = {0};
+    uint32_t value = {0};
+    uint32_t mask = {0xffffffff};
+};
+//! the outputs covered by \p keystream, the Mersenne CTR keystream from byte \p offset on,
+//! partial words at the ends get a mask
+std::vector<KnownOutput> knownOutputs( const size_t& offset, ByteView keystream );
+
+//! finds a seed in [ \p first, \p last ] for Mersenne( seed ) producing all \p known outputs, indices below 623,
+//! 16 or 8 seeds per SIMD register on all cores, stops at the first match or when \p cancel is set
+std::optional<uint32_t> findMersenneSeed( const std::vector<KnownOutput>& known, const uint32_t& first = 0,
+                                          const uint32_t& last = 0xffffffff, const std::atomic_bool* cancel = nullptr );
+
+//! first outputs of Mersenne( seed ) for all seeds in [ first, last ], e.g. timestamps, sorted for binary search,
+//! saved as the raw header and entries of the little endian host, so a saved index is mapped into memory as is
+class SeedIndex {
+    public:
+        struct Entry {
+            uint32_t output = {0};
+            uint32_t seed = {0};
+        };
+
+        //! computes the index for the seeds [ \p first, \p last ] on all cores
+        SeedIndex( const uint32_t& first, const uint32_t& last );
+        //! maps the index saved to \p filename, empty if it isn't a valid one
+        explicit SeedIndex( const std::string& filename );
+
+        //! writes the index to \p filename
+        bool save( const std::string& filename ) const;
+
+        //! \returns the seeds with the first output \p output, in O( log n ), usually none or one
+        std::vector<uint32_t> seeds( const uint32_t& output ) const;
+        //! seeds() for each of \p outputs, looked up in sorted order to narrow the searched range
+        std::vector<std::vector<uint32_t>> seeds( const std::vector<uint32_t>& outputs ) const;
+
+        uint32_t first() const {
+            return header.first;
+        }
+        uint32_t last() const {
+            return header.last;
+        }
+        size_t size() const {
+            return header.count;
+        }
+
+    private:
+        struct Header {
+            uint32_t magic = {0};
+            uint32_t version = {0};
+            uint32_t first = {0};
+            uint32_t last = {0};
+            uint64_t count = {0};
+        };
+
+        Header header;
+        //! the mapped file or the computed entries
+        std::shared_ptr<const void> storage;
+        const Entry* entries = nullptr;
+};
+
+//! forges MACs H( key || message || glue || suffix ) from the MAC H( key || message ) of the Merkle-Damgard hash
+//! \p Ctx, e.g. hash::Sha1Ctx, for an unknown key length: the state is restored from the MAC once, the whole blocks
+//! of the suffix are compressed once, and the last blocks are finished once per total length the glue padding aligns to,
+//! all key lengths with the same one share the forged MAC
+template<class Ctx>
+class LengthExtension {
+    public:
+        struct Forgery {
+            size_t keyLength = {0};
+            //! message || glue || suffix, what is sent with the MAC
+            Bytes message;
+            Bytes mac;
+        };
+        //! checks a batch of forgeries, \returns the index of one that was accepted
+        using Oracle = std::function<std::optional<size_t>( const std::vector<Forgery>& )>;
+
+        LengthExtension( const Bytes& message, const Bytes& mac, const Bytes& suffix ) : message( message ), suffix( suffix ) {
+            whole = suffix.size() / Ctx::blockSize * Ctx::blockSize;
+            Ctx ctx( hash::shaToMagics<Bytes, Ctx::digestSize / 4, Ctx::bigEndian>( mac ) );
+            ctx.update( ByteView( suffix ).first( whole ) );
+            midstate = ctx.magics();
+        }
+
+        //! the forgery for a key of \p keyLength bytes
+        Forgery forge( const size_t& keyLength ) {
+            const size_t length = keyLength + message.size();
+            Bytes glue = hash::sha1MDPadding<Bytes, Ctx::bigEndian>( length );
+            const uint64_t hashed = length + glue.size();
+
+            auto found = macs.find( hashed );
+
+            if( found == macs.end() ) {
+                Bytes mac( Ctx::digestSize );
+                Ctx ctx( midstate, hashed + whole );
+                ctx.update( ByteView( suffix ).subspan( whole ) );
+                ctx.final( mac.data() );
+                found = macs.emplace( hashed, mac ).first;
+            }
+
+            return Forgery{ keyLength, message + glue + suffix, found->second };
+        }
+
+        //! tries the key lengths [ \p first, \p last ] in batches of \p batchSize forgeries until \p oracle accepts one
+        std::optional<Forgery> forge( const size_t& first, const size_t& last, const Oracle& oracle, const size_t& batchSize = 64 ) {
+            std::vector<Forgery> batch;
+
+            for( size_t keyLength = first; keyLength <= last; ) {
+                batch.clear();
+
+                for( ; keyLength <= last && batch.size() < batchSize; ++keyLength ) {
+                    batch.push_back( forge( keyLength ) );
+                }
+
+                std::optional<size_t> accepted = oracle( batch );
+
+                if( accepted && *accepted < batch.size() ) {
+                    return batch[*accepted];
+                }
+            }
+
+            return {};
+        }
+
+        //! the number of last blocks finished so far, the only hashing besides the constructor
+        size_t finished() const {
+            return macs.size();
+        }
+
+    private:
+        Bytes message;
+        Bytes suffix;
+        //! bytes of whole blocks in suffix, compressed into midstate
+        size_t whole = 0;
+        typename Ctx::Magics midstate = {};
+        //! the forged MAC for each total length of key, message and glue
+        std::map<uint64_t, Bytes> macs;
+};
+
 }
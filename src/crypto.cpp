@@ -1,32 +1,109 @@
 #include "crypto.hpp"
 
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <random>
 #include <stdexcept>
 #include <cstring>
+#include <thread>
+
+#include <emmintrin.h>
 
 #include "converter.hpp"
 #include "random.hpp"
 #include "hash.hpp"
+#include "hashbatch.hpp"
 #include "log.hpp"
+#include "aes.hpp"
+#include "ghash.hpp"
 
-#if 0
-#include "openssl.hpp"
-namespace aes = openssl;
-#else
-#include "aesni.hpp"
-namespace aes = aesni;
-#endif
+namespace {
 
-Bytes crypto::XOR( const Bytes& data, const Bytes& key ) {
+//! XORs \p length bytes of \p in with \p stream into \p out, which may be \p in, 16 bytes per instruction
+void xorStream( const uint8_t* in, const uint8_t* stream, uint8_t* out, const size_t& length ) {
+    size_t i = 0;
+
+    for( ; i + 16 <= length; i += 16 ) {
+        __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + i ) );
+        __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( stream + i ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), _mm_xor_si128( a, b ) );
+    }
+
+    for( ; i < length; ++i ) {
+        out[i] = in[i] ^ stream[i];
+    }
+}
+
+//! minimum number of AES blocks per thread, smaller inputs run on the calling thread
+const size_t blocksPerThread = 64 * 1024;
+
+//! splits \p blocks into contiguous ranges [from, to) and calls \p func for each one on its own thread
+void forChunks( const size_t& blocks, const std::function<void( const size_t&, const size_t& )>& func ) {
+    size_t threads = std::min<size_t>( std::thread::hardware_concurrency(), blocks / blocksPerThread );
+
+    if( threads < 2 ) {
+        func( 0, blocks );
+        return;
+    }
+
+    size_t chunk = ( blocks + threads - 1 ) / threads;
+    std::vector<std::thread> workers;
+    workers.reserve( threads );
+
+    for( size_t from = 0; from < blocks; from += chunk ) {
+        workers.emplace_back( func, from, std::min( from + chunk, blocks ) );
+    }
+
+    for( std::thread& worker : workers ) {
+        worker.join();
+    }
+}
+
+//! XORs \p length bytes of \p in with the CTR keystream starting at byte \p position into \p out,
+//! a partial first block is completed on the stack
+void cryptAt( const crypto::AesKey128& key, const uint64_t& nonce, const size_t& position,
+              const uint8_t* in, uint8_t* out, const size_t& length ) {
+    size_t skip = position % crypto::blockSize;
+    size_t done = 0;
+
+    if( skip && length ) {
+        uint8_t block[crypto::blockSize] = {};
+        done = std::min( crypto::blockSize - skip, length );
+        std::memcpy( block + skip, in, done );
+        aes::cryptAES128CTR( block, block, crypto::blockSize, key, nonce, position / crypto::blockSize );
+        std::memcpy( out, block + skip, done );
+    }
+
+    if( length > done ) {
+        aes::cryptAES128CTR( in + done, out + done, length - done, key, nonce, ( position + done ) / crypto::blockSize );
+    }
+}
+
+}
+
+void crypto::XOR( ByteView data, ByteView key, uint8_t* out ) {
     size_t size1 = data.size();
     size_t size2 = key.size();
-    Bytes rv( size1, 0 );
 
-    for( size_t i = 0; i < size1; ++i ) {
-        rv[i] = data[i] ^ key[i % size2];
+    for( size_t i = 0, k = 0; i < size1; ++i, ++k ) {
+        if( k == size2 ) { k = 0; }
+
+        out[i] = data[i] ^ key[k];
     }
+}
+
+void crypto::XOR( ByteView data, const uint8_t& key, uint8_t* out ) {
+    size_t size = data.size();
+
+    for( size_t i = 0; i < size; ++i ) {
+        out[i] = data[i] ^ key;
+    }
+}
 
+Bytes crypto::XOR( const Bytes& data, const Bytes& key ) {
+    Bytes rv( data.size(), 0 );
+    XOR( data, key, rv.data() );
     return rv;
 }
 
@@ -39,13 +116,8 @@ std::string crypto::XOR( const std::string& data, const std::string& key ) {
 }
 
 Bytes crypto::XOR( const Bytes& data, const uint8_t& key ) {
-    size_t size = data.size();
-    Bytes rv( size, 0 );
-
-    for( size_t i = 0; i < size; ++i ) {
-        rv[i] = data[i] ^ key;
-    }
-
+    Bytes rv( data.size(), 0 );
+    XOR( data, key, rv.data() );
     return rv;
 }
 
@@ -65,12 +137,10 @@ Container crypto::padPKCS7( const Container& input, const size_t block ) {
     size_t size = input.size();
 
     size_t padSize = block - size % block;
-    Container rv = input;
+    Container rv;
     rv.reserve( size + padSize );
-
-    for( uint8_t i = 0; i < padSize; ++i ) {
-        rv.push_back( static_cast<typename Container::value_type>( padSize ) );
-    }
+    rv.insert( rv.end(), input.cbegin(), input.cend() );
+    rv.resize( size + padSize, static_cast<typename Container::value_type>( padSize ) );
 
     return rv;
 }
@@ -78,14 +148,15 @@ Container crypto::padPKCS7( const Container& input, const size_t block ) {
 template Bytes crypto::padPKCS7( const Bytes& input, const size_t blockSize );
 template std::string crypto::padPKCS7( const std::string& input, const size_t blockSize );
 
-template<class Container>
-Container crypto::unpadPKCS7( const Container& input ) {
-    using type = typename Container::value_type;
+namespace {
+
+//! \returns the validated PKCS#7 padding size of \p input
+size_t padSizePKCS7( ByteView input ) {
 
-    if( input.empty() ) { return {}; }
+    if( input.empty() ) { return 0; }
 
     size_t size = input.size();
-    type padSize = input.back();
+    uint8_t padSize = input.back();
 
     if( input.size() < static_cast<size_t>( padSize ) ) {
         throw std::invalid_argument( "PKCS7: Padding too big" );
@@ -96,13 +167,21 @@ Container crypto::unpadPKCS7( const Container& input ) {
     }
 
     // validate PKCS7 format
-    for( type i = 1; i <= padSize; ++i ) {
+    for( size_t i = 1; i <= padSize; ++i ) {
 
         if( input[size - i] != padSize ) {
             throw std::invalid_argument( "PKCS7: Bad padding" );
         }
     }
 
+    return padSize;
+}
+
+}
+
+template<class Container>
+Container crypto::unpadPKCS7( const Container& input ) {
+    size_t padSize = padSizePKCS7( ByteView( reinterpret_cast<const uint8_t*>( input.data() ), input.size() ) );
     return Container( input.cbegin(), input.cend() - static_cast<typename Container::difference_type>( padSize ) );
 }
 
@@ -116,15 +195,39 @@ Bytes crypto::encryptAES128ECB( const Bytes& text, const Bytes& key ) {
         return {};
     }
 
-    Bytes padded = padPKCS7( text );
-    Bytes cipher( padded.size(), 0 );
-
-    int len = aes::encryptAES128ECB( padded.data(), cipher.data(), padded.size(), key.data() );
+    return encryptAES128ECB( text, AesKey128( key.data() ) );
+}
 
-    cipher.resize( static_cast<size_t>( len ) );
+Bytes crypto::encryptAES128ECB( const Bytes& text, const AesKey128& key ) {
+    Bytes cipher( paddedSize( text.size() ), 0 );
+    encryptAES128ECB( text, key, cipher.data() );
     return cipher;
 }
 
+namespace {
+
+//! copies the incomplete last block of \p text into \p last and pads it
+//! \returns the size of the complete blocks before it
+size_t lastBlockPKCS7( ByteView text, uint8_t* last ) {
+    size_t full = text.size() - text.size() % crypto::blockSize;
+    size_t rest = text.size() - full;
+    std::memcpy( last, text.data() + full, rest );
+    std::memset( last + rest, static_cast<int>( crypto::blockSize - rest ), crypto::blockSize - rest );
+    return full;
+}
+
+}
+
+size_t crypto::encryptAES128ECB( ByteView text, const AesKey128& key, uint8_t* out ) {
+    uint8_t last[crypto::blockSize];
+    size_t full = lastBlockPKCS7( text, last );
+
+    aes::encryptAES128ECB( text.data(), out, full, key );
+    aes::encryptAES128ECB( last, out + full, crypto::blockSize, key );
+
+    return full + crypto::blockSize;
+}
+
 Bytes crypto::decryptAES128ECB( const Bytes& data, const Bytes& key ) {
 
     if( key.size() != crypto::blockSize ) {
@@ -132,19 +235,25 @@ Bytes crypto::decryptAES128ECB( const Bytes& data, const Bytes& key ) {
         return {};
     }
 
-    if( data.size() % crypto::blockSize != 0 ) {
-        LOG( "Error: Invalid data size " << data.size() << " % " << crypto::blockSize << " != 0" );
-        return {};
-    }
+    return decryptAES128ECB( data, AesKey128( key.data() ) );
+}
 
+Bytes crypto::decryptAES128ECB( const Bytes& data, const AesKey128& key ) {
     Bytes plain( data.size(), 0 );
+    plain.resize( decryptAES128ECB( data, key, plain.data() ) );
+    return plain;
+}
 
-    int len = aes::decryptAES128ECB( data.data(), plain.data(), data.size(), key.data() );
+size_t crypto::decryptAES128ECB( ByteView data, const AesKey128& key, uint8_t* out ) {
 
-    plain.resize( static_cast<size_t>( len ) );
-    plain = unpadPKCS7( plain );
+    if( data.size() % crypto::blockSize != 0 ) {
+        LOG( "Error: Invalid data size " << data.size() << " % " << crypto::blockSize << " != 0" );
+        return 0;
+    }
 
-    return plain;
+    aes::decryptAES128ECB( data.data(), out, data.size(), key );
+
+    return data.size() - padSizePKCS7( ByteView( out, data.size() ) );
 }
 
 Bytes crypto::encryptAES128CBC( const Bytes& text, const Bytes& key, const Bytes& iv ) {
@@ -154,28 +263,78 @@ Bytes crypto::encryptAES128CBC( const Bytes& text, const Bytes& key, const Bytes
         return {};
     }
 
+    return encryptAES128CBC( text, AesKey128( key.data() ), iv );
+}
+
+Bytes crypto::encryptAES128CBC( const Bytes& text, const AesKey128& key, const Bytes& iv ) {
+    Bytes result( paddedSize( text.size() ), 0 );
+    result.resize( encryptAES128CBC( text, key, iv, result.data() ) );
+    return result;
+}
+
+size_t crypto::encryptAES128CBC( ByteView text, const AesKey128& key, ByteView iv, uint8_t* out ) {
+
     if( iv.size() != crypto::blockSize ) {
         LOG( "Error: Invalid iv size " << iv.size() << " != " << crypto::blockSize );
+        return 0;
+    }
+
+    uint8_t last[crypto::blockSize];
+    size_t full = lastBlockPKCS7( text, last );
+
+    aes::encryptAES128CBC( text.data(), out, full, key, iv.data() );
+    aes::encryptAES128CBC( last, out + full, crypto::blockSize, key, full ? out + full - crypto::blockSize : iv.data() );
+
+    return full + crypto::blockSize;
+}
+
+std::vector<Bytes> helperAES128CBCBatch( const std::vector<Bytes>& texts,
+                                         const std::function<const crypto::AesKey128&( const size_t& )>& keyAt,
+                                         const std::vector<Bytes>& ivs ) {
+
+    if( texts.size() != ivs.size() ) {
+        LOG( "Error: Invalid iv count " << ivs.size() << " != " << texts.size() );
         return {};
     }
 
-    Bytes padded = crypto::padPKCS7( text );
-    size_t steps = padded.size() / crypto::blockSize;
+    for( const Bytes& iv : ivs ) {
+        if( iv.size() != crypto::blockSize ) {
+            LOG( "Error: Invalid iv size " << iv.size() << " != " << crypto::blockSize );
+            return {};
+        }
+    }
+
+    std::vector<Bytes> results;
+    results.reserve( texts.size() );
 
-    Bytes encrypted = iv;
-    Bytes result;
+    std::vector<aesni::CBCJob> jobs;
+    jobs.reserve( texts.size() );
 
-    for( size_t i = 0; i < steps; ++i ) {
-        Bytes plain = crypto::XOR( encrypted,
-                                   Bytes( padded.cbegin() + ( i + 0 ) * crypto::blockSize,
-                                          padded.cbegin() + ( i + 1 ) * crypto::blockSize ) );
-        aes::encryptAES128ECB( plain.data(), encrypted.data(), plain.size(), key.data() );
-        result = result + encrypted;
+    // pad into the output, then encrypt in place
+    for( size_t i = 0; i < texts.size(); ++i ) {
+        results.push_back( crypto::padPKCS7( texts[i] ) );
+        Bytes& result = results.back();
+        jobs.push_back( { result.data(), result.data(), result.size(), &keyAt( i ), ivs[i].data() } );
     }
 
-    return result;
+    aes::encryptAES128CBC( jobs.data(), jobs.size() );
+
+    return results;
 }
 
+std::vector<Bytes> crypto::encryptAES128CBC( const std::vector<Bytes>& texts, const AesKey128& key, const std::vector<Bytes>& ivs ) {
+    return helperAES128CBCBatch( texts, [&key]( const size_t& ) -> const AesKey128& { return key; }, ivs );
+}
+
+std::vector<Bytes> crypto::encryptAES128CBC( const std::vector<Bytes>& texts, const std::vector<AesKey128>& keys, const std::vector<Bytes>& ivs ) {
+
+    if( texts.size() != keys.size() ) {
+        LOG( "Error: Invalid key count " << keys.size() << " != " << texts.size() );
+        return {};
+    }
+
+    return helperAES128CBCBatch( texts, [&keys]( const size_t& i ) -> const AesKey128& { return keys[i]; }, ivs );
+}
 
 Bytes crypto::decryptAES128CBC( const Bytes& data, const Bytes& key, const Bytes& iv ) {
 
@@ -184,37 +343,44 @@ Bytes crypto::decryptAES128CBC( const Bytes& data, const Bytes& key, const Bytes
         return {};
     }
 
+    return decryptAES128CBC( data, AesKey128( key.data() ), iv );
+}
+
+Bytes crypto::decryptAES128CBC( const Bytes& data, const AesKey128& key, const Bytes& iv ) {
+    Bytes result( data.size() );
+    result.resize( decryptAES128CBC( data, key, iv, result.data() ) );
+    return result;
+}
+
+size_t crypto::decryptAES128CBC( ByteView data, const AesKey128& key, ByteView iv, uint8_t* out ) {
+
     if( iv.size() != crypto::blockSize ) {
         LOG( "Error: Invalid iv size " << iv.size() << " != " << crypto::blockSize );
-        return {};
+        return 0;
     }
 
     if( data.size() % crypto::blockSize != 0 ) {
         LOG( "Error: Invalid data size " << data.size() << " % " << crypto::blockSize << " != 0" );
-        return {};
+        return 0;
     }
 
-    size_t steps = data.size() / crypto::blockSize;
-
-    Bytes newIV = iv;
-    Bytes decrypted( crypto::blockSize, 0 );
-    Bytes result;
-
-    for( size_t i = 0; i < steps; ++i ) {
-        Bytes encrypted = Bytes( data.cbegin() + ( i + 0 ) * crypto::blockSize,
-                                 data.cbegin() + ( i + 1 ) * crypto::blockSize );
-        aes::decryptAES128ECB( encrypted.data(), decrypted.data(), encrypted.size(), key.data() );
-        Bytes plain = crypto::XOR( newIV, decrypted );
-        result.insert( result.end(), plain.cbegin(), plain.cend() );
-        newIV = encrypted;
+    // in place, the chunks would overwrite the ciphertext blocks their neighbours chain on
+    if( out == data.data() ) {
+        aes::decryptAES128CBC( data.data(), out, data.size(), key, iv.data() );
+    } else {
+        size_t blocks = data.size() / crypto::blockSize;
+
+        // CBC decryption has no serial dependency, each chunk only needs the ciphertext block before it
+        forChunks( blocks, [&]( const size_t & from, const size_t & to ) {
+            const uint8_t* chunkIV = from ? data.data() + ( from - 1 ) * crypto::blockSize : iv.data();
+            aes::decryptAES128CBC( data.data() + from * crypto::blockSize, out + from * crypto::blockSize,
+                                   ( to - from ) * crypto::blockSize, key, chunkIV );
+        } );
     }
 
-    result = unpadPKCS7( result );
-
-    return result;
+    return data.size() - padSizePKCS7( ByteView( out, data.size() ) );
 }
 
-
 Bytes crypto::genKey() {
     return randombuffer::get( crypto::blockSize );
 }
@@ -250,19 +416,72 @@ crypto::Encrypted crypto::encryptECBOrCBC( const Bytes& data ) {
     }
 }
 
-Bytes crypto::encryptECBWithSecretSuffix( const Bytes& data ) {
-    // dd if=/dev/urandom bs=1 count=16 status=none | xxd -i -c 1000
-    Bytes key = { 0x61, 0x82, 0xd5, 0x3a, 0x29, 0x82, 0xcb, 0x4f, 0x2d, 0x9e, 0x04, 0x3b, 0xe5, 0xdf, 0x97, 0xb3 };
+namespace {
+
+const std::string secretSuffix = "Um9sbGluJyBpbiBteSA1LjAKV2l0aCBteSByYWctdG9wIGRvd24gc28gbXkg"
+                                 "aGFpciBjYW4gYmxvdwpUaGUgZ2lybGllcyBvbiBzdGFuZGJ5IHdhdmluZyBq"
+                                 "dXN0IHRvIHNheSBoaQpEaWQgeW91IHN0b3A/IE5vLCBJIGp1c3QgZHJvdmUg"
+                                 "YnkK";
+
+}
+
+crypto::ECBOracle::ECBOracle( const Bytes& key, const Bytes& prefix, const Bytes& suffix ) :
+    key( key.data() ), prefix( prefix ), suffix( suffix ) {
+}
+
+Bytes crypto::ECBOracle::encrypt( const Bytes& data ) const {
+    return encrypt( std::vector<Bytes> { data } ).front();
+}
+
+std::vector<Bytes> crypto::ECBOracle::encrypt( const std::vector<Bytes>& data ) const {
+    std::vector<size_t> offsets;
+    offsets.reserve( data.size() + 1 );
+    offsets.push_back( 0 );
+
+    for( const Bytes& text : data ) {
+        offsets.push_back( offsets.back() + paddedSize( prefix.size() + text.size() + suffix.size() ) );
+    }
+
+    // all messages padded back to back, ECB encrypts them independently in one call
+    Bytes all( offsets.back() );
+
+    for( size_t i = 0; i < data.size(); ++i ) {
+        uint8_t* message = all.data() + offsets[i];
+        uint8_t* end = all.data() + offsets[i + 1];
+        message = std::copy( prefix.cbegin(), prefix.cend(), message );
+        message = std::copy( data[i].cbegin(), data[i].cend(), message );
+        message = std::copy( suffix.cbegin(), suffix.cend(), message );
+        std::fill( message, end, static_cast<uint8_t>( end - message ) );
+    }
+
+    aes::encryptAES128ECB( all.data(), all.data(), all.size(), key );
+
+    std::vector<Bytes> encrypted;
+    encrypted.reserve( data.size() );
+
+    for( size_t i = 0; i < data.size(); ++i ) {
+        encrypted.emplace_back( all.cbegin() + offsets[i], all.cbegin() + offsets[i + 1] );
+    }
+
+    return encrypted;
+}
 
-    std::string base64 = "Um9sbGluJyBpbiBteSA1LjAKV2l0aCBteSByYWctdG9wIGRvd24gc28gbXkg"
-                         "aGFpciBjYW4gYmxvdwpUaGUgZ2lybGllcyBvbiBzdGFuZGJ5IHdhdmluZyBq"
-                         "dXN0IHRvIHNheSBoaQpEaWQgeW91IHN0b3A/IE5vLCBJIGp1c3QgZHJvdmUg"
-                         "YnkK";
+const crypto::ECBOracle& crypto::secretSuffixOracle() {
+    // dd if=/dev/urandom bs=1 count=16 status=none | xxd -i -c 1000
+    static const ECBOracle oracle( { 0x61, 0x82, 0xd5, 0x3a, 0x29, 0x82, 0xcb, 0x4f, 0x2d, 0x9e, 0x04, 0x3b, 0xe5, 0xdf, 0x97, 0xb3 },
+                                   {}, converter::base64ToBinary( secretSuffix ) );
+    return oracle;
+}
 
-    Bytes suffix = converter::base64ToBinary( base64 );
-    Bytes all = data + suffix;
+const crypto::ECBOracle& crypto::randomPrefixAndSecretSuffixOracle() {
+    // dd if=/dev/urandom bs=1 count=16 status=none | xxd -i -c 1000
+    static const ECBOracle oracle( { 0x3e, 0xb0, 0x62, 0x32, 0x19, 0x3e, 0x12, 0x61, 0xc5, 0x84, 0x45, 0x15, 0x2c, 0x1d, 0x47, 0xb0 },
+                                   randombuffer::get( randSize( 0, 50 ) ), converter::base64ToBinary( secretSuffix ) );
+    return oracle;
+}
 
-    return encryptAES128ECB( all, key );
+Bytes crypto::encryptECBWithSecretSuffix( const Bytes& data ) {
+    return secretSuffixOracle().encrypt( data );
 }
 
 std::ostream& crypto::operator<<( std::ostream& os, const crypto::Encrypted::Type& type ) {
@@ -280,127 +499,413 @@ std::ostream& crypto::operator<<( std::ostream& os, const crypto::Encrypted::Typ
 }
 
 Bytes crypto::encryptECBWithRandomPrefixAndSecretSuffix( const Bytes& data ) {
-    // dd if=/dev/urandom bs=1 count=16 status=none | xxd -i -c 1000
-    Bytes key = { 0x3e, 0xb0, 0x62, 0x32, 0x19, 0x3e, 0x12, 0x61, 0xc5, 0x84, 0x45, 0x15, 0x2c, 0x1d, 0x47, 0xb0 };
+    return randomPrefixAndSecretSuffixOracle().encrypt( data );
+}
 
-    static Bytes prefix  = randombuffer::get( randSize( 0, 50 ) );
+void crypto::cryptAES128CTR( ByteView text, const AesKey128& key, const uint64_t& nonce, uint8_t* out ) {
+    aes::cryptAES128CTR( text.data(), out, text.size(), key, nonce );
+}
 
-    std::string base64 = "Um9sbGluJyBpbiBteSA1LjAKV2l0aCBteSByYWctdG9wIGRvd24gc28gbXkg"
-                         "aGFpciBjYW4gYmxvdwpUaGUgZ2lybGllcyBvbiBzdGFuZGJ5IHdhdmluZyBq"
-                         "dXN0IHRvIHNheSBoaQpEaWQgeW91IHN0b3A/IE5vLCBJIGp1c3QgZHJvdmUg"
-                         "YnkK";
+Bytes helperAES128CTR( const Bytes& text, const crypto::AesKey128& key, const uint64_t& nonce ) {
+    Bytes encrypted( text.size() );
+    crypto::cryptAES128CTR( text, key, nonce, encrypted.data() );
+    return encrypted;
+}
 
-    Bytes suffix = converter::base64ToBinary( base64 );
+Bytes crypto::editAES128CTR( const Bytes& encrypted, const size_t& offset, const Bytes& replacement, const Bytes& key, const uint64_t& nonce ) {
 
-    Bytes all = prefix + data + suffix;
+    if( key.size() != crypto::blockSize ) {
+        LOG( "Error: Invalid key size " << key.size() << " != " << crypto::blockSize );
+        return {};
+    }
 
-    return encryptAES128ECB( all, key );
+    return editAES128CTR( encrypted, offset, replacement, AesKey128( key.data() ), nonce );
 }
 
-Bytes helperAES128CTR( const Bytes& text, const Bytes& key, const uint64_t& nonce ) {
-    Bytes padded = crypto::padPKCS7( text );
-    Bytes encrypted;
-    encrypted.reserve( padded.size() );
+Bytes crypto::editAES128CTR( const Bytes& encrypted, const size_t& offset, const Bytes& replacement, const AesKey128& key, const uint64_t& nonce ) {
 
-    uint64_t counter = 0;
-    Bytes nonce_counter( crypto::blockSize );
-    static_assert( crypto::blockSize == 2 * sizeof( nonce ), "nonce does not fit first half of AES block!" );
-    static_assert( crypto::blockSize == 2 * sizeof( counter ), "counter does not fit second half of AES block!" );
-    std::memcpy( &nonce_counter[0], &nonce, sizeof( nonce ) );
+    Bytes edited = encrypted;
 
-    for( size_t i = 0; i < padded.size(); i += crypto::blockSize ) {
-        Bytes sub( padded.cbegin() + i, padded.cbegin() + i + crypto::blockSize );
-        std::memcpy( &nonce_counter[crypto::blockSize / 2], &counter, sizeof( counter ) );
-        Bytes xorStream = crypto::encryptAES128ECB( nonce_counter, key );
-        Bytes scrambled = crypto::XOR( sub, xorStream );
-        encrypted.insert( encrypted.cend(), scrambled.cbegin(), scrambled.cend() );
-        counter++;
+    if( !CTRStream( edited, key, nonce ).edit( offset, replacement ) ) {
+        return Bytes();
     }
 
-    encrypted.resize( text.size() );
+    return edited;
+}
 
-    return encrypted;
+Bytes crypto::encryptAES128CTR( const Bytes& text, const Bytes& key, const uint64_t& nonce ) {
+
+    if( key.size() != crypto::blockSize ) {
+        LOG( "Error: Invalid key size " << key.size() << " != " << crypto::blockSize );
+        return {};
+    }
+
+    return helperAES128CTR( text, AesKey128( key.data() ), nonce );
 }
 
-Bytes crypto::editAES128CTR( const Bytes& encrypted, const size_t& offset, const Bytes& replacement, const Bytes& key, const uint64_t& nonce ) {
+Bytes crypto::encryptAES128CTR( const Bytes& text, const AesKey128& key, const uint64_t& nonce ) {
+    return helperAES128CTR( text, key, nonce );
+}
 
-    if( ( offset + replacement.size() ) > encrypted.size() ) {
-        LOG( "Replacement doesn't fit into encrypted stream" );
-        return Bytes();
+Bytes crypto::decryptAES128CTR( const Bytes& text, const Bytes& key, const uint64_t& nonce ) {
+    return encryptAES128CTR( text, key, nonce );
+}
+
+Bytes crypto::decryptAES128CTR( const Bytes& text, const AesKey128& key, const uint64_t& nonce ) {
+    return helperAES128CTR( text, key, nonce );
+}
+
+namespace {
+
+//! AES blocks per keystream chunk, small enough to be hashed while still in L1
+const size_t gcmChunkBlocks = 32;
+
+//! one pass GCM: keystream chunks from the dispatched AES kernels, GHASH over the ciphertext of every chunk
+//! \p out may be \p in, \returns the tag in \p tag
+void helperAES128GCM( ByteView in, const crypto::AesKey128& key, ByteView iv, ByteView aad,
+                      uint8_t* out, uint8_t* tag, const bool& decrypt ) {
+    using crypto::blockSize;
+
+    if( iv.empty() ) {
+        throw std::invalid_argument( "GCM: Invalid iv size" );
+    }
+
+    uint8_t h[blockSize] = {};
+    aes::encryptAES128ECB( h, h, blockSize, key );
+    ghash::Key hashKey( h );
+
+    // pre-counter block, the recommended 96 bit iv is used directly
+    uint8_t j0[blockSize] = {};
+
+    if( iv.size() == 12 ) {
+        std::memcpy( j0, iv.data(), iv.size() );
+        j0[blockSize - 1] = 1;
+    } else {
+        uint8_t lengths[blockSize] = {};
+        ghash::detail::storeBigEndian( lengths + 8, iv.size() * 8 );
+        ghash::update( j0, iv.data(), iv.size(), hashKey );
+        ghash::update( j0, lengths, blockSize, hashKey );
     }
 
-    Bytes nonce_counter( crypto::blockSize );
-    Bytes padded = crypto::padPKCS7( encrypted );
+    uint8_t state[blockSize] = {};
+    ghash::update( state, aad.data(), aad.size(), hashKey );
 
-    // |                |                |                |                |
-    // |                |<----######################----->|                |
-    size_t from = offset - offset % crypto::blockSize;
-    size_t to   = offset + replacement.size() - ( offset + replacement.size() ) % crypto::blockSize + crypto::blockSize;
+    uint32_t counter = static_cast<uint32_t>( ghash::detail::loadBigEndian( j0 + 8 ) );
+    uint8_t stream[gcmChunkBlocks * blockSize];
 
-    // decrypt part where replacement should go
-    {
-        uint64_t counter = from / crypto::blockSize;
-        std::memcpy( &nonce_counter[0], &nonce, sizeof( nonce ) );
+    for( size_t done = 0; done < in.size(); done += sizeof( stream ) ) {
+        size_t length = std::min( sizeof( stream ), in.size() - done );
 
-        for( size_t i = from; i < to; i += crypto::blockSize ) {
-            Bytes sub( padded.cbegin() + i, padded.cbegin() + i + crypto::blockSize );
-            std::memcpy( &nonce_counter[crypto::blockSize / 2], &counter, sizeof( counter ) );
-            Bytes xorStream = crypto::encryptAES128ECB( nonce_counter, key );
-            Bytes unscrambled = crypto::XOR( sub, xorStream );
-            std::memcpy( &padded[i], unscrambled.data(), crypto::blockSize );
-            counter++;
+        // inc32: only the last 4 bytes count, big endian
+        for( size_t i = 0; i < length; i += blockSize ) {
+            ++counter;
+            std::memcpy( stream + i, j0, blockSize - 4 );
+
+            for( size_t b = 0; b < 4; ++b ) {
+                stream[i + blockSize - 1 - b] = static_cast<uint8_t>( counter >> ( 8 * b ) );
+            }
         }
-    }
 
-    // replace clear text
-    std::memcpy( &padded[offset], replacement.data(), replacement.size() );
+        aes::encryptAES128ECB( stream, stream, ( length + blockSize - 1 ) / blockSize * blockSize, key );
 
-    // re-encrypt
-    {
-        uint64_t counter = from / crypto::blockSize;
-        std::memcpy( &nonce_counter[0], &nonce, sizeof( nonce ) );
+        if( decrypt ) {
+            ghash::update( state, in.data() + done, length, hashKey );
+        }
 
-        for( size_t i = from; i < to; i += crypto::blockSize ) {
-            Bytes sub( padded.cbegin() + i, padded.cbegin() + i + crypto::blockSize );
-            std::memcpy( &nonce_counter[crypto::blockSize / 2], &counter, sizeof( counter ) );
-            Bytes xorStream = crypto::encryptAES128ECB( nonce_counter, key );
-            Bytes scrambled = crypto::XOR( sub, xorStream );
-            std::memcpy( &padded[i], scrambled.data(), crypto::blockSize );
-            counter++;
+        xorStream( in.data() + done, stream, out + done, length );
+
+        if( !decrypt ) {
+            ghash::update( state, out + done, length, hashKey );
         }
     }
 
-    padded.resize( encrypted.size() );
-    return padded;
+    uint8_t lengths[blockSize];
+    ghash::detail::storeBigEndian( lengths, aad.size() * 8 );
+    ghash::detail::storeBigEndian( lengths + 8, in.size() * 8 );
+    ghash::update( state, lengths, blockSize, hashKey );
+
+    aes::encryptAES128ECB( j0, tag, blockSize, key );
+
+    for( size_t i = 0; i < blockSize; ++i ) {
+        tag[i] ^= state[i];
+    }
 }
 
-Bytes crypto::encryptAES128CTR( const Bytes& text, const Bytes& key, const uint64_t& nonce ) {
-    return helperAES128CTR( text, key, nonce );
 }
 
-Bytes crypto::decryptAES128CTR( const Bytes& text, const Bytes& key, const uint64_t& nonce ) {
-    return helperAES128CTR( text, key, nonce );
+void crypto::encryptAES128GCM( ByteView text, const AesKey128& key, ByteView iv, ByteView aad, uint8_t* out, uint8_t* tag ) {
+    helperAES128GCM( text, key, iv, aad, out, tag, false );
 }
 
-Bytes helperMersenneCTR( const Bytes& text, const uint16_t& key ) {
-    const size_t blockSize = sizeof( uint32_t );
-    Bytes padded = crypto::padPKCS7( text, blockSize );
-    Bytes encrypted;
-    encrypted.reserve( padded.size() );
+bool crypto::decryptAES128GCM( ByteView data, const AesKey128& key, ByteView iv, ByteView aad, ByteView tag, uint8_t* out ) {
+    uint8_t expected[blockSize];
+    helperAES128GCM( data, key, iv, aad, out, expected, true );
 
-    Mersenne mersenne( key );
+    // constant time, the position of the first wrong byte must not leak
+    uint8_t diff = tag.size() != blockSize;
+
+    for( size_t i = 0; i < blockSize && i < tag.size(); ++i ) {
+        diff |= expected[i] ^ tag[i];
+    }
+
+    if( diff ) {
+        std::fill_n( out, data.size(), 0 );
+        return false;
+    }
+
+    return true;
+}
+
+Bytes crypto::encryptAES128GCM( const Bytes& text, const AesKey128& key, const Bytes& iv, const Bytes& aad ) {
+    Bytes encrypted( text.size() + blockSize );
+    encryptAES128GCM( text, key, iv, aad, encrypted.data(), encrypted.data() + text.size() );
+    return encrypted;
+}
+
+Bytes crypto::decryptAES128GCM( const Bytes& data, const AesKey128& key, const Bytes& iv, const Bytes& aad ) {
+    if( data.size() < blockSize ) {
+        throw std::invalid_argument( "GCM: Missing tag" );
+    }
+
+    ByteView view( data );
+    Bytes decrypted( data.size() - blockSize );
+
+    if( !decryptAES128GCM( view.first( decrypted.size() ), key, iv, aad, view.last( blockSize ), decrypted.data() ) ) {
+        throw std::invalid_argument( "GCM: Authentication failed" );
+    }
+
+    return decrypted;
+}
+
+Bytes crypto::CipherStream::update( const Bytes& chunk ) {
+    Bytes out( chunk.size() + crypto::blockSize );
+    out.resize( update( chunk.data(), chunk.size(), out.data() ) );
+    return out;
+}
+
+Bytes crypto::CipherStream::final() {
+    Bytes out( crypto::blockSize );
+    out.resize( final( out.data() ) );
+    return out;
+}
+
+crypto::BlockCipherStream::BlockCipherStream( const AesKey128& key, const bool& decrypt ) :
+    key( key ), decrypt( decrypt ) {
+}
+
+size_t crypto::BlockCipherStream::update( const uint8_t* in, const size_t& length, uint8_t* out ) {
+    size_t total = buffered + length;
+    size_t rest = total % crypto::blockSize;
+
+    // the decryptor holds back the last full block, it carries the padding
+    if( decrypt && rest == 0 && total > 0 ) {
+        rest = crypto::blockSize;
+    }
+
+    if( total == rest ) {
+        std::memcpy( buffer + buffered, in, length );
+        buffered += length;
+        return 0;
+    }
+
+    size_t consumed = 0;
+    size_t written = 0;
+
+    // complete the buffered block first
+    if( buffered ) {
+        consumed = crypto::blockSize - buffered;
+        std::memcpy( buffer + buffered, in, consumed );
+        process( buffer, out, crypto::blockSize );
+        written = crypto::blockSize;
+    }
+
+    size_t bulk = total - rest - written;
+
+    if( bulk ) {
+        process( in + consumed, out + written, bulk );
+        consumed += bulk;
+        written += bulk;
+    }
+
+    buffered = length - consumed;
+    std::memcpy( buffer, in + consumed, buffered );
+
+    return written;
+}
+
+size_t crypto::BlockCipherStream::final( uint8_t* out ) {
+
+    if( !decrypt ) {
+        uint8_t padSize = static_cast<uint8_t>( crypto::blockSize - buffered );
+        std::memset( buffer + buffered, padSize, padSize );
+        process( buffer, out, crypto::blockSize );
+        buffered = 0;
+        return crypto::blockSize;
+    }
+
+    if( buffered == 0 ) {
+        return 0;
+    }
+
+    if( buffered != crypto::blockSize ) {
+        throw std::invalid_argument( "Stream: Incomplete block" );
+    }
+
+    process( buffer, out, crypto::blockSize );
+    buffered = 0;
+
+    return crypto::blockSize - padSizePKCS7( ByteView( out, crypto::blockSize ) );
+}
+
+crypto::ECBEncryptor::ECBEncryptor( const AesKey128& key ) :
+    BlockCipherStream( key, false ) {
+}
+
+void crypto::ECBEncryptor::process( const uint8_t* in, uint8_t* out, const size_t& length ) {
+    aes::encryptAES128ECB( in, out, length, key );
+}
+
+crypto::ECBDecryptor::ECBDecryptor( const AesKey128& key ) :
+    BlockCipherStream( key, true ) {
+}
+
+void crypto::ECBDecryptor::process( const uint8_t* in, uint8_t* out, const size_t& length ) {
+    aes::decryptAES128ECB( in, out, length, key );
+}
+
+crypto::CBCEncryptor::CBCEncryptor( const AesKey128& key, const Bytes& iv ) :
+    BlockCipherStream( key, false ) {
+
+    if( iv.size() != crypto::blockSize ) {
+        throw std::invalid_argument( "CBC: Invalid iv size" );
+    }
+
+    std::memcpy( chain, iv.data(), crypto::blockSize );
+}
+
+void crypto::CBCEncryptor::process( const uint8_t* in, uint8_t* out, const size_t& length ) {
+    aes::encryptAES128CBC( in, out, length, key, chain );
+    std::memcpy( chain, out + length - crypto::blockSize, crypto::blockSize );
+}
+
+crypto::CBCDecryptor::CBCDecryptor( const AesKey128& key, const Bytes& iv ) :
+    BlockCipherStream( key, true ) {
+
+    if( iv.size() != crypto::blockSize ) {
+        throw std::invalid_argument( "CBC: Invalid iv size" );
+    }
+
+    std::memcpy( chain, iv.data(), crypto::blockSize );
+}
+
+void crypto::CBCDecryptor::process( const uint8_t* in, uint8_t* out, const size_t& length ) {
+    uint8_t next[crypto::blockSize];
+    std::memcpy( next, in + length - crypto::blockSize, crypto::blockSize );
+    aes::decryptAES128CBC( in, out, length, key, chain );
+    std::memcpy( chain, next, crypto::blockSize );
+}
+
+crypto::CTREncryptor::CTREncryptor( const AesKey128& key, const uint64_t& nonce ) :
+    key( key ), nonce( nonce ) {
+}
 
-    for( size_t i = 0; i < padded.size(); i += blockSize ) {
-        Bytes sub( padded.cbegin() + i, padded.cbegin() + i + blockSize );
-        uint32_t r = mersenne.get();
-        Bytes stream( blockSize );
-        memcpy( stream.data(), &r, blockSize );
-        Bytes scrambled = crypto::XOR( sub, stream );
-        encrypted.insert( encrypted.cend(), scrambled.cbegin(), scrambled.cend() );
+size_t crypto::CTREncryptor::update( const uint8_t* in, const size_t& length, uint8_t* out ) {
+    cryptAt( key, nonce, position, in, out, length );
+    position += length;
+    return length;
+}
+
+size_t crypto::CTREncryptor::final( uint8_t* ) {
+    return 0;
+}
+
+crypto::CTRStream::CTRStream( std::span<uint8_t> encrypted, const AesKey128& key, const uint64_t& nonce ) :
+    encrypted( encrypted ), key( key ), nonce( nonce ) {
+}
+
+bool crypto::CTRStream::seek( const size_t& offset ) {
+
+    if( offset > encrypted.size() ) {
+        LOG( "Error: Cannot seek to " << offset << " > " << encrypted.size() );
+        return false;
+    }
+
+    position = offset;
+    return true;
+}
+
+size_t crypto::CTRStream::tell() const {
+    return position;
+}
+
+size_t crypto::CTRStream::size() const {
+    return encrypted.size();
+}
+
+Bytes crypto::CTRStream::read( const size_t& length ) {
+    Bytes rv = read( position, std::min( length, encrypted.size() - position ) );
+    position += rv.size();
+    return rv;
+}
+
+bool crypto::CTRStream::read( const size_t& offset, const size_t& length, uint8_t* out ) const {
+
+    if( offset > encrypted.size() || length > encrypted.size() - offset ) {
+        LOG( "Error: Range " << offset << " + " << length << " exceeds stream size " << encrypted.size() );
+        return false;
+    }
+
+    cryptAt( key, nonce, offset, encrypted.data() + offset, out, length );
+    return true;
+}
+
+Bytes crypto::CTRStream::read( const size_t& offset, const size_t& length ) const {
+    Bytes rv( length );
+
+    if( !read( offset, length, rv.data() ) ) {
+        return {};
+    }
+
+    return rv;
+}
+
+bool crypto::CTRStream::write( ByteView replacement ) {
+
+    if( !edit( position, replacement ) ) {
+        return false;
+    }
+
+    position += replacement.size();
+    return true;
+}
+
+bool crypto::CTRStream::edit( const size_t& offset, ByteView replacement ) {
+
+    if( offset > encrypted.size() || replacement.size() > encrypted.size() - offset ) {
+        LOG( "Replacement doesn't fit into encrypted stream" );
+        return false;
     }
 
-    encrypted.resize( text.size() );
+    cryptAt( key, nonce, offset, replacement.data(), encrypted.data() + offset, replacement.size() );
+    return true;
+}
 
+void crypto::cryptMersenneCTR( ByteView text, const uint16_t& key, uint8_t* out ) {
+    Mersenne mersenne( key );
+    // one twist worth of keystream per step
+    uint32_t stream[Mersenne::size];
+    const size_t chunk = sizeof( stream );
+
+    for( size_t done = 0; done < text.size(); done += chunk ) {
+        size_t length = std::min( chunk, text.size() - done );
+        mersenne.fill( stream, ( length + sizeof( uint32_t ) - 1 ) / sizeof( uint32_t ) );
+        xorStream( text.data() + done, reinterpret_cast<const uint8_t*>( stream ), out + done, length );
+    }
+}
+
+Bytes helperMersenneCTR( const Bytes& text, const uint16_t& key ) {
+    Bytes encrypted( text.size() );
+    crypto::cryptMersenneCTR( text, key, encrypted.data() );
     return encrypted;
 }
 
@@ -413,27 +918,158 @@ Bytes crypto::decryptMersenneCTR( const Bytes& text, const uint16_t& key ) {
 }
 
 Bytes crypto::macSha1( const Bytes& text, const Bytes& key ) {
-    return hash::sha1( key + text );
+    Bytes mac( hash::Sha1Ctx::digestSize );
+    hash::Sha1Ctx ctx;
+    ctx.update( key );
+    ctx.update( text );
+    ctx.final( mac.data() );
+    return mac;
 }
 
 Bytes crypto::macMd4( const Bytes& text, const Bytes& key ) {
-    return hash::md4( key + text );
+    Bytes mac( hash::Md4Ctx::digestSize );
+    hash::Md4Ctx ctx;
+    ctx.update( key );
+    ctx.update( text );
+    ctx.final( mac.data() );
+    return mac;
+}
+
+namespace {
+
+//! the key prefixed texts of a batch of \p count MACs, one of \p texts or \p keys has a single entry for all
+std::vector<Bytes> macInputs( const std::vector<Bytes>& texts, const std::vector<Bytes>& keys, const size_t count ) {
+    std::vector<Bytes> inputs( count );
+
+    for( size_t i = 0; i < inputs.size(); ++i ) {
+        const Bytes& key = keys[keys.size() == 1 ? 0 : i];
+        const Bytes& text = texts[texts.size() == 1 ? 0 : i];
+        inputs[i].reserve( key.size() + text.size() );
+        inputs[i].insert( inputs[i].end(), key.begin(), key.end() );
+        inputs[i].insert( inputs[i].end(), text.begin(), text.end() );
+    }
+
+    return inputs;
+}
+
+}
+
+std::vector<Bytes> crypto::macSha1( const std::vector<Bytes>& texts, const Bytes& key ) {
+    return hash::sha1Batch( macInputs( texts, { key }, texts.size() ) );
+}
+
+std::vector<Bytes> crypto::macSha1( const Bytes& text, const std::vector<Bytes>& keys ) {
+    return hash::sha1Batch( macInputs( { text }, keys, keys.size() ) );
+}
+
+std::vector<Bytes> crypto::macMd4( const std::vector<Bytes>& texts, const Bytes& key ) {
+    return hash::md4Batch( macInputs( texts, { key }, texts.size() ) );
+}
+
+std::vector<Bytes> crypto::macMd4( const Bytes& text, const std::vector<Bytes>& keys ) {
+    return hash::md4Batch( macInputs( { text }, keys, keys.size() ) );
 }
 
 Bytes crypto::hmacSha1( const Bytes& text, Bytes key ) {
-    size_t sha1BlockSize = 64;
+    return HmacSha1Key( key ).mac( text );
+}
+
+Bytes crypto::hmacSha256( const Bytes& text, const Bytes& key ) {
+    return HmacSha256Key( key ).mac( text );
+}
+
+template<class Ctx>
+crypto::HmacKey<Ctx>::HmacKey( ByteView key ) {
+    const size_t blockSize = Ctx::blockSize;
+    uint8_t block[blockSize] = {};
+
+    // keys longer than a block are hashed, shorter ones padded with zeros
+    if( key.size() > blockSize ) {
+        Ctx ctx;
+        ctx.update( key );
+        ctx.final( block );
+    } else {
+        std::copy( key.begin(), key.end(), block );
+    }
 
-    if( key.size() > sha1BlockSize ) {
-        key = hash::sha1( key );
+    auto padded = [&block]( const uint8_t& pad ) {
+        uint8_t xored[blockSize];
+
+        for( size_t i = 0; i < blockSize; ++i ) {
+            xored[i] = block[i] ^ pad;
+        }
+
+        Ctx ctx;
+        ctx.update( ByteView( xored ) );
+        return ctx.magics();
+    };
+
+    inner = padded( 0x36 );
+    outer = padded( 0x5c );
+}
+
+template<class Ctx>
+void crypto::HmacKey<Ctx>::mac( ByteView text, uint8_t* mac ) const {
+    Ctx ctx( inner, Ctx::blockSize );
+    ctx.update( text );
+    ctx.final( mac );
+
+    ctx.init( outer, Ctx::blockSize );
+    ctx.update( ByteView( mac, macSize ) );
+    ctx.final( mac );
+}
+
+template<class Ctx>
+Bytes crypto::HmacKey<Ctx>::mac( ByteView text ) const {
+    Bytes res( macSize );
+    mac( text, res.data() );
+    return res;
+}
+
+template<class Ctx>
+bool crypto::HmacKey<Ctx>::verify( ByteView text, ByteView mac ) const {
+    uint8_t expected[macSize];
+    this->mac( text, expected );
+
+    if( mac.size() != macSize ) {
+        return false;
     }
 
-    if( key.size() < sha1BlockSize ) {
-        key.resize( sha1BlockSize, 0 );
+    // no early exit, every byte is compared
+    uint8_t difference = 0;
+
+    for( size_t i = 0; i < macSize; ++i ) {
+        difference |= expected[i] ^ mac[i];
     }
 
-    Bytes o_key_pad = crypto::XOR( key, Bytes( sha1BlockSize, 0x5c ) );
-    Bytes i_key_pad = crypto::XOR( key, Bytes( sha1BlockSize, 0x36 ) );
+    return difference == 0;
+}
+
+template<class Ctx>
+crypto::HmacCtx<Ctx>::HmacCtx( const HmacKey<Ctx>& key ) : key( key ) {
+    init();
+}
 
-    Bytes hmac = hash::sha1( o_key_pad + hash::sha1( i_key_pad + text ) );
-    return hmac;
+template<class Ctx>
+void crypto::HmacCtx<Ctx>::update( ByteView data ) {
+    ctx.update( data );
 }
+
+template<class Ctx>
+void crypto::HmacCtx<Ctx>::final( uint8_t* mac ) {
+    ctx.final( mac );
+
+    ctx.init( key.outer, Ctx::blockSize );
+    ctx.update( ByteView( mac, HmacKey<Ctx>::macSize ) );
+    ctx.final( mac );
+}
+
+template<class Ctx>
+void crypto::HmacCtx<Ctx>::init() {
+    ctx.init( key.inner, Ctx::blockSize );
+}
+
+template class crypto::HmacKey<hash::Sha1Ctx>;
+template class crypto::HmacKey<hash::Sha256Ctx>;
+template class crypto::HmacCtx<hash::Sha1Ctx>;
+template class crypto::HmacCtx<hash::Sha256Ctx>;
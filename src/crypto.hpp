@@ -1,15 +1,24 @@
 #pragma once
 
 #include "utils.hpp"
+#include "aesni.hpp"
+#include "hash.hpp"
 
 namespace crypto {
 const size_t blockSize = 16;
 
+//! expanded AES-128 key, create once to avoid key expansion per call
+using AesKey128 = aesni::AesKey128;
+
 std::string XOR( const std::string& data, const std::string& key );
 Bytes XOR( const Bytes& data, const Bytes& key );
 Bytes XOR( const Bytes& data, const uint8_t& key );
 std::vector<Bytes> XOR( const std::vector<Bytes>& data, const Bytes& key );
 
+//! XORs \p data with the repeated \p key into \p out, which holds data.size() bytes and may be \p data itself
+void XOR( ByteView data, ByteView key, uint8_t* out );
+void XOR( ByteView data, const uint8_t& key, uint8_t* out );
+
 Bytes encryptAES128ECB( const Bytes& text, const Bytes& key );
 Bytes decryptAES128ECB( const Bytes& data, const Bytes& key );
 
@@ -22,13 +31,233 @@ Bytes editAES128CTR( const Bytes& encrypted,
                      const Bytes& key, const uint64_t& nonce );
 Bytes decryptAES128CTR( const Bytes& text, const Bytes& key, const uint64_t& nonce );
 
+Bytes encryptAES128ECB( const Bytes& text, const AesKey128& key );
+Bytes decryptAES128ECB( const Bytes& data, const AesKey128& key );
+
+Bytes encryptAES128CBC( const Bytes& text, const AesKey128& key, const Bytes& iv );
+Bytes decryptAES128CBC( const Bytes& data, const AesKey128& key, const Bytes& iv );
+
+//! CBC encrypts independent \p texts with their own \p ivs, interleaved through the AES pipeline
+std::vector<Bytes> encryptAES128CBC( const std::vector<Bytes>& texts, const AesKey128& key, const std::vector<Bytes>& ivs );
+std::vector<Bytes> encryptAES128CBC( const std::vector<Bytes>& texts, const std::vector<AesKey128>& keys, const std::vector<Bytes>& ivs );
+
+Bytes encryptAES128CTR( const Bytes& text, const AesKey128& key, const uint64_t& nonce );
+Bytes editAES128CTR( const Bytes& encrypted,
+                     const size_t& offset, const Bytes& replacement,
+                     const AesKey128& key, const uint64_t& nonce );
+Bytes decryptAES128CTR( const Bytes& text, const AesKey128& key, const uint64_t& nonce );
+
+//! \returns the size of \p size bytes after PKCS#7 padding
+inline size_t paddedSize( const size_t& size ) {
+    return size - size % blockSize + blockSize;
+}
+
+// caller provided buffers, \p out may be the input itself for in-place operation
+
+//! \p out holds paddedSize( text.size() ) bytes
+//! \returns bytes written
+size_t encryptAES128ECB( ByteView text, const AesKey128& key, uint8_t* out );
+size_t encryptAES128CBC( ByteView text, const AesKey128& key, ByteView iv, uint8_t* out );
+
+//! \p out holds data.size() bytes
+//! \returns the unpadded size, throws std::invalid_argument on bad padding
+size_t decryptAES128ECB( ByteView data, const AesKey128& key, uint8_t* out );
+size_t decryptAES128CBC( ByteView data, const AesKey128& key, ByteView iv, uint8_t* out );
+
+//! en- and decrypts \p text into \p out, which holds text.size() bytes
+void cryptAES128CTR( ByteView text, const AesKey128& key, const uint64_t& nonce, uint8_t* out );
+
+//! AES-128-GCM authenticated encryption in one pass, \p iv of any size but 12 bytes is recommended,
+//! \p aad is authenticated but not encrypted
+//! \p out holds text.size() bytes, \p tag 16 bytes, throws std::invalid_argument on an empty \p iv
+void encryptAES128GCM( ByteView text, const AesKey128& key, ByteView iv, ByteView aad, uint8_t* out, uint8_t* tag );
+//! \returns false and zeroes \p out if \p tag doesn't match
+bool decryptAES128GCM( ByteView data, const AesKey128& key, ByteView iv, ByteView aad, ByteView tag, uint8_t* out );
+
+//! \returns the ciphertext followed by the 16 byte tag
+Bytes encryptAES128GCM( const Bytes& text, const AesKey128& key, const Bytes& iv, const Bytes& aad = {} );
+//! \p data is the ciphertext followed by the tag, throws std::invalid_argument if it doesn't authenticate
+Bytes decryptAES128GCM( const Bytes& data, const AesKey128& key, const Bytes& iv, const Bytes& aad = {} );
+
+//! incremental encryption and decryption with constant memory,
+//! feed chunks of any size to update() and finish with final()
+class CipherStream {
+    public:
+        virtual ~CipherStream() = default;
+
+        //! processes \p length bytes of \p in into \p out, which must hold \p length + blockSize bytes
+        //! and must not overlap \p in
+        //! \returns bytes written to \p out
+        virtual size_t update( const uint8_t* in, const size_t& length, uint8_t* out ) = 0;
+        Bytes update( const Bytes& chunk );
+
+        //! writes the remaining bytes to \p out, which must hold blockSize bytes
+        //! \returns bytes written to \p out, throws std::invalid_argument on bad padding
+        virtual size_t final( uint8_t* out ) = 0;
+        Bytes final();
+};
+
+//! buffers partial blocks for ECB and CBC, pads on encryption and unpads on decryption
+class BlockCipherStream : public CipherStream {
+    public:
+        size_t update( const uint8_t* in, const size_t& length, uint8_t* out ) override;
+        size_t final( uint8_t* out ) override;
+        using CipherStream::update;
+        using CipherStream::final;
+
+    protected:
+        BlockCipherStream( const AesKey128& key, const bool& decrypt );
+        //! en- or decrypts \p length bytes, a multiple of blockSize
+        virtual void process( const uint8_t* in, uint8_t* out, const size_t& length ) = 0;
+
+        AesKey128 key;
+
+    private:
+        bool decrypt;
+        size_t buffered = 0;
+        uint8_t buffer[blockSize];
+};
+
+class ECBEncryptor : public BlockCipherStream {
+    public:
+        explicit ECBEncryptor( const AesKey128& key );
+    protected:
+        void process( const uint8_t* in, uint8_t* out, const size_t& length ) override;
+};
+
+class ECBDecryptor : public BlockCipherStream {
+    public:
+        explicit ECBDecryptor( const AesKey128& key );
+    protected:
+        void process( const uint8_t* in, uint8_t* out, const size_t& length ) override;
+};
+
+class CBCEncryptor : public BlockCipherStream {
+    public:
+        CBCEncryptor( const AesKey128& key, const Bytes& iv );
+    protected:
+        void process( const uint8_t* in, uint8_t* out, const size_t& length ) override;
+    private:
+        uint8_t chain[blockSize];
+};
+
+class CBCDecryptor : public BlockCipherStream {
+    public:
+        CBCDecryptor( const AesKey128& key, const Bytes& iv );
+    protected:
+        void process( const uint8_t* in, uint8_t* out, const size_t& length ) override;
+    private:
+        uint8_t chain[blockSize];
+};
+
+//! CTR needs neither buffering nor padding, every update returns as many bytes as it got
+class CTREncryptor : public CipherStream {
+    public:
+        CTREncryptor( const AesKey128& key, const uint64_t& nonce );
+        size_t update( const uint8_t* in, const size_t& length, uint8_t* out ) override;
+        size_t final( uint8_t* out ) override;
+        using CipherStream::update;
+        using CipherStream::final;
+    private:
+        AesKey128 key;
+        uint64_t nonce;
+        uint64_t position = 0;
+};
+using CTRDecryptor = CTREncryptor;
+
+//! random access to a CTR encrypted buffer owned by the caller,
+//! every operation only generates the keystream blocks covering its range
+class CTRStream {
+    public:
+        CTRStream( std::span<uint8_t> encrypted, const AesKey128& key, const uint64_t& nonce );
+
+        //! sets the position of the next read() or write(), \returns false if \p offset is past the end
+        bool seek( const size_t& offset );
+        size_t tell() const;
+        size_t size() const;
+
+        //! decrypts up to \p length bytes from the position and advances it
+        Bytes read( const size_t& length );
+        //! decrypts \p length bytes at \p offset into \p out, the position stays unchanged
+        //! \returns false if the range is out of bounds
+        bool read( const size_t& offset, const size_t& length, uint8_t* out ) const;
+        Bytes read( const size_t& offset, const size_t& length ) const;
+
+        //! replaces the plaintext at the position with \p replacement and advances it
+        bool write( ByteView replacement );
+        //! replaces the plaintext at \p offset with \p replacement, re-encrypting in place
+        //! \returns false if \p replacement doesn't fit
+        bool edit( const size_t& offset, ByteView replacement );
+
+    private:
+        std::span<uint8_t> encrypted;
+        AesKey128 key;
+        uint64_t nonce;
+        size_t position = 0;
+};
+
+//! XORs \p text with the little endian outputs of Mersenne( \p key ) into \p out, which may be \p text itself
+void cryptMersenneCTR( ByteView text, const uint16_t& key, uint8_t* out );
 Bytes encryptMersenneCTR( const Bytes& text, const uint16_t& key );
 Bytes decryptMersenneCTR( const Bytes& text, const uint16_t& key );
 
 Bytes macSha1( const Bytes& text, const Bytes& key );
 Bytes macMd4( const Bytes& text, const Bytes& key );
+//! the MACs of all \p texts under \p key, hashed side by side with hash::sha1Batch()
+std::vector<Bytes> macSha1( const std::vector<Bytes>& texts, const Bytes& key );
+//! the MACs of \p text under each of \p keys
+std::vector<Bytes> macSha1( const Bytes& text, const std::vector<Bytes>& keys );
+std::vector<Bytes> macMd4( const std::vector<Bytes>& texts, const Bytes& key );
+std::vector<Bytes> macMd4( const Bytes& text, const std::vector<Bytes>& keys );
 Bytes hmacSha1( const Bytes& text, Bytes key );
 
+//! an HMAC key for the Merkle-Damgard hash \p Ctx with the states after its inner and outer pad block hashed once,
+//! a MAC costs the blocks of the text and one outer block, without allocations
+template<class Ctx>
+class HmacKey {
+    public:
+        static constexpr size_t macSize = Ctx::digestSize;
+
+        explicit HmacKey( ByteView key );
+
+        //! writes the macSize byte HMAC of \p text to \p mac
+        void mac( ByteView text, uint8_t* mac ) const;
+        Bytes mac( ByteView text ) const;
+
+        //! \returns if \p mac is the HMAC of \p text, in time independent of where they differ
+        bool verify( ByteView text, ByteView mac ) const;
+
+    private:
+        template<class> friend class HmacCtx;
+
+        typename Ctx::Magics inner = {};
+        typename Ctx::Magics outer = {};
+};
+
+//! incremental HMAC under a HmacKey
+template<class Ctx>
+class HmacCtx {
+    public:
+        explicit HmacCtx( const HmacKey<Ctx>& key );
+
+        void update( ByteView data );
+        //! writes the HMAC of all data since construction or init() to \p mac
+        void final( uint8_t* mac );
+        //! starts the next HMAC under the same key
+        void init();
+
+    private:
+        HmacKey<Ctx> key;
+        Ctx ctx;
+};
+
+using HmacSha1Key = HmacKey<hash::Sha1Ctx>;
+using HmacSha1Ctx = HmacCtx<hash::Sha1Ctx>;
+using HmacSha256Key = HmacKey<hash::Sha256Ctx>;
+using HmacSha256Ctx = HmacCtx<hash::Sha256Ctx>;
+
+Bytes hmacSha256( const Bytes& text, const Bytes& key );
+
 //! pad \p input in PKCS#7 to \p size bytes
 template <class Container>
 Container padPKCS7( const Container& input, const size_t blockSize = crypto::blockSize );
@@ -49,6 +278,26 @@ struct Encrypted {
 };
 Bytes encryptECBWithSecretSuffix( const Bytes& data );
 Bytes encryptECBWithRandomPrefixAndSecretSuffix( const Bytes& data );
+
+//! chosen plaintext ECB oracle, encrypts prefix + data + suffix under a fixed key,
+//! prefix, suffix and key schedule are prepared once
+class ECBOracle {
+    public:
+        ECBOracle( const Bytes& key, const Bytes& prefix, const Bytes& suffix );
+
+        Bytes encrypt( const Bytes& data ) const;
+        //! encrypts all \p data with a single pass through the AES pipeline
+        std::vector<Bytes> encrypt( const std::vector<Bytes>& data ) const;
+
+    private:
+        AesKey128 key;
+        Bytes prefix;
+        Bytes suffix;
+};
+
+//! the oracles behind encryptECBWithSecretSuffix() and encryptECBWithRandomPrefixAndSecretSuffix()
+const ECBOracle& secretSuffixOracle();
+const ECBOracle& randomPrefixAndSecretSuffixOracle();
 Encrypted encryptECBOrCBC( const Bytes& data );
 std::ostream& operator<<( std::ostream& os, const Encrypted::Type& type );
 
@@ -3,6 +3,7 @@
 #include "set3.hpp"
 #include "set4.hpp"
 #include "set5.hpp"
+#include "benchmark.hpp"
 #include "stopwatch.hpp"
 
 #include <vector>
@@ -59,21 +60,39 @@ int main( int argc, char* argv[] ) {
         { "5.33", challenge5_33 },
     };
 
+    // only run, when named explicitly
+    const std::vector<std::pair<std::string, std::function<void()>>> benchmarks = {
+        { "bench.aes", benchmarkAES },
+        { "bench.mersenne", benchmarkMersenne },
+        { "bench.hash", benchmarkHash },
+    };
+
     StopWatch sw;
 
     // run one challenge
     if( argc > 1 ) {
 
         for( int arg = 1; arg < argc; ++arg ) {
-            auto it = std::find_if( challenges.cbegin(), challenges.cend(), [argv, arg]( const auto & pair ) {
+            auto byName = [argv, arg]( const auto & pair ) {
                 return pair.first == std::string( argv[arg] );
-            } );
+            };
+            auto it = std::find_if( challenges.cbegin(), challenges.cend(), byName );
 
             if( it != challenges.cend() ) {
                 sw.start();
                 it->second();
                 auto ns = sw.stop();
                 LOG( "Running challenge " << it->first << " : " << ns / 1000000 << " ms" );
+                continue;
+            }
+
+            it = std::find_if( benchmarks.cbegin(), benchmarks.cend(), byName );
+
+            if( it != benchmarks.cend() ) {
+                sw.start();
+                it->second();
+                auto ns = sw.stop();
+                LOG( "Running benchmark " << it->first << " : " << ns / 1000000 << " ms" );
 
             } else {
                 LOG( argv[arg] << " not found" );
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+//! polynomials over GF(2), bit i of the words is the coefficient of x^i
+namespace gf2 {
+
+using Polynomial = std::vector<uint64_t>;
+
+inline bool coefficient( const Polynomial& a, const size_t& i ) {
+    return i / 64 < a.size() && ( ( a[i / 64] >> ( i % 64 ) ) & 1 );
+}
+
+//! \returns the degree, -1 for the zero polynomial
+inline int64_t degree( const Polynomial& a ) {
+    for( size_t w = a.size(); w-- > 0; ) {
+        if( a[w] ) {
+            return static_cast<int64_t>( w * 64 + 63 - std::countl_zero( a[w] ) );
+        }
+    }
+
+    return -1;
+}
+
+//! \returns x^\p n
+inline Polynomial monomial( const size_t& n ) {
+    Polynomial a( n / 64 + 1 );
+    a[n / 64] = 1ull << ( n % 64 );
+    return a;
+}
+
+//! adds \p b * x^\p shift to \p a
+inline void addShifted( Polynomial& a, const Polynomial& b, const size_t& shift ) {
+    const size_t words = shift / 64;
+    const size_t bits = shift % 64;
+    a.resize( std::max( a.size(), b.size() + words + 1 ) );
+
+    for( size_t i = 0; i < b.size(); ++i ) {
+        a[i + words] ^= b[i] << bits;
+
+        if( bits ) {
+            a[i + words + 1] ^= b[i] >> ( 64 - bits );
+        }
+    }
+}
+
+//! \returns \p a * \p b, one shifted \p a per term of \p b
+inline Polynomial multiply( const Polynomial& a, const Polynomial& b ) {
+    Polynomial product( a.size() + b.size() + 1 );
+
+    for( size_t w = 0; w < b.size(); ++w ) {
+        for( uint64_t bits = b[w]; bits; bits &= bits - 1 ) {
+            addShifted( product, a, w * 64 + std::countr_zero( bits ) );
+        }
+    }
+
+    return product;
+}
+
+//! \returns \p a^2, squaring only spreads the coefficients to the even powers
+inline Polynomial square( const Polynomial& a ) {
+    auto spread = []( uint64_t x ) {
+        x = ( x | ( x << 16 ) ) & 0x0000ffff0000ffffull;
+        x = ( x | ( x << 8 ) ) & 0x00ff00ff00ff00ffull;
+        x = ( x | ( x << 4 ) ) & 0x0f0f0f0f0f0f0f0full;
+        x = ( x | ( x << 2 ) ) & 0x3333333333333333ull;
+        return ( x | ( x << 1 ) ) & 0x5555555555555555ull;
+    };
+
+    Polynomial squared( 2 * a.size() );
+
+    for( size_t i = 0; i < a.size(); ++i ) {
+        squared[2 * i] = spread( a[i] & 0xffffffff );
+        squared[2 * i + 1] = spread( a[i] >> 32 );
+    }
+
+    return squared;
+}
+
+//! arithmetic modulo a polynomial, its multiples with x^0 .. x^63 are precomputed for the reduction
+class Modulus {
+    public:
+        explicit Modulus( const Polynomial& m ) : d( static_cast<size_t>( std::max<int64_t>( gf2::degree( m ), 0 ) ) ) {
+            for( size_t s = 0; s < shifted.size(); ++s ) {
+                shifted[s].clear();
+                addShifted( shifted[s], m, s );
+                shifted[s].resize( ( d + s ) / 64 + 1 );
+            }
+        }
+
+        size_t degree() const {
+            return d;
+        }
+
+        //! \returns \p a mod m
+        Polynomial reduce( Polynomial a ) const {
+            for( size_t w = a.size(); w-- > d / 64; ) {
+                while( a[w] ) {
+                    size_t i = w * 64 + 63 - std::countl_zero( a[w] );
+
+                    if( i < d ) {
+                        break;
+                    }
+
+                    // cancels x^i and changes only lower coefficients
+                    const Polynomial& multiple = shifted[( i - d ) % 64];
+                    size_t offset = ( i - d ) / 64;
+
+                    for( size_t k = 0; k < multiple.size() && offset + k < a.size(); ++k ) {
+                        a[offset + k] ^= multiple[k];
+                    }
+                }
+            }
+
+            a.resize( d / 64 + 1 );
+            return a;
+        }
+
+        Polynomial multiply( const Polynomial& a, const Polynomial& b ) const {
+            return reduce( gf2::multiply( a, b ) );
+        }
+
+        Polynomial square( const Polynomial& a ) const {
+            return reduce( gf2::square( a ) );
+        }
+
+        //! \returns \p base^\p exponent mod m, by squaring from the highest bit of \p exponent
+        Polynomial power( const Polynomial& base, const uint64_t& exponent ) const {
+            Polynomial result = reduce( monomial( 0 ) );
+
+            for( int bit = 63 - std::countl_zero( exponent ); bit >= 0; --bit ) {
+                result = square( result );
+
+                if( ( exponent >> bit ) & 1 ) {
+                    result = multiply( result, base );
+                }
+            }
+
+            return result;
+        }
+
+    private:
+        size_t d = 0;
+        std::array<Polynomial, 64> shifted;
+};
+
+//! \returns the minimal polynomial x^L + c_1 x^(L-1) + ... + c_L of the first \p length bits of \p sequence,
+//! the shortest recurrence s_i = c_1 s_(i-1) + ... + c_L s_(i-L), with the Berlekamp-Massey algorithm,
+//! \p length should be at least twice the expected degree
+inline Polynomial minimalPolynomial( const Polynomial& sequence, const size_t& length ) {
+    // reversed, so the discrepancy is the parity of the connection polynomial and the bits from length - 1 - i on
+    Polynomial reversed( length / 64 + 2 );
+
+    for( size_t t = 0; t < length; ++t ) {
+        if( coefficient( sequence, length - 1 - t ) ) {
+            reversed[t / 64] |= 1ull << ( t % 64 );
+        }
+    }
+
+    auto bitsAt = [&reversed]( const size_t& position ) {
+        size_t w = position / 64;
+        size_t s = position % 64;
+        uint64_t low = w < reversed.size() ? reversed[w] >> s : 0;
+        uint64_t high = s && w + 1 < reversed.size() ? reversed[w + 1] << ( 64 - s ) : 0;
+        return low | high;
+    };
+
+    Polynomial c = monomial( 0 );
+    Polynomial b = monomial( 0 );
+    size_t l = 0;
+    size_t m = 1;
+
+    for( size_t i = 0; i < length; ++i ) {
+        uint64_t discrepancy = 0;
+
+        for( size_t w = 0; w <= l / 64 && w < c.size(); ++w ) {
+            discrepancy ^= c[w] & bitsAt( length - 1 - i + 64 * w );
+        }
+
+        if( std::popcount( discrepancy ) % 2 == 0 ) {
+            ++m;
+        } else if( 2 * l <= i ) {
+            Polynomial previous = c;
+            addShifted( c, b, m );
+            l = i + 1 - l;
+            b = previous;
+            m = 1;
+        } else {
+            addShifted( c, b, m );
+            ++m;
+        }
+    }
+
+    // the connection polynomial 1 + c_1 x + ... + c_L x^L reversed
+    Polynomial minimal( l / 64 + 1 );
+
+    for( size_t k = 0; k <= l; ++k ) {
+        if( coefficient( c, l - k ) ) {
+            minimal[k / 64] |= 1ull << ( k % 64 );
+        }
+    }
+
+    return minimal;
+}
+
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <immintrin.h>
+
+#include "cpu.hpp"
+
+//! GHASH, the universal hash of GCM: multiplication by H in GF(2^128)
+//! with carry-less multiplication where available, else a constant time bitwise fallback
+namespace ghash {
+
+const size_t blockSize = 16;
+//! blocks per reduction with PCLMULQDQ
+const size_t aggregated = 8;
+
+namespace detail {
+
+inline uint64_t loadBigEndian( const uint8_t* p ) {
+    uint64_t v = 0;
+
+    for( size_t i = 0; i < 8; ++i ) {
+        v = ( v << 8 ) | p[i];
+    }
+
+    return v;
+}
+
+inline void storeBigEndian( uint8_t* p, uint64_t v ) {
+    for( size_t i = 8; i-- > 0; v >>= 8 ) {
+        p[i] = static_cast<uint8_t>( v );
+    }
+}
+
+//! GHASH reverses the bits, byte reversal is done by the shuffle and the bits by the shift in reduce()
+CPU_TARGET( "ssse3" )
+inline __m128i reflect( const __m128i& x ) {
+    return _mm_shuffle_epi8( x, _mm_set_epi8( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ) );
+}
+
+//! adds the 256 bit product of \p a and \p b to \p lo, \p mid and \p hi
+CPU_TARGET( "pclmul" )
+inline void multiplyAdd( const __m128i& a, const __m128i& b, __m128i& lo, __m128i& mid, __m128i& hi ) {
+    lo = _mm_xor_si128( lo, _mm_clmulepi64_si128( a, b, 0x00 ) );
+    hi = _mm_xor_si128( hi, _mm_clmulepi64_si128( a, b, 0x11 ) );
+    mid = _mm_xor_si128( mid, _mm_clmulepi64_si128( a, b, 0x10 ) );
+    mid = _mm_xor_si128( mid, _mm_clmulepi64_si128( a, b, 0x01 ) );
+}
+
+//! reduces the sum of products modulo x^128 + x^7 + x^2 + x + 1,
+//! Intel's carry-less multiplication white paper, algorithm 5
+CPU_TARGET( "pclmul" )
+inline __m128i reduce( __m128i lo, __m128i mid, __m128i hi ) {
+    lo = _mm_xor_si128( lo, _mm_slli_si128( mid, 8 ) );
+    hi = _mm_xor_si128( hi, _mm_srli_si128( mid, 8 ) );
+
+    // shift the 256 bit product left by one for the reflected bit order
+    __m128i carryLo = _mm_srli_epi32( lo, 31 );
+    __m128i carryHi = _mm_srli_epi32( hi, 31 );
+    lo = _mm_slli_epi32( lo, 1 );
+    hi = _mm_slli_epi32( hi, 1 );
+    __m128i across = _mm_srli_si128( carryLo, 12 );
+    carryHi = _mm_slli_si128( carryHi, 4 );
+    carryLo = _mm_slli_si128( carryLo, 4 );
+    lo = _mm_or_si128( lo, carryLo );
+    hi = _mm_or_si128( hi, carryHi );
+    hi = _mm_or_si128( hi, across );
+
+    __m128i a = _mm_xor_si128( _mm_xor_si128( _mm_slli_epi32( lo, 31 ), _mm_slli_epi32( lo, 30 ) ), _mm_slli_epi32( lo, 25 ) );
+    __m128i b = _mm_srli_si128( a, 4 );
+    lo = _mm_xor_si128( lo, _mm_slli_si128( a, 12 ) );
+
+    __m128i c = _mm_xor_si128( _mm_xor_si128( _mm_srli_epi32( lo, 1 ), _mm_srli_epi32( lo, 2 ) ), _mm_srli_epi32( lo, 7 ) );
+    c = _mm_xor_si128( c, b );
+    lo = _mm_xor_si128( lo, c );
+    return _mm_xor_si128( hi, lo );
+}
+
+CPU_TARGET( "pclmul" )
+inline __m128i multiply( const __m128i& a, const __m128i& b ) {
+    __m128i lo = _mm_setzero_si128();
+    __m128i mid = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    multiplyAdd( a, b, lo, mid, hi );
+    return reduce( lo, mid, hi );
+}
+
+}
+
+//! hash key H = E( K, 0 ) with the powers H^1 .. H^8 for the aggregated reduction
+struct Key {
+    Key() = default;
+    explicit Key( const uint8_t* h ) {
+        hi = detail::loadBigEndian( h );
+        lo = detail::loadBigEndian( h + 8 );
+
+        if( cpu::features().pclmul && cpu::features().ssse3 ) {
+            computePowers( h );
+        }
+    }
+
+    //! reflected H^( i + 1 ), only with PCLMULQDQ
+    alignas( 16 ) __m128i powers[aggregated];
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    private:
+        CPU_TARGET( "pclmul,ssse3" )
+        void computePowers( const uint8_t* h ) {
+            powers[0] = detail::reflect( _mm_loadu_si128( reinterpret_cast<const __m128i*>( h ) ) );
+
+            for( size_t i = 1; i < aggregated; ++i ) {
+                powers[i] = detail::multiply( powers[i - 1], powers[0] );
+            }
+        }
+};
+
+//! absorbs \p length bytes of \p data into the 16 byte hash \p state, a partial last block is zero padded
+//! bitwise multiplication with masks instead of branches or tables, about 100 times slower than updateClmul()
+inline void updateSoftware( uint8_t* state, const uint8_t* data, const size_t length, const Key& key ) {
+    uint64_t yh = detail::loadBigEndian( state );
+    uint64_t yl = detail::loadBigEndian( state + 8 );
+
+    for( size_t i = 0; i < length; i += blockSize ) {
+        uint8_t block[blockSize] = {};
+        std::memcpy( block, data + i, std::min( blockSize, length - i ) );
+        uint64_t xh = yh ^ detail::loadBigEndian( block );
+        uint64_t xl = yl ^ detail::loadBigEndian( block + 8 );
+        uint64_t vh = key.hi;
+        uint64_t vl = key.lo;
+        yh = yl = 0;
+
+        for( size_t bit = 0; bit < 128; ++bit ) {
+            uint64_t x = bit < 64 ? xh >> ( 63 - bit ) : xl >> ( 127 - bit );
+            uint64_t mask = 0 - ( x & 1 );
+            yh ^= vh & mask;
+            yl ^= vl & mask;
+            uint64_t reduce = 0 - ( vl & 1 );
+            vl = ( vl >> 1 ) | ( vh << 63 );
+            vh = ( vh >> 1 ) ^ ( 0xe100000000000000ull & reduce );
+        }
+    }
+
+    detail::storeBigEndian( state, yh );
+    detail::storeBigEndian( state + 8, yl );
+}
+
+//! same as updateSoftware(), one reduction per 8 blocks: Y = ( Y + X1 ) H^8 + X2 H^7 + ... + X8 H
+CPU_TARGET( "pclmul,ssse3" )
+inline void updateClmul( uint8_t* state, const uint8_t* data, const size_t length, const Key& key ) {
+    __m128i y = detail::reflect( _mm_loadu_si128( reinterpret_cast<const __m128i*>( state ) ) );
+    size_t blocks = length / blockSize;
+    size_t i = 0;
+
+    for( ; i + aggregated <= blocks; i += aggregated ) {
+        __m128i lo = _mm_setzero_si128();
+        __m128i mid = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+
+        for( size_t j = 0; j < aggregated; ++j ) {
+            __m128i x = detail::reflect( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + ( i + j ) * blockSize ) ) );
+
+            if( j == 0 ) {
+                x = _mm_xor_si128( x, y );
+            }
+
+            detail::multiplyAdd( x, key.powers[aggregated - 1 - j], lo, mid, hi );
+        }
+
+        y = detail::reduce( lo, mid, hi );
+    }
+
+    for( ; i < blocks; ++i ) {
+        __m128i x = detail::reflect( _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + i * blockSize ) ) );
+        y = detail::multiply( _mm_xor_si128( x, y ), key.powers[0] );
+    }
+
+    if( size_t rest = length % blockSize ) {
+        alignas( 16 ) uint8_t block[blockSize] = {};
+        std::memcpy( block, data + blocks * blockSize, rest );
+        __m128i x = detail::reflect( _mm_load_si128( reinterpret_cast<const __m128i*>( block ) ) );
+        y = detail::multiply( _mm_xor_si128( x, y ), key.powers[0] );
+    }
+
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( state ), detail::reflect( y ) );
+}
+
+inline void update( uint8_t* state, const uint8_t* data, const size_t length, const Key& key ) {
+    if( cpu::features().pclmul && cpu::features().ssse3 ) {
+        updateClmul( state, data, length, key );
+    } else {
+        updateSoftware( state, data, length, key );
+    }
+}
+
+}
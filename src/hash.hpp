@@ -1,9 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <vector>
 #include <array>
+#include <span>
+#include <utility>
+
+#include <immintrin.h>
+
+#include "cpu.hpp"
 
 namespace hash {
 
@@ -98,69 +105,277 @@ const Magic<5> SHA1_MAGICS = { 0x67452301,
                                0xC3D2E1F0
                              };
 
+//! processes \p blocks 64 byte blocks of \p data into \p magics, all 80 rounds unrolled
+//! with the message schedule in a ring of 16 words
 //! \sa https://en.wikipedia.org/wiki/SHA-1#SHA-1_pseudocode
-template<class Container = std::vector<uint8_t>>
-Container sha1( const Container& in, Magic<5> magics = SHA1_MAGICS, size_t offset = 0 ) {
-    static_assert( sizeof( typename Container::value_type ) == 1, "Container type must be 8 bit" );
+inline void sha1BlocksScalar( Magic<5>& magics, const uint8_t* data, const size_t& blocks ) {
+    auto F1 = []( const uint32_t& b, const uint32_t& c, const uint32_t& d ) { return d ^ ( b & ( c ^ d ) ); };
+    auto F2 = []( const uint32_t& b, const uint32_t& c, const uint32_t& d ) { return b ^ c ^ d; };
+    auto F3 = []( const uint32_t& b, const uint32_t& c, const uint32_t& d ) { return ( b & c ) | ( d & ( b | c ) ); };
 
-    size_t bytes = in.size();
-    Container work = in + sha1MDPadding<Container, true>( bytes );
-    size_t size = work.size();
+    for( size_t n = 0; n < blocks; ++n, data += 64 ) {
+        // big endian words
+        uint32_t w[16];
+        memcpy( w, data, 64 );
 
-    std::vector<uint32_t> w( 80 );
-
-    for( size_t pos = offset; pos < size; pos += 64 ) {
-        // copy work into first 16 words as big endian
-        memcpy( w.data(), &work[pos], 64 );
-
-        // and convert to little endian
         for( size_t i = 0; i < 16; ++i ) {
             w[i] = endian_reverse( w[i] );
         }
 
-        for( size_t i = 16; i < 80; ++i ) {
-            w[i] = rotL<1>( w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16] );
+        uint32_t A = magics[0];
+        uint32_t B = magics[1];
+        uint32_t C = magics[2];
+        uint32_t D = magics[3];
+        uint32_t E = magics[4];
+
+        // w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16] in place of w[i - 16] from round 16 on
+#define W(i) ( i < 16 ? w[i & 15] : ( w[i & 15] = rotL<1>( w[( i + 13 ) & 15] ^ w[( i + 8 ) & 15] ^ w[( i + 2 ) & 15] ^ w[i & 15] ) ) )
+
+        // instead of shifting the variables, their roles rotate by one each round
+        // rounds 0 to 19
+#define OP(a,b,c,d,e,i) e += rotL<5>( a ) + F1( b, c, d ) + 0x5A827999 + W( i ); b = rotL<30>( b )
+        OP( A, B, C, D, E,  0 ); OP( E, A, B, C, D,  1 ); OP( D, E, A, B, C,  2 ); OP( C, D, E, A, B,  3 ); OP( B, C, D, E, A,  4 );
+        OP( A, B, C, D, E,  5 ); OP( E, A, B, C, D,  6 ); OP( D, E, A, B, C,  7 ); OP( C, D, E, A, B,  8 ); OP( B, C, D, E, A,  9 );
+        OP( A, B, C, D, E, 10 ); OP( E, A, B, C, D, 11 ); OP( D, E, A, B, C, 12 ); OP( C, D, E, A, B, 13 ); OP( B, C, D, E, A, 14 );
+        OP( A, B, C, D, E, 15 ); OP( E, A, B, C, D, 16 ); OP( D, E, A, B, C, 17 ); OP( C, D, E, A, B, 18 ); OP( B, C, D, E, A, 19 );
+#undef OP
+
+        // rounds 20 to 39
+#define OP(a,b,c,d,e,i) e += rotL<5>( a ) + F2( b, c, d ) + 0x6ED9EBA1 + W( i ); b = rotL<30>( b )
+        OP( A, B, C, D, E, 20 ); OP( E, A, B, C, D, 21 ); OP( D, E, A, B, C, 22 ); OP( C, D, E, A, B, 23 ); OP( B, C, D, E, A, 24 );
+        OP( A, B, C, D, E, 25 ); OP( E, A, B, C, D, 26 ); OP( D, E, A, B, C, 27 ); OP( C, D, E, A, B, 28 ); OP( B, C, D, E, A, 29 );
+        OP( A, B, C, D, E, 30 ); OP( E, A, B, C, D, 31 ); OP( D, E, A, B, C, 32 ); OP( C, D, E, A, B, 33 ); OP( B, C, D, E, A, 34 );
+        OP( A, B, C, D, E, 35 ); OP( E, A, B, C, D, 36 ); OP( D, E, A, B, C, 37 ); OP( C, D, E, A, B, 38 ); OP( B, C, D, E, A, 39 );
+#undef OP
+
+        // rounds 40 to 59
+#define OP(a,b,c,d,e,i) e += rotL<5>( a ) + F3( b, c, d ) + 0x8F1BBCDC + W( i ); b = rotL<30>( b )
+        OP( A, B, C, D, E, 40 ); OP( E, A, B, C, D, 41 ); OP( D, E, A, B, C, 42 ); OP( C, D, E, A, B, 43 ); OP( B, C, D, E, A, 44 );
+        OP( A, B, C, D, E, 45 ); OP( E, A, B, C, D, 46 ); OP( D, E, A, B, C, 47 ); OP( C, D, E, A, B, 48 ); OP( B, C, D, E, A, 49 );
+        OP( A, B, C, D, E, 50 ); OP( E, A, B, C, D, 51 ); OP( D, E, A, B, C, 52 ); OP( C, D, E, A, B, 53 ); OP( B, C, D, E, A, 54 );
+        OP( A, B, C, D, E, 55 ); OP( E, A, B, C, D, 56 ); OP( D, E, A, B, C, 57 ); OP( C, D, E, A, B, 58 ); OP( B, C, D, E, A, 59 );
+#undef OP
+
+        // rounds 60 to 79
+#define OP(a,b,c,d,e,i) e += rotL<5>( a ) + F2( b, c, d ) + 0xCA62C1D6 + W( i ); b = rotL<30>( b )
+        OP( A, B, C, D, E, 60 ); OP( E, A, B, C, D, 61 ); OP( D, E, A, B, C, 62 ); OP( C, D, E, A, B, 63 ); OP( B, C, D, E, A, 64 );
+        OP( A, B, C, D, E, 65 ); OP( E, A, B, C, D, 66 ); OP( D, E, A, B, C, 67 ); OP( C, D, E, A, B, 68 ); OP( B, C, D, E, A, 69 );
+        OP( A, B, C, D, E, 70 ); OP( E, A, B, C, D, 71 ); OP( D, E, A, B, C, 72 ); OP( C, D, E, A, B, 73 ); OP( B, C, D, E, A, 74 );
+        OP( A, B, C, D, E, 75 ); OP( E, A, B, C, D, 76 ); OP( D, E, A, B, C, 77 ); OP( C, D, E, A, B, 78 ); OP( B, C, D, E, A, 79 );
+#undef OP
+#undef W
+
+        magics[0] += A;
+        magics[1] += B;
+        magics[2] += C;
+        magics[3] += D;
+        magics[4] += E;
+    }
+}
+
+namespace detail {
+
+//! rounds 4 i to 4 i + 3 with sha1rnds4, \p e[i % 2] gets the E of the quad from the a of four rounds before,
+//! and the schedule of the later quads, \p w[q % 4] is built from quad q - 4 by sha1msg1, the XOR and sha1msg2
+template<size_t i>
+CPU_TARGET( "sha,sse4.1" )
+inline void sha1QuadShaNi( __m128i& abcd, __m128i e[2], __m128i w[4], const uint8_t* block ) {
+    if constexpr( i < 4 ) {
+        const __m128i bigEndian = _mm_set_epi64x( 0x0001020304050607ll, 0x08090a0b0c0d0e0fll );
+        w[i] = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>( block + 16 * i ) ), bigEndian );
+    }
+
+    if constexpr( i == 0 ) {
+        e[0] = _mm_add_epi32( e[0], w[0] );
+    } else {
+        e[i % 2] = _mm_sha1nexte_epu32( e[i % 2], w[i % 4] );
+    }
+
+    e[( i + 1 ) % 2] = abcd;
+
+    if constexpr( 3 <= i && i <= 18 ) {
+        w[( i + 1 ) % 4] = _mm_sha1msg2_epu32( w[( i + 1 ) % 4], w[i % 4] );
+    }
+
+    abcd = _mm_sha1rnds4_epu32( abcd, e[i % 2], i / 5 );
+
+    if constexpr( 1 <= i && i <= 16 ) {
+        w[( i + 3 ) % 4] = _mm_sha1msg1_epu32( w[( i + 3 ) % 4], w[i % 4] );
+    }
+
+    if constexpr( 2 <= i && i <= 17 ) {
+        w[( i + 2 ) % 4] = _mm_xor_si128( w[( i + 2 ) % 4], w[i % 4] );
+    }
+}
+
+template<size_t... i>
+CPU_TARGET( "sha,sse4.1" )
+inline void sha1QuadsShaNi( __m128i& abcd, __m128i e[2], __m128i w[4], const uint8_t* block, std::index_sequence<i...> ) {
+    ( sha1QuadShaNi<i>( abcd, e, w, block ), ... );
+}
+
+}
+
+//! sha1BlocksScalar() with the SHA extensions, the state stays in registers across \p blocks,
+//! only call if cpu::features() has sha and sse41
+//! \sa https://www.intel.com/content/www/us/en/developer/articles/technical/intel-sha-extensions.html
+CPU_TARGET( "sha,sse4.1" )
+inline void sha1BlocksShaNi( Magic<5>& magics, const uint8_t* data, const size_t& blocks ) {
+    // a in the highest lane, e in the highest lane of its own register
+    __m128i abcd = _mm_shuffle_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>( magics.data() ) ), 0x1b );
+    __m128i e[2] = { _mm_set_epi32( static_cast<int>( magics[4] ), 0, 0, 0 ), _mm_setzero_si128() };
+    __m128i w[4];
+
+    for( size_t n = 0; n < blocks; ++n, data += 64 ) {
+        const __m128i abcdSaved = abcd;
+        const __m128i eSaved = e[0];
+
+        detail::sha1QuadsShaNi( abcd, e, w, data, std::make_index_sequence<20>() );
+
+        e[0] = _mm_sha1nexte_epu32( e[0], eSaved );
+        abcd = _mm_add_epi32( abcd, abcdSaved );
+    }
+
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( magics.data() ), _mm_shuffle_epi32( abcd, 0x1b ) );
+    magics[4] = static_cast<uint32_t>( _mm_extract_epi32( e[0], 3 ) );
+}
+
+//! processes \p blocks 64 byte blocks of \p data into \p magics, with the SHA extensions where available
+inline void sha1Blocks( Magic<5>& magics, const uint8_t* data, const size_t& blocks ) {
+    static const bool shaNi = cpu::features().sha && cpu::features().sse41;
+
+    if( shaNi ) {
+        sha1BlocksShaNi( magics, data, blocks );
+    } else {
+        sha1BlocksScalar( magics, data, blocks );
+    }
+}
+
+//! processes one 64 byte \p block into \p magics
+inline void sha1Block( Magic<5>& magics, const uint8_t* block ) {
+    sha1Blocks( magics, block, 1 );
+}
+
+//! incremental Merkle-Damgard hash over 64 byte blocks, whole blocks go from the input straight to \p compress,
+//! only a partial block is kept in the buffer and only the last one or two blocks get padded,
+//! \p compress takes a run of whole blocks at once
+template<size_t T, bool reverse, void( *compress )( Magic<T>&, const uint8_t*, const size_t& )>
+class MDCtx {
+    public:
+        static constexpr size_t blockSize = 64;
+        static constexpr size_t digestSize = 4 * T;
+        //! the digest is the state as big endian words
+        static constexpr bool bigEndian = reverse;
+        using Magics = Magic<T>;
+
+        //! starts from \p magics with \p offset bytes hashed already, a multiple of the block size, e.g. to extend a hash
+        void init( const Magic<T>& magics, const uint64_t& offset = 0 ) {
+            state = magics;
+            length = offset;
+            buffered = 0;
+        }
+
+        void update( std::span<const uint8_t> data ) {
+            const uint8_t* in = data.data();
+            size_t size = data.size();
+            length += size;
+
+            if( buffered ) {
+                size_t n = std::min( blockSize - buffered, size );
+                memcpy( buffer + buffered, in, n );
+                buffered += n;
+                in += n;
+                size -= n;
+
+                if( buffered < blockSize ) {
+                    return;
+                }
+
+                compress( state, buffer, 1 );
+                buffered = 0;
+            }
+
+            if( size >= blockSize ) {
+                size_t blocks = size / blockSize;
+                compress( state, in, blocks );
+                in += blocks * blockSize;
+                size -= blocks * blockSize;
+            }
+
+            memcpy( buffer, in, size );
+            buffered = size;
         }
 
-        uint32_t a = magics[0];
-        uint32_t b = magics[1];
-        uint32_t c = magics[2];
-        uint32_t d = magics[3];
-        uint32_t e = magics[4];
-        uint32_t f = 0;
-        uint32_t k = 0;
-
-        for( unsigned long i = 0; i < 80; ++i ) {
-            if( between( 0ul, i, 19ul ) ) {
-                f = ( b & c ) | ( ( ~ b ) & d );
-                k = 0x5A827999;
-            } else if( between( 20ul, i, 39ul ) ) {
-                f = b ^ c ^ d;
-                k = 0x6ED9EBA1;
-            } else if( between( 40ul, i, 59ul ) ) {
-                f = ( b & c ) | ( b & d ) | ( c & d );
-                k = 0x8F1BBCDC;
-            } else if( between( 60ul, i, 79ul ) ) {
-                f = b ^ c ^ d;
-                k = 0xCA62C1D6;
+        //! pads and writes the digestSize byte digest to \p digest, init() starts the next hash
+        void final( uint8_t* digest ) {
+            uint64_t bits = length * 8;
+
+            if constexpr( reverse ) {
+                bits = endian_reverse( bits );
+            }
+
+            // parity bit, then zeros up to the length in the last 8 bytes
+            buffer[buffered++] = 0x80;
+
+            if( buffered > blockSize - 8 ) {
+                memset( buffer + buffered, 0, blockSize - buffered );
+                compress( state, buffer, 1 );
+                buffered = 0;
             }
 
-            uint32_t temp = rotL<5>( a ) + f + e + k + w[i];
-            e = d;
-            d = c;
-            c = rotL<30>( b );
-            b = a;
-            a = temp;
+            memset( buffer + buffered, 0, blockSize - 8 - buffered );
+            memcpy( buffer + blockSize - 8, &bits, 8 );
+            compress( state, buffer, 1 );
+
+            for( size_t i = 0; i < T; ++i ) {
+                uint32_t word = state[i];
+
+                if constexpr( reverse ) {
+                    word = endian_reverse( word );
+                }
+
+                memcpy( digest + 4 * i, &word, 4 );
+            }
         }
 
-        magics[0] += a;
-        magics[1] += b;
-        magics[2] += c;
-        magics[3] += d;
-        magics[4] += e;
-    }
+        //! the chaining value after the hashed whole blocks
+        const Magic<T>& magics() const {
+            return state;
+        }
+
+    private:
+        Magic<T> state = {};
+        uint64_t length = 0;
+        size_t buffered = 0;
+        uint8_t buffer[blockSize];
+};
+
+class Sha1Ctx : public MDCtx<5, true, sha1Blocks> {
+    public:
+        explicit Sha1Ctx( const Magic<5>& magics = SHA1_MAGICS, const uint64_t& offset = 0 ) {
+            init( magics, offset );
+        }
 
-    Container res = magicsToSha<Container, 5, true>( magics );
+        void init( const Magic<5>& magics = SHA1_MAGICS, const uint64_t& offset = 0 ) {
+            MDCtx::init( magics, offset );
+        }
+};
+
+//! writes the 20 byte SHA-1 of \p in to \p digest, without copying \p in
+//! \p magics and \p offset continue a hash state, e.g. for length extension, the first \p offset bytes of \p in are skipped
+inline void sha1( std::span<const uint8_t> in, uint8_t* digest, Magic<5> magics = SHA1_MAGICS, size_t offset = 0 ) {
+    Sha1Ctx ctx( magics, offset );
+    ctx.update( in.subspan( std::min( offset, in.size() ) ) );
+    ctx.final( digest );
+}
+
+template<class Container = std::vector<uint8_t>>
+Container sha1( const Container& in, Magic<5> magics = SHA1_MAGICS, size_t offset = 0 ) {
+    static_assert( sizeof( typename Container::value_type ) == 1, "Container type must be 8 bit" );
+
+    Container res( 20, 0 );
+    sha1( std::span<const uint8_t>( reinterpret_cast<const uint8_t*>( in.data() ), in.size() ),
+          reinterpret_cast<uint8_t*>( res.data() ), magics, offset );
     return res;
 }
 
@@ -170,15 +385,12 @@ const Magic<4> MD4_MAGICS = { 0x67452301,
                               0x10325476,
                             };
 
+//! processes one 64 byte \p block into \p magics
 //! \sa https://tools.ietf.org/html/rfc1320
-template<class Container = std::vector<uint8_t>>
-Container md4( const Container& in, Magic<4> magics = MD4_MAGICS, size_t offset = 0 ) {
-
-    size_t bytes = in.size();
-    Container work = in + sha1MDPadding<Container, false>( bytes );
-    size_t size = work.size();
-
-    std::vector<uint32_t> X( 80 );
+inline void md4Block( Magic<4>& magics, const uint8_t* block ) {
+    // little endian words
+    uint32_t X[16];
+    memcpy( X, block, 64 );
 
     uint32_t A = magics[0];
     uint32_t B = magics[1];
@@ -189,57 +401,245 @@ Container md4( const Container& in, Magic<4> magics = MD4_MAGICS, size_t offset
     auto G = []( const uint32_t& X, const uint32_t& Y, const uint32_t& Z ) { return ( X & Y ) | ( X & Z ) | ( Y & Z );};
     auto H = []( const uint32_t& X, const uint32_t& Y, const uint32_t& Z ) { return X ^ Y ^ Z; };
 
-    for( size_t pos = offset; pos < size; pos += 64 ) {
-        // copy work into first 16 words as big endian
-        memcpy( X.data(), &work[pos], 64 );
-
-        // and convert to little endian
-        //        for( size_t i = 0; i < 16; ++i ) {
-        //            X[i] = endian_reverse( X[i] );
-        //        }
-
-        uint32_t AA = A;
-        uint32_t BB = B;
-        uint32_t CC = C;
-        uint32_t DD = D;
-
-        // round 1
+    // round 1
 #define OP(a,b,c,d,k,s) a = rotL<s>( a + F( b, c, d ) + X[k] )
-        OP( A, B, C, D,  0,  3 ); OP( D, A, B, C,  1,  7 ); OP( C, D, A, B,  2, 11 ); OP( B, C, D, A,  3, 19 );
-        OP( A, B, C, D,  4,  3 ); OP( D, A, B, C,  5,  7 ); OP( C, D, A, B,  6, 11 ); OP( B, C, D, A,  7, 19 );
-        OP( A, B, C, D,  8,  3 ); OP( D, A, B, C,  9,  7 ); OP( C, D, A, B, 10, 11 ); OP( B, C, D, A, 11, 19 );
-        OP( A, B, C, D, 12,  3 ); OP( D, A, B, C, 13,  7 ); OP( C, D, A, B, 14, 11 ); OP( B, C, D, A, 15, 19 );
+    OP( A, B, C, D,  0,  3 ); OP( D, A, B, C,  1,  7 ); OP( C, D, A, B,  2, 11 ); OP( B, C, D, A,  3, 19 );
+    OP( A, B, C, D,  4,  3 ); OP( D, A, B, C,  5,  7 ); OP( C, D, A, B,  6, 11 ); OP( B, C, D, A,  7, 19 );
+    OP( A, B, C, D,  8,  3 ); OP( D, A, B, C,  9,  7 ); OP( C, D, A, B, 10, 11 ); OP( B, C, D, A, 11, 19 );
+    OP( A, B, C, D, 12,  3 ); OP( D, A, B, C, 13,  7 ); OP( C, D, A, B, 14, 11 ); OP( B, C, D, A, 15, 19 );
 #undef OP
 
-        // round 2
+    // round 2
 #define OP(a,b,c,d,k,s) a = rotL<s>( a + G( b, c, d ) + X[k] + 0x5A827999 )
-        OP( A, B, C, D,  0,  3 ); OP( D, A, B, C,  4,  5 ); OP( C, D, A, B,  8,  9 ); OP( B, C, D, A, 12, 13 );
-        OP( A, B, C, D,  1,  3 ); OP( D, A, B, C,  5,  5 ); OP( C, D, A, B,  9,  9 ); OP( B, C, D, A, 13, 13 );
-        OP( A, B, C, D,  2,  3 ); OP( D, A, B, C,  6,  5 ); OP( C, D, A, B, 10,  9 ); OP( B, C, D, A, 14, 13 );
-        OP( A, B, C, D,  3,  3 ); OP( D, A, B, C,  7,  5 ); OP( C, D, A, B, 11,  9 ); OP( B, C, D, A, 15, 13 );
+    OP( A, B, C, D,  0,  3 ); OP( D, A, B, C,  4,  5 ); OP( C, D, A, B,  8,  9 ); OP( B, C, D, A, 12, 13 );
+    OP( A, B, C, D,  1,  3 ); OP( D, A, B, C,  5,  5 ); OP( C, D, A, B,  9,  9 ); OP( B, C, D, A, 13, 13 );
+    OP( A, B, C, D,  2,  3 ); OP( D, A, B, C,  6,  5 ); OP( C, D, A, B, 10,  9 ); OP( B, C, D, A, 14, 13 );
+    OP( A, B, C, D,  3,  3 ); OP( D, A, B, C,  7,  5 ); OP( C, D, A, B, 11,  9 ); OP( B, C, D, A, 15, 13 );
 #undef OP
 
-        // round 3
+    // round 3
 #define OP(a,b,c,d,k,s) a = rotL<s>( a + H( b, c, d ) + X[k] + 0x6ED9EBA1 )
-        OP( A, B, C, D,  0,  3 ); OP( D, A, B, C,  8,  9 ); OP( C, D, A, B,  4, 11 ); OP( B, C, D, A, 12, 15 );
-        OP( A, B, C, D,  2,  3 ); OP( D, A, B, C, 10,  9 ); OP( C, D, A, B,  6, 11 ); OP( B, C, D, A, 14, 15 );
-        OP( A, B, C, D,  1,  3 ); OP( D, A, B, C,  9,  9 ); OP( C, D, A, B,  5, 11 ); OP( B, C, D, A, 13, 15 );
-        OP( A, B, C, D,  3,  3 ); OP( D, A, B, C, 11,  9 ); OP( C, D, A, B,  7, 11 ); OP( B, C, D, A, 15, 15 );
+    OP( A, B, C, D,  0,  3 ); OP( D, A, B, C,  8,  9 ); OP( C, D, A, B,  4, 11 ); OP( B, C, D, A, 12, 15 );
+    OP( A, B, C, D,  2,  3 ); OP( D, A, B, C, 10,  9 ); OP( C, D, A, B,  6, 11 ); OP( B, C, D, A, 14, 15 );
+    OP( A, B, C, D,  1,  3 ); OP( D, A, B, C,  9,  9 ); OP( C, D, A, B,  5, 11 ); OP( B, C, D, A, 13, 15 );
+    OP( A, B, C, D,  3,  3 ); OP( D, A, B, C, 11,  9 ); OP( C, D, A, B,  7, 11 ); OP( B, C, D, A, 15, 15 );
 #undef OP
 
-        A += AA;
-        B += BB;
-        C += CC;
-        D += DD;
+    magics[0] += A;
+    magics[1] += B;
+    magics[2] += C;
+    magics[3] += D;
+}
+
+inline void md4Blocks( Magic<4>& magics, const uint8_t* data, const size_t& blocks ) {
+    for( size_t n = 0; n < blocks; ++n ) {
+        md4Block( magics, data + 64 * n );
     }
+}
 
-    magics[0] = A;
-    magics[1] = B;
-    magics[2] = C;
-    magics[3] = D;
+class Md4Ctx : public MDCtx<4, false, md4Blocks> {
+    public:
+        explicit Md4Ctx( const Magic<4>& magics = MD4_MAGICS, const uint64_t& offset = 0 ) {
+            init( magics, offset );
+        }
 
-    Container res = magicsToSha<Container, 4, false>( magics );
+        void init( const Magic<4>& magics = MD4_MAGICS, const uint64_t& offset = 0 ) {
+            MDCtx::init( magics, offset );
+        }
+};
+
+//! writes the 16 byte MD4 of \p in to \p digest, \p magics and \p offset as for sha1()
+inline void md4( std::span<const uint8_t> in, uint8_t* digest, Magic<4> magics = MD4_MAGICS, size_t offset = 0 ) {
+    Md4Ctx ctx( magics, offset );
+    ctx.update( in.subspan( std::min( offset, in.size() ) ) );
+    ctx.final( digest );
+}
+
+template<class Container = std::vector<uint8_t>>
+Container md4( const Container& in, Magic<4> magics = MD4_MAGICS, size_t offset = 0 ) {
+    static_assert( sizeof( typename Container::value_type ) == 1, "Container type must be 8 bit" );
+
+    Container res( 16, 0 );
+    md4( std::span<const uint8_t>( reinterpret_cast<const uint8_t*>( in.data() ), in.size() ),
+         reinterpret_cast<uint8_t*>( res.data() ), magics, offset );
     return res;
 }
 
+const Magic<8> SHA256_MAGICS = { 0x6a09e667,
+                                 0xbb67ae85,
+                                 0x3c6ef372,
+                                 0xa54ff53a,
+                                 0x510e527f,
+                                 0x9b05688c,
+                                 0x1f83d9ab,
+                                 0x5be0cd19
+                               };
+
+//! the round constants of SHA-256
+//! \sa https://nvlpubs.nist.gov/nistpubs/FIPS/NIST.FIPS.180-4.pdf
+alignas( 16 ) const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+//! processes \p blocks 64 byte blocks of \p data into \p magics, eight rounds per iteration
+//! with the roles of the variables rotating and the message schedule in a ring of 16 words
+inline void sha256BlocksScalar( Magic<8>& magics, const uint8_t* data, const size_t& blocks ) {
+    auto S0 = []( const uint32_t& a ) { return rotL<30>( a ) ^ rotL<19>( a ) ^ rotL<10>( a ); };
+    auto S1 = []( const uint32_t& e ) { return rotL<26>( e ) ^ rotL<21>( e ) ^ rotL<7>( e ); };
+    auto s0 = []( const uint32_t& w ) { return rotL<25>( w ) ^ rotL<14>( w ) ^ ( w >> 3 ); };
+    auto s1 = []( const uint32_t& w ) { return rotL<15>( w ) ^ rotL<13>( w ) ^ ( w >> 10 ); };
+    auto Ch = []( const uint32_t& e, const uint32_t& f, const uint32_t& g ) { return g ^ ( e & ( f ^ g ) ); };
+    auto Maj = []( const uint32_t& a, const uint32_t& b, const uint32_t& c ) { return ( a & b ) | ( c & ( a | b ) ); };
+
+    for( size_t n = 0; n < blocks; ++n, data += 64 ) {
+        // big endian words
+        uint32_t w[16];
+        memcpy( w, data, 64 );
+
+        for( size_t i = 0; i < 16; ++i ) {
+            w[i] = endian_reverse( w[i] );
+        }
+
+        uint32_t A = magics[0];
+        uint32_t B = magics[1];
+        uint32_t C = magics[2];
+        uint32_t D = magics[3];
+        uint32_t E = magics[4];
+        uint32_t F = magics[5];
+        uint32_t G = magics[6];
+        uint32_t H = magics[7];
+
+        for( size_t i = 0; i < 64; i += 8 ) {
+            // w[i - 16] + s0( w[i - 15] ) + w[i - 7] + s1( w[i - 2] ) in place of w[i - 16] from round 16 on
+#define W(i) ( (i) < 16 ? w[(i) & 15] : ( w[(i) & 15] += s0( w[( (i) + 1 ) & 15] ) + w[( (i) + 9 ) & 15] + s1( w[( (i) + 14 ) & 15] ) ) )
+#define OP(a,b,c,d,e,f,g,h,i) h += S1( e ) + Ch( e, f, g ) + SHA256_K[i] + W( i ); d += h; h += S0( a ) + Maj( a, b, c )
+            OP( A, B, C, D, E, F, G, H, i     ); OP( H, A, B, C, D, E, F, G, i + 1 );
+            OP( G, H, A, B, C, D, E, F, i + 2 ); OP( F, G, H, A, B, C, D, E, i + 3 );
+            OP( E, F, G, H, A, B, C, D, i + 4 ); OP( D, E, F, G, H, A, B, C, i + 5 );
+            OP( C, D, E, F, G, H, A, B, i + 6 ); OP( B, C, D, E, F, G, H, A, i + 7 );
+#undef OP
+#undef W
+        }
+
+        magics[0] += A;
+        magics[1] += B;
+        magics[2] += C;
+        magics[3] += D;
+        magics[4] += E;
+        magics[5] += F;
+        magics[6] += G;
+        magics[7] += H;
+    }
+}
+
+namespace detail {
+
+//! rounds 4 q to 4 q + 3 with two sha256rnds2, and the schedule of the later quads, \p w[q % 4] is built
+//! from quad q - 4 by sha256msg1, the add of the words 7 back and sha256msg2
+template<size_t q>
+CPU_TARGET( "sha,sse4.1" )
+inline void sha256QuadShaNi( __m128i& abef, __m128i& cdgh, __m128i w[4], const uint8_t* block ) {
+    if constexpr( q < 4 ) {
+        const __m128i bigEndian = _mm_set_epi64x( 0x0c0d0e0f08090a0bll, 0x0405060700010203ll );
+        w[q] = _mm_shuffle_epi8( _mm_loadu_si128( reinterpret_cast<const __m128i*>( block + 16 * q ) ), bigEndian );
+    }
+
+    __m128i words = _mm_add_epi32( w[q % 4], _mm_load_si128( reinterpret_cast<const __m128i*>( SHA256_K + 4 * q ) ) );
+    cdgh = _mm_sha256rnds2_epu32( cdgh, abef, words );
+
+    if constexpr( 3 <= q && q <= 14 ) {
+        __m128i next = _mm_add_epi32( w[( q + 1 ) % 4], _mm_alignr_epi8( w[q % 4], w[( q + 3 ) % 4], 4 ) );
+        w[( q + 1 ) % 4] = _mm_sha256msg2_epu32( next, w[q % 4] );
+    }
+
+    abef = _mm_sha256rnds2_epu32( abef, cdgh, _mm_shuffle_epi32( words, 0x0e ) );
+
+    if constexpr( 1 <= q && q <= 12 ) {
+        w[( q + 3 ) % 4] = _mm_sha256msg1_epu32( w[( q + 3 ) % 4], w[q % 4] );
+    }
+}
+
+template<size_t... q>
+CPU_TARGET( "sha,sse4.1" )
+inline void sha256QuadsShaNi( __m128i& abef, __m128i& cdgh, __m128i w[4], const uint8_t* block, std::index_sequence<q...> ) {
+    ( sha256QuadShaNi<q>( abef, cdgh, w, block ), ... );
+}
+
+}
+
+//! sha256BlocksScalar() with the SHA extensions, only call if cpu::features() has sha and sse41
+//! \sa https://www.intel.com/content/www/us/en/developer/articles/technical/intel-sha-extensions.html
+CPU_TARGET( "sha,sse4.1" )
+inline void sha256BlocksShaNi( Magic<8>& magics, const uint8_t* data, const size_t& blocks ) {
+    // sha256rnds2 keeps the state as a, b, e, f and c, d, g, h
+    __m128i dcba = _mm_loadu_si128( reinterpret_cast<const __m128i*>( magics.data() ) );
+    __m128i hgfe = _mm_loadu_si128( reinterpret_cast<const __m128i*>( magics.data() + 4 ) );
+    __m128i cdab = _mm_shuffle_epi32( dcba, 0xb1 );
+    __m128i efgh = _mm_shuffle_epi32( hgfe, 0x1b );
+    __m128i abef = _mm_alignr_epi8( cdab, efgh, 8 );
+    __m128i cdgh = _mm_blend_epi16( efgh, cdab, 0xf0 );
+    __m128i w[4];
+
+    for( size_t n = 0; n < blocks; ++n, data += 64 ) {
+        const __m128i abefSaved = abef;
+        const __m128i cdghSaved = cdgh;
+
+        detail::sha256QuadsShaNi( abef, cdgh, w, data, std::make_index_sequence<16>() );
+
+        abef = _mm_add_epi32( abef, abefSaved );
+        cdgh = _mm_add_epi32( cdgh, cdghSaved );
+    }
+
+    __m128i feba = _mm_shuffle_epi32( abef, 0x1b );
+    __m128i dchg = _mm_shuffle_epi32( cdgh, 0xb1 );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( magics.data() ), _mm_blend_epi16( feba, dchg, 0xf0 ) );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( magics.data() + 4 ), _mm_alignr_epi8( dchg, feba, 8 ) );
+}
+
+//! processes \p blocks 64 byte blocks of \p data into \p magics, with the SHA extensions where available
+inline void sha256Blocks( Magic<8>& magics, const uint8_t* data, const size_t& blocks ) {
+    static const bool shaNi = cpu::features().sha && cpu::features().sse41;
+
+    if( shaNi ) {
+        sha256BlocksShaNi( magics, data, blocks );
+    } else {
+        sha256BlocksScalar( magics, data, blocks );
+    }
+}
+
+//! SHA-256 on the same Merkle-Damgard padding as SHA-1, magics() is the midstate e.g. for length extension
+class Sha256Ctx : public MDCtx<8, true, sha256Blocks> {
+    public:
+        explicit Sha256Ctx( const Magic<8>& magics = SHA256_MAGICS, const uint64_t& offset = 0 ) {
+            init( magics, offset );
+        }
+
+        void init( const Magic<8>& magics = SHA256_MAGICS, const uint64_t& offset = 0 ) {
+            MDCtx::init( magics, offset );
+        }
+};
+
+//! writes the 32 byte SHA-256 of \p in to \p digest, \p magics and \p offset as for sha1()
+inline void sha256( std::span<const uint8_t> in, uint8_t* digest, Magic<8> magics = SHA256_MAGICS, size_t offset = 0 ) {
+    Sha256Ctx ctx( magics, offset );
+    ctx.update( in.subspan( std::min( offset, in.size() ) ) );
+    ctx.final( digest );
+}
+
+template<class Container = std::vector<uint8_t>>
+Container sha256( const Container& in, Magic<8> magics = SHA256_MAGICS, size_t offset = 0 ) {
+    static_assert( sizeof( typename Container::value_type ) == 1, "Container type must be 8 bit" );
+
+    Container res( 32, 0 );
+    sha256( std::span<const uint8_t>( reinterpret_cast<const uint8_t*>( in.data() ), in.size() ),
+            reinterpret_cast<uint8_t*>( res.data() ), magics, offset );
+    return res;
+}
 }
@@ -0,0 +1,507 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <span>
+#include <vector>
+
+#include <immintrin.h>
+
+#include "cpu.hpp"
+#include "hash.hpp"
+
+//! multi-buffer SHA-1 and MD4, one independent message per 32 bit lane,
+//! 8 lanes with AVX2 and 16 with AVX-512, each message hashed to its own length
+namespace hash {
+
+namespace detail {
+
+CPU_TARGET( "avx2" )
+inline __m256i load256( const uint32_t* p ) {
+    return _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) );
+}
+
+CPU_TARGET( "avx2" )
+inline void store256( uint32_t* p, const __m256i& x ) {
+    _mm256_storeu_si256( reinterpret_cast<__m256i*>( p ), x );
+}
+
+template<int n>
+CPU_TARGET( "avx2" )
+inline __m256i rotL256( const __m256i& x ) {
+    return _mm256_or_si256( _mm256_slli_epi32( x, n ), _mm256_srli_epi32( x, 32 - n ) );
+}
+
+CPU_TARGET( "avx2" )
+inline __m256i add256( const __m256i& a, const __m256i& b, const __m256i& c, const __m256i& d ) {
+    return _mm256_add_epi32( _mm256_add_epi32( a, b ), _mm256_add_epi32( c, d ) );
+}
+
+//! the 16 words of the 64 byte blocks at \p blocks of 8 lanes, w[t] holds word t of every lane,
+//! two 8 by 8 transposes, big endian if \p reverse
+template<bool reverse>
+CPU_TARGET( "avx2" )
+inline void load256( __m256i w[16], const uint8_t* const* blocks ) {
+    const __m256i bigEndian = _mm256_set_epi8( 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                               12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3 );
+
+    for( size_t half = 0; half < 2; ++half ) {
+        __m256i r[8];
+
+        for( size_t lane = 0; lane < 8; ++lane ) {
+            r[lane] = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( blocks[lane] + 32 * half ) );
+        }
+
+        // pairs of lanes, then quads, in both 128 bit halves
+        __m256i t[8];
+
+        for( size_t i = 0; i < 4; ++i ) {
+            t[2 * i] = _mm256_unpacklo_epi32( r[2 * i], r[2 * i + 1] );
+            t[2 * i + 1] = _mm256_unpackhi_epi32( r[2 * i], r[2 * i + 1] );
+        }
+
+        for( size_t g = 0; g < 2; ++g ) {
+            r[4 * g] = _mm256_unpacklo_epi64( t[4 * g], t[4 * g + 2] );
+            r[4 * g + 1] = _mm256_unpackhi_epi64( t[4 * g], t[4 * g + 2] );
+            r[4 * g + 2] = _mm256_unpacklo_epi64( t[4 * g + 1], t[4 * g + 3] );
+            r[4 * g + 3] = _mm256_unpackhi_epi64( t[4 * g + 1], t[4 * g + 3] );
+        }
+
+        // r[4 g + j] holds word j and j + 4 of lanes 4 g to 4 g + 3
+        for( size_t j = 0; j < 4; ++j ) {
+            w[8 * half + j] = _mm256_permute2x128_si256( r[j], r[4 + j], 0x20 );
+            w[8 * half + 4 + j] = _mm256_permute2x128_si256( r[j], r[4 + j], 0x31 );
+        }
+    }
+
+    if constexpr( reverse ) {
+        for( size_t i = 0; i < 16; ++i ) {
+            w[i] = _mm256_shuffle_epi8( w[i], bigEndian );
+        }
+    }
+}
+
+//! the masked forms, the plain ones make GCC 12 warn about their undefined pass through operand
+template<int n>
+CPU_TARGET( "avx512f" )
+inline __m512i rotL512( const __m512i& x ) {
+    return _mm512_maskz_rol_epi32( 0xffff, x, n );
+}
+
+CPU_TARGET( "avx512f" )
+inline __m512i rotL512( const __m512i& x, const int& n ) {
+    return _mm512_maskz_rolv_epi32( 0xffff, x, _mm512_set1_epi32( n ) );
+}
+
+//! load256() for 16 lanes, one 16 by 16 transpose, the byte swap as two rotations, masked forms as for rotL512()
+template<bool reverse>
+CPU_TARGET( "avx512f" )
+inline void load512( __m512i w[16], const uint8_t* const* blocks ) {
+    __m512i r[16];
+
+    for( size_t lane = 0; lane < 16; ++lane ) {
+        r[lane] = _mm512_loadu_si512( blocks[lane] );
+    }
+
+    __m512i t[16];
+
+    for( size_t i = 0; i < 8; ++i ) {
+        t[2 * i] = _mm512_maskz_unpacklo_epi32( 0xffff, r[2 * i], r[2 * i + 1] );
+        t[2 * i + 1] = _mm512_maskz_unpackhi_epi32( 0xffff, r[2 * i], r[2 * i + 1] );
+    }
+
+    for( size_t g = 0; g < 4; ++g ) {
+        r[4 * g] = _mm512_maskz_unpacklo_epi64( 0xff, t[4 * g], t[4 * g + 2] );
+        r[4 * g + 1] = _mm512_maskz_unpackhi_epi64( 0xff, t[4 * g], t[4 * g + 2] );
+        r[4 * g + 2] = _mm512_maskz_unpacklo_epi64( 0xff, t[4 * g + 1], t[4 * g + 3] );
+        r[4 * g + 3] = _mm512_maskz_unpackhi_epi64( 0xff, t[4 * g + 1], t[4 * g + 3] );
+    }
+
+    // 128 bit part c of r[4 g + j] holds word 4 c + j of lanes 4 g to 4 g + 3
+    for( size_t j = 0; j < 4; ++j ) {
+        __m512i low = _mm512_maskz_shuffle_i32x4( 0xffff, r[j], r[4 + j], 0x44 );
+        __m512i high = _mm512_maskz_shuffle_i32x4( 0xffff, r[j], r[4 + j], 0xee );
+        __m512i low2 = _mm512_maskz_shuffle_i32x4( 0xffff, r[8 + j], r[12 + j], 0x44 );
+        __m512i high2 = _mm512_maskz_shuffle_i32x4( 0xffff, r[8 + j], r[12 + j], 0xee );
+        w[j] = _mm512_maskz_shuffle_i32x4( 0xffff, low, low2, 0x88 );
+        w[4 + j] = _mm512_maskz_shuffle_i32x4( 0xffff, low, low2, 0xdd );
+        w[8 + j] = _mm512_maskz_shuffle_i32x4( 0xffff, high, high2, 0x88 );
+        w[12 + j] = _mm512_maskz_shuffle_i32x4( 0xffff, high, high2, 0xdd );
+    }
+
+    if constexpr( reverse ) {
+        for( size_t i = 0; i < 16; ++i ) {
+            w[i] = _mm512_ternarylogic_epi32( _mm512_set1_epi32( 0x00ff00ff ), rotL512<8>( w[i] ), rotL512<24>( w[i] ), 0xca );
+        }
+    }
+}
+
+//! sha1BlocksScalar() on the 64 byte blocks at \p blocks of 8 lanes,
+//! \p state holds a, b, c, d and e, each of all lanes next to each other
+CPU_TARGET( "avx2" )
+inline void sha1Lanes8( uint32_t* state, const uint8_t* const* blocks ) {
+    __m256i w[16];
+    load256<true>( w, blocks );
+
+    __m256i a = load256( state );
+    __m256i b = load256( state + 8 );
+    __m256i c = load256( state + 16 );
+    __m256i d = load256( state + 24 );
+    __m256i e = load256( state + 32 );
+
+    for( size_t i = 0; i < 80; ++i ) {
+        if( i >= 16 ) {
+            __m256i x = _mm256_xor_si256( _mm256_xor_si256( w[( i + 13 ) & 15], w[( i + 8 ) & 15] ),
+                                          _mm256_xor_si256( w[( i + 2 ) & 15], w[i & 15] ) );
+            w[i & 15] = rotL256<1>( x );
+        }
+
+        __m256i f;
+        __m256i k;
+
+        if( i < 20 ) {
+            f = _mm256_xor_si256( d, _mm256_and_si256( b, _mm256_xor_si256( c, d ) ) );
+            k = _mm256_set1_epi32( 0x5A827999 );
+        } else if( i < 40 ) {
+            f = _mm256_xor_si256( _mm256_xor_si256( b, c ), d );
+            k = _mm256_set1_epi32( 0x6ED9EBA1 );
+        } else if( i < 60 ) {
+            f = _mm256_or_si256( _mm256_and_si256( b, c ), _mm256_and_si256( d, _mm256_or_si256( b, c ) ) );
+            k = _mm256_set1_epi32( static_cast<int>( 0x8F1BBCDC ) );
+        } else {
+            f = _mm256_xor_si256( _mm256_xor_si256( b, c ), d );
+            k = _mm256_set1_epi32( static_cast<int>( 0xCA62C1D6 ) );
+        }
+
+        __m256i temp = _mm256_add_epi32( add256( rotL256<5>( a ), f, e, k ), w[i & 15] );
+        e = d;
+        d = c;
+        c = rotL256<30>( b );
+        b = a;
+        a = temp;
+    }
+
+    store256( state, _mm256_add_epi32( load256( state ), a ) );
+    store256( state + 8, _mm256_add_epi32( load256( state + 8 ), b ) );
+    store256( state + 16, _mm256_add_epi32( load256( state + 16 ), c ) );
+    store256( state + 24, _mm256_add_epi32( load256( state + 24 ), d ) );
+    store256( state + 32, _mm256_add_epi32( load256( state + 32 ), e ) );
+}
+
+//! sha1Lanes8() on 16 lanes, the round functions are single ternary logic instructions
+CPU_TARGET( "avx512f" )
+inline void sha1Lanes16( uint32_t* state, const uint8_t* const* blocks ) {
+    __m512i w[16];
+    load512<true>( w, blocks );
+
+    __m512i a = _mm512_loadu_si512( state );
+    __m512i b = _mm512_loadu_si512( state + 16 );
+    __m512i c = _mm512_loadu_si512( state + 32 );
+    __m512i d = _mm512_loadu_si512( state + 48 );
+    __m512i e = _mm512_loadu_si512( state + 64 );
+
+    for( size_t i = 0; i < 80; ++i ) {
+        if( i >= 16 ) {
+            __m512i x = _mm512_ternarylogic_epi32( w[( i + 13 ) & 15], w[( i + 8 ) & 15], w[( i + 2 ) & 15], 0x96 );
+            w[i & 15] = rotL512<1>( _mm512_xor_si512( x, w[i & 15] ) );
+        }
+
+        __m512i f;
+        __m512i k;
+
+        // truth tables of choose, parity and majority of b, c and d
+        if( i < 20 ) {
+            f = _mm512_ternarylogic_epi32( b, c, d, 0xca );
+            k = _mm512_set1_epi32( 0x5A827999 );
+        } else if( i < 40 ) {
+            f = _mm512_ternarylogic_epi32( b, c, d, 0x96 );
+            k = _mm512_set1_epi32( 0x6ED9EBA1 );
+        } else if( i < 60 ) {
+            f = _mm512_ternarylogic_epi32( b, c, d, 0xe8 );
+            k = _mm512_set1_epi32( static_cast<int>( 0x8F1BBCDC ) );
+        } else {
+            f = _mm512_ternarylogic_epi32( b, c, d, 0x96 );
+            k = _mm512_set1_epi32( static_cast<int>( 0xCA62C1D6 ) );
+        }
+
+        __m512i temp = _mm512_add_epi32( _mm512_add_epi32( rotL512<5>( a ), f ),
+                                         _mm512_add_epi32( _mm512_add_epi32( e, k ), w[i & 15] ) );
+        e = d;
+        d = c;
+        c = rotL512<30>( b );
+        b = a;
+        a = temp;
+    }
+
+    _mm512_storeu_si512( state, _mm512_add_epi32( _mm512_loadu_si512( state ), a ) );
+    _mm512_storeu_si512( state + 16, _mm512_add_epi32( _mm512_loadu_si512( state + 16 ), b ) );
+    _mm512_storeu_si512( state + 32, _mm512_add_epi32( _mm512_loadu_si512( state + 32 ), c ) );
+    _mm512_storeu_si512( state + 48, _mm512_add_epi32( _mm512_loadu_si512( state + 48 ), d ) );
+    _mm512_storeu_si512( state + 64, _mm512_add_epi32( _mm512_loadu_si512( state + 64 ), e ) );
+}
+
+//! word and shift of the 48 MD4 steps, round by round
+//! \sa https://tools.ietf.org/html/rfc1320
+const uint8_t md4Words[48] = {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15,
+                                0,  4,  8, 12,  1,  5,  9, 13,  2,  6, 10, 14,  3,  7, 11, 15,
+                                0,  8,  4, 12,  2, 10,  6, 14,  1,  9,  5, 13,  3, 11,  7, 15
+                             };
+const uint8_t md4Shifts[12] = { 3, 7, 11, 19, 3, 5, 9, 13, 3, 9, 11, 15 };
+
+//! md4Block() on 8 lanes, \p state and \p blocks as for sha1Lanes8()
+CPU_TARGET( "avx2" )
+inline void md4Lanes8( uint32_t* state, const uint8_t* const* blocks ) {
+    __m256i w[16];
+    load256<false>( w, blocks );
+
+    __m256i a = load256( state );
+    __m256i b = load256( state + 8 );
+    __m256i c = load256( state + 16 );
+    __m256i d = load256( state + 24 );
+
+    for( size_t i = 0; i < 48; ++i ) {
+        __m256i f;
+        __m256i k;
+
+        if( i < 16 ) {
+            f = _mm256_xor_si256( d, _mm256_and_si256( b, _mm256_xor_si256( c, d ) ) );
+            k = _mm256_setzero_si256();
+        } else if( i < 32 ) {
+            f = _mm256_or_si256( _mm256_and_si256( b, c ), _mm256_and_si256( d, _mm256_or_si256( b, c ) ) );
+            k = _mm256_set1_epi32( 0x5A827999 );
+        } else {
+            f = _mm256_xor_si256( _mm256_xor_si256( b, c ), d );
+            k = _mm256_set1_epi32( 0x6ED9EBA1 );
+        }
+
+        int s = md4Shifts[i / 16 * 4 + i % 4];
+        __m256i x = add256( a, f, w[md4Words[i]], k );
+        x = _mm256_or_si256( _mm256_sll_epi32( x, _mm_cvtsi32_si128( s ) ), _mm256_srl_epi32( x, _mm_cvtsi32_si128( 32 - s ) ) );
+
+        // the next step updates d with a, b and c in the roles of b, c and d
+        a = d;
+        d = c;
+        c = b;
+        b = x;
+    }
+
+    store256( state, _mm256_add_epi32( load256( state ), a ) );
+    store256( state + 8, _mm256_add_epi32( load256( state + 8 ), b ) );
+    store256( state + 16, _mm256_add_epi32( load256( state + 16 ), c ) );
+    store256( state + 24, _mm256_add_epi32( load256( state + 24 ), d ) );
+}
+
+//! md4Lanes8() on 16 lanes
+CPU_TARGET( "avx512f" )
+inline void md4Lanes16( uint32_t* state, const uint8_t* const* blocks ) {
+    __m512i w[16];
+    load512<false>( w, blocks );
+
+    __m512i a = _mm512_loadu_si512( state );
+    __m512i b = _mm512_loadu_si512( state + 16 );
+    __m512i c = _mm512_loadu_si512( state + 32 );
+    __m512i d = _mm512_loadu_si512( state + 48 );
+
+    for( size_t i = 0; i < 48; ++i ) {
+        __m512i f;
+        __m512i k;
+
+        if( i < 16 ) {
+            f = _mm512_ternarylogic_epi32( b, c, d, 0xca );
+            k = _mm512_setzero_si512();
+        } else if( i < 32 ) {
+            f = _mm512_ternarylogic_epi32( b, c, d, 0xe8 );
+            k = _mm512_set1_epi32( 0x5A827999 );
+        } else {
+            f = _mm512_ternarylogic_epi32( b, c, d, 0x96 );
+            k = _mm512_set1_epi32( 0x6ED9EBA1 );
+        }
+
+        __m512i x = _mm512_add_epi32( _mm512_add_epi32( a, f ), _mm512_add_epi32( w[md4Words[i]], k ) );
+        x = rotL512( x, md4Shifts[i / 16 * 4 + i % 4] );
+
+        a = d;
+        d = c;
+        c = b;
+        b = x;
+    }
+
+    _mm512_storeu_si512( state, _mm512_add_epi32( _mm512_loadu_si512( state ), a ) );
+    _mm512_storeu_si512( state + 16, _mm512_add_epi32( _mm512_loadu_si512( state + 16 ), b ) );
+    _mm512_storeu_si512( state + 32, _mm512_add_epi32( _mm512_loadu_si512( state + 32 ), c ) );
+    _mm512_storeu_si512( state + 48, _mm512_add_epi32( _mm512_loadu_si512( state + 48 ), d ) );
+}
+
+//! hashes \p messages in groups of \p lanes with \p compress, each lane runs through the whole blocks of its message
+//! and then its padded tail, the digest is taken after the last block of the lane, later blocks of it are don't care,
+//! messages of different lengths are grouped by their number of blocks so the lanes of a group finish about together
+template<size_t T, bool reverse, size_t lanes>
+void batch( void( *compress )( uint32_t*, const uint8_t* const* ), std::span<const std::span<const uint8_t>> messages,
+            uint8_t* digests, const Magic<T>& magics, const size_t& offset ) {
+    std::vector<size_t> order( messages.size() );
+    std::iota( order.begin(), order.end(), 0 );
+
+    // sorting is skipped for the common batch of one length
+    auto fewerBlocks = [&messages]( const size_t& a, const size_t& b ) {
+        return ( messages[a].size() + 8 ) / 64 < ( messages[b].size() + 8 ) / 64;
+    };
+
+    if( !std::is_sorted( order.begin(), order.end(), fewerBlocks ) ) {
+        std::sort( order.begin(), order.end(), fewerBlocks );
+    }
+
+    alignas( 64 ) uint32_t state[T * lanes];
+    const uint8_t* blocks[lanes];
+    const uint8_t* data[lanes];
+    size_t whole[lanes];
+    size_t total[lanes];
+    // the padded last one or two blocks behind 64 bytes of room for the copies
+    uint8_t tail[lanes][256];
+
+    for( size_t group = 0; group < order.size(); group += lanes ) {
+        const size_t used = std::min( lanes, order.size() - group );
+        size_t maxBlocks = 0;
+
+        for( size_t lane = 0; lane < used; ++lane ) {
+            std::span<const uint8_t> message = messages[order[group + lane]];
+            message = message.subspan( std::min( offset, message.size() ) );
+            data[lane] = message.data();
+            whole[lane] = message.size() / 64;
+
+            // parity bit and length as in MDCtx::final()
+            size_t rest = message.size() % 64;
+            size_t tailSize = rest + 9 > 64 ? 128 : 64;
+            uint64_t bits = ( offset + message.size() ) * 8;
+
+            if constexpr( reverse ) {
+                bits = endian_reverse( bits );
+            }
+
+            // fixed size copies, the last 64 bytes of the message end at the start of the padding,
+            // what lands before the tail in the 64 bytes in front of it is never hashed
+            uint8_t* padded = tail[lane] + 64;
+
+            if( message.size() >= 64 ) {
+                memcpy( padded + rest - 64, message.data() + message.size() - 64, 64 );
+            } else {
+                memcpy( padded, message.data(), rest );
+            }
+
+            memset( padded + rest, 0, 128 );
+            padded[rest] = 0x80;
+            memcpy( padded + tailSize - 8, &bits, 8 );
+            total[lane] = whole[lane] + tailSize / 64;
+            maxBlocks = std::max( maxBlocks, total[lane] );
+        }
+
+        for( size_t i = 0; i < T; ++i ) {
+            std::fill_n( state + i * lanes, lanes, magics[i] );
+        }
+
+        for( size_t block = 0; block < maxBlocks; ++block ) {
+            for( size_t lane = 0; lane < used; ++lane ) {
+                if( block < whole[lane] ) {
+                    blocks[lane] = data[lane] + 64 * block;
+                } else if( block < total[lane] ) {
+                    blocks[lane] = tail[lane] + 64 * ( block - whole[lane] + 1 );
+                }
+            }
+
+            // unused lanes repeat the first
+            std::fill( blocks + used, blocks + lanes, blocks[0] );
+            compress( state, blocks );
+
+            for( size_t lane = 0; lane < used; ++lane ) {
+                if( total[lane] != block + 1 ) {
+                    continue;
+                }
+
+                uint8_t* digest = digests + 4 * T * order[group + lane];
+
+                for( size_t i = 0; i < T; ++i ) {
+                    uint32_t word = state[i * lanes + lane];
+
+                    if constexpr( reverse ) {
+                        word = endian_reverse( word );
+                    }
+
+                    memcpy( digest + 4 * i, &word, 4 );
+                }
+            }
+        }
+    }
+}
+
+}
+
+//! writes the 20 byte SHA-1 of each of \p messages to \p digests, one after the other,
+//! \p magics and \p offset as for sha1() and the same for all messages
+inline void sha1Batch( std::span<const std::span<const uint8_t>> messages, uint8_t* digests,
+                       const Magic<5>& magics = SHA1_MAGICS, const size_t& offset = 0 ) {
+    if( cpu::features().avx512f ) {
+        detail::batch<5, true, 16>( detail::sha1Lanes16, messages, digests, magics, offset );
+    } else if( cpu::features().avx2 ) {
+        detail::batch<5, true, 8>( detail::sha1Lanes8, messages, digests, magics, offset );
+    } else {
+        for( size_t i = 0; i < messages.size(); ++i ) {
+            sha1( messages[i], digests + 20 * i, magics, offset );
+        }
+    }
+}
+
+//! writes the 16 byte MD4 of each of \p messages to \p digests, as sha1Batch()
+inline void md4Batch( std::span<const std::span<const uint8_t>> messages, uint8_t* digests,
+                      const Magic<4>& magics = MD4_MAGICS, const size_t& offset = 0 ) {
+    if( cpu::features().avx512f ) {
+        detail::batch<4, false, 16>( detail::md4Lanes16, messages, digests, magics, offset );
+    } else if( cpu::features().avx2 ) {
+        detail::batch<4, false, 8>( detail::md4Lanes8, messages, digests, magics, offset );
+    } else {
+        for( size_t i = 0; i < messages.size(); ++i ) {
+            md4( messages[i], digests + 16 * i, magics, offset );
+        }
+    }
+}
+
+namespace detail {
+
+template<size_t digestSize, class Container>
+std::vector<Container> batch( void( *hash )( std::span<const std::span<const uint8_t>>, uint8_t*, const Magic<digestSize / 4>&, const size_t& ),
+                              const std::vector<Container>& messages, const Magic<digestSize / 4>& magics, const size_t& offset ) {
+    static_assert( sizeof( typename Container::value_type ) == 1, "Container type must be 8 bit" );
+
+    std::vector<std::span<const uint8_t>> views;
+    views.reserve( messages.size() );
+
+    for( const Container& message : messages ) {
+        views.emplace_back( reinterpret_cast<const uint8_t*>( message.data() ), message.size() );
+    }
+
+    std::vector<uint8_t> digests( digestSize * messages.size() );
+    hash( views, digests.data(), magics, offset );
+
+    std::vector<Container> res;
+    res.reserve( messages.size() );
+
+    for( size_t i = 0; i < messages.size(); ++i ) {
+        res.emplace_back( digests.begin() + digestSize * i, digests.begin() + digestSize * ( i + 1 ) );
+    }
+
+    return res;
+}
+
+}
+
+template<class Container = std::vector<uint8_t>>
+std::vector<Container> sha1Batch( const std::vector<Container>& messages, const Magic<5>& magics = SHA1_MAGICS, const size_t& offset = 0 ) {
+    return detail::batch<20>( sha1Batch, messages, magics, offset );
+}
+
+template<class Container = std::vector<uint8_t>>
+std::vector<Container> md4Batch( const std::vector<Container>& messages, const Magic<4>& magics = MD4_MAGICS, const size_t& offset = 0 ) {
+    return detail::batch<16>( md4Batch, messages, magics, offset );
+}
+
+}
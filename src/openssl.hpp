@@ -1,82 +1,179 @@
 #pragma once
 
-#include <memory>
+#include <algorithm>
+#include <cstring>
 
 #include "openssl/evp.h"
 #include "openssl/rand.h"
 
 #include "log.hpp"
+#include "aesni.hpp"
 
 #define BREAK_IF( COND, MSG ) if( ( COND ) ) { LOG( MSG ); break; }
 
 namespace openssl {
 
-// https://wiki.openssl.org/index.php/EVP_Symmetric_Encryption_and_Decryption#Encrypting_the_message
-inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const uint8_t* userkey ) {
+namespace detail {
+
+const size_t keySize = 16;
 
-    size_t ciphertext_len = 0;
+//! an EVP context for one cipher and direction, reused across calls,
+//! the key schedule runs again only when the key changes
+class Context {
+    public:
+        Context( const EVP_CIPHER* cipher, const int& encrypt ) :
+            ctx( EVP_CIPHER_CTX_new() ), cipher( cipher ), encrypt( encrypt ) {
+        }
+        ~Context() {
+            EVP_CIPHER_CTX_free( ctx );
+        }
+        Context( const Context& ) = delete;
+        Context& operator=( const Context& ) = delete;
+
+        //! \returns the context ready for \p userkey and \p iv, nullptr on errors
+        EVP_CIPHER_CTX* init( const uint8_t* userkey, const uint8_t* iv ) {
+            if( !ctx ) {
+                return nullptr;
+            }
+
+            bool rekey = !keyed || std::memcmp( key, userkey, keySize ) != 0;
+            keyed = false;
+
+            // without cipher and key only the iv is reset
+            int rv = EVP_CipherInit_ex( ctx, rekey ? cipher : nullptr, nullptr, rekey ? userkey : nullptr, iv, encrypt );
+
+            if( rv != 1 ) {
+                LOG( "Error: EVP_CipherInit_ex returned " << rv );
+                return nullptr;
+            }
+
+            rv = EVP_CIPHER_CTX_set_padding( ctx, 0 );
+
+            if( rv != 1 ) {
+                LOG( "Error: EVP_CIPHER_CTX_set_padding returned " << rv );
+                return nullptr;
+            }
+
+            std::memcpy( key, userkey, keySize );
+            keyed = true;
+            return ctx;
+        }
+
+    private:
+        EVP_CIPHER_CTX* ctx;
+        const EVP_CIPHER* cipher;
+        int encrypt;
+        bool keyed = false;
+        uint8_t key[keySize];
+};
+
+enum class Mode { ECBEncrypt, ECBDecrypt, CBCEncrypt, CBCDecrypt };
+
+//! \returns the context of this thread for \p mode, created on first use
+inline Context& context( const Mode& mode ) {
+    thread_local Context contexts[] = {
+        { EVP_aes_128_ecb(), 1 },
+        { EVP_aes_128_ecb(), 0 },
+        { EVP_aes_128_cbc(), 1 },
+        { EVP_aes_128_cbc(), 0 },
+    };
+    return contexts[static_cast<size_t>( mode )];
+}
+
+// https://wiki.openssl.org/index.php/EVP_Symmetric_Encryption_and_Decryption
+inline size_t crypt( const Mode& mode, const uint8_t* in, uint8_t* out, const size_t length, const uint8_t* userkey, const uint8_t* iv ) {
+
+    size_t out_len = 0;
 
     do {
         int len = 0;
 
-        std::shared_ptr<EVP_CIPHER_CTX> ctx( EVP_CIPHER_CTX_new(), []( EVP_CIPHER_CTX * ctx ) {
-            EVP_CIPHER_CTX_free( ctx );
-        } );
+        EVP_CIPHER_CTX* ctx = context( mode ).init( userkey, iv );
         BREAK_IF( !ctx, "Error: Invalid ctx" );
 
-        int rv = EVP_EncryptInit_ex( ctx.get(), EVP_aes_128_ecb(), nullptr, userkey, nullptr );
-        BREAK_IF( rv != 1, "Error: EVP_EncryptInit_ex returned " << rv );
+        int rv = EVP_CipherUpdate( ctx, out, &len, in, length );
+        BREAK_IF( rv != 1, "Error: EVP_CipherUpdate returned " << rv );
 
-        rv = EVP_CIPHER_CTX_set_padding( ctx.get(), 0 );
-        BREAK_IF( rv != 1, "Error: EVP_CIPHER_CTX_set_padding returned " << rv );
+        out_len = len;
 
-        rv = EVP_EncryptUpdate( ctx.get(), ciphertext, &len, plaintext, length );
-        BREAK_IF( rv != 1, "Error: EVP_EncryptUpdate returned " << rv );
+        rv = EVP_CipherFinal_ex( ctx, out + len, &len );
+        BREAK_IF( rv != 1, "Error: EVP_CipherFinal_ex returned " << rv );
 
-        ciphertext_len = len;
-
-        rv = EVP_EncryptFinal_ex( ctx.get(), ciphertext + len, &len );
-        BREAK_IF( rv != 1, "Error: EVP_EncryptFinal_ex returned " << rv );
-
-        ciphertext_len += len;
+        out_len += len;
 
     } while( false );
 
-    return ciphertext_len;
+    return out_len;
 }
 
-// https://wiki.openssl.org/index.php/EVP_Symmetric_Encryption_and_Decryption#Decrypting_the_Message
-inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const uint8_t* userkey ) {
+}
 
-    size_t plaintext_len = 0;
+// one EVP context per thread and mode, see detail::Context
 
-    do {
-        int len = 0;
+inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const uint8_t* userkey ) {
+    return detail::crypt( detail::Mode::ECBEncrypt, plaintext, ciphertext, length, userkey, nullptr );
+}
 
-        std::shared_ptr<EVP_CIPHER_CTX> ctx( EVP_CIPHER_CTX_new(), []( EVP_CIPHER_CTX * ctx ) {
-            EVP_CIPHER_CTX_free( ctx );
-        } );
-        BREAK_IF( !ctx, "Error: Invalid ctx" );
+inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const uint8_t* userkey ) {
+    return detail::crypt( detail::Mode::ECBDecrypt, ciphertext, plaintext, length, userkey, nullptr );
+}
 
-        int rv = EVP_DecryptInit_ex( ctx.get(), EVP_aes_128_ecb(), nullptr, userkey, nullptr );
-        BREAK_IF( rv != 1, "Error: EVP_DecryptInit_ex returned " << rv );
+inline size_t encryptAES128CBC( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const uint8_t* userkey, const uint8_t* iv ) {
+    return detail::crypt( detail::Mode::CBCEncrypt, plaintext, ciphertext, length, userkey, iv );
+}
 
-        rv = EVP_CIPHER_CTX_set_padding( ctx.get(), 0 );
-        BREAK_IF( rv != 1, "Error: EVP_CIPHER_CTX_set_padding returned " << rv );
+inline size_t decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const uint8_t* userkey, const uint8_t* iv ) {
+    return detail::crypt( detail::Mode::CBCDecrypt, ciphertext, plaintext, length, userkey, iv );
+}
 
-        rv = EVP_DecryptUpdate( ctx.get(), plaintext, &len, ciphertext, length );
-        BREAK_IF( rv != 1, "Error: EVP_DecryptUpdate returned " << rv );
+inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const aesni::AesKey128& key ) {
+    return encryptAES128ECB( plaintext, ciphertext, length, key.data() );
+}
 
-        plaintext_len = len;
+inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const aesni::AesKey128& key ) {
+    return decryptAES128ECB( ciphertext, plaintext, length, key.data() );
+}
 
-        rv = EVP_DecryptFinal_ex( ctx.get(), plaintext + len, &len );
-        BREAK_IF( rv != 1, "Error: EVP_DecryptFinal_ex returned " << rv );
+inline size_t encryptAES128CBC( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const aesni::AesKey128& key, const uint8_t* iv ) {
+    return encryptAES128CBC( plaintext, ciphertext, length, key.data(), iv );
+}
 
-        plaintext_len += len;
+//! CBC encrypts \p count independent messages one after the other
+inline void encryptAES128CBC( const aesni::CBCJob* jobs, const size_t count ) {
+    for( size_t i = 0; i < count; ++i ) {
+        encryptAES128CBC( jobs[i].in, jobs[i].out, jobs[i].length, jobs[i].key->data(), jobs[i].iv );
+    }
+}
 
-    } while( false );
+inline size_t decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const aesni::AesKey128& key, const uint8_t* iv ) {
+    return decryptAES128CBC( ciphertext, plaintext, length, key.data(), iv );
+}
 
-    return plaintext_len;
+//! XORs \p length bytes of \p in with the CTR keystream into \p out, same counter layout as aesni::cryptAES128CTR
+//! EVP_aes_128_ctr increments the whole block big endian, the little endian counter in the upper half
+//! needs its own counter blocks, encrypted as ECB with the persistent context
+inline void cryptAES128CTR( const uint8_t* in, uint8_t* out, const size_t length,
+                            const aesni::AesKey128& key, const uint64_t& nonce, uint64_t counter = 0 ) {
+    const size_t blockSize = 16;
+    const size_t chunk = 256 * blockSize;
+    uint8_t counters[chunk];
+    uint8_t stream[chunk];
+
+    for( size_t pos = 0; pos < length; pos += chunk ) {
+        size_t size = std::min( chunk, length - pos );
+        size_t blocks = ( size + blockSize - 1 ) / blockSize;
+
+        for( size_t i = 0; i < blocks; ++i, ++counter ) {
+            memcpy( &counters[i * blockSize], &nonce, sizeof( nonce ) );
+            memcpy( &counters[i * blockSize + sizeof( nonce )], &counter, sizeof( counter ) );
+        }
+
+        openssl::encryptAES128ECB( counters, stream, blocks * blockSize, key );
+
+        for( size_t i = 0; i < size; ++i ) {
+            out[pos + i] = in[pos + i] ^ stream[i];
+        }
+    }
 }
 
 }
@@ -7,13 +7,18 @@
 #elif __linux__
 #include <sys/random.h>
 #endif
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
 #include <cstring>
 #include <random>
 #include <array>
 
+#include <immintrin.h>
+
 #include "types.hpp"
+#include "cpu.hpp"
+#include "gf2.hpp"
 #include "log.hpp"
 
 namespace randombuffer {
@@ -51,35 +56,31 @@ inline uint32_t get( const uint32_t max = -1 ) {
 }
 
 // https://de.wikipedia.org/wiki/Mersenne-Twister#Algorithmus
+// the same generator as std::mt19937, the state is a ring of 624 words regenerated in place
 class Mersenne {
     public:
         static const size_t size = 624;
-        static const size_t twopow31 = 2147483648;
-        static const size_t twopow11 = 2048;
-        static const size_t twopow7 = 128;
-        static const size_t twopow15 = 32768;
-        static const size_t twopow18 = 262144;
+        static const size_t shift = 397;
+        static const uint32_t upper = 0x80000000;
+        static const uint32_t lower = 0x7fffffff;
+        static const uint32_t matrix = 0x9908b0df;
         using Init = std::array<uint32_t, size>;
-        using State = std::array<uint32_t, 2 * size>;
+        using State = std::array<uint32_t, size>;
 
         explicit Mersenne( const Init& init ) {
-            std::memcpy( state.data(), init.data(), size * sizeof( uint32_t ) );
+            state = init;
         }
         explicit Mersenne( std::seed_seq& seq ) {
-            Mersenne::Init init;
-            seq.generate( init.begin(), init.end() );
-            std::memcpy( state.data(), init.data(), size * sizeof( uint32_t ) );
+            seq.generate( state.begin(), state.end() );
         }
         explicit Mersenne( const uint32_t& seed ) {
             std::seed_seq seq{ seed };
-            Mersenne::Init init;
-            seq.generate( init.begin(), init.end() );
-            std::memcpy( state.data(), init.data(), size * sizeof( uint32_t ) );
+            seq.generate( state.begin(), state.end() );
         }
 
         uint32_t get() {
             if( pos == size ) {
-                shuffle();
+                twist();
                 pos = 0;
             }
 
@@ -88,6 +89,85 @@ class Mersenne {
             return scramble( v );
         }
 
+        //! writes the next \p count outputs to \p out, the same sequence as \p count calls of get()
+        void fill( uint32_t* out, size_t count ) {
+            while( count > 0 ) {
+                if( pos == size ) {
+                    twist();
+                    pos = 0;
+                }
+
+                size_t n = std::min( count, size - pos );
+                scramble( &state[pos], out, n );
+                pos += n;
+                out += n;
+                count -= n;
+            }
+        }
+
+        //! advances the generator as \p steps calls of get() would, far jumps in O( log steps ) polynomial operations
+        void jump( const uint64_t& steps ) {
+            uint64_t twists = ( pos + steps ) / size;
+            pos = ( pos + steps ) % size;
+
+            if( twists <= jumpTwists ) {
+                while( twists-- > 0 ) {
+                    twist();
+                }
+
+                return;
+            }
+
+            // the lower bits of the first word don't reach the next state, one step drops them before the polynomial
+            State stepped = state;
+            stepped[0] = twist( state[0], state[1], state[shift] );
+            std::rotate( stepped.begin(), stepped.begin() + 1, stepped.end() );
+            state = transform( stepped, modulus().power( gf2::monomial( 1 ), twists * size - 1 ) );
+        }
+
+        //! \returns the generator whose next output is output \p target counted from seeding,
+        //! cloned from the \p size consecutive \p outputs from output \p offset on, \p target may be before \p offset
+        static Mersenne clone( const uint32_t* outputs, const uint64_t& offset, const uint64_t& target ) {
+            Init init;
+            unscramble( outputs, init.data(), init.size() );
+            Mersenne mersenne( init );
+            mersenne.pos = 0;
+
+            if( target >= offset ) {
+                mersenne.jump( target - offset );
+            } else {
+                // x^-1 = ( m + 1 ) / x for the characteristic polynomial m, its constant term is 1
+                const gf2::Polynomial& m = characteristic();
+                gf2::Polynomial inverse( m.size() );
+
+                for( size_t i = 0; i < m.size(); ++i ) {
+                    inverse[i] = ( m[i] >> 1 ) | ( i + 1 < m.size() ? m[i + 1] << 63 : 0 );
+                }
+
+                mersenne.state = transform( init, modulus().power( inverse, offset - target ) );
+            }
+
+            return mersenne;
+        }
+
+        //! scrambles \p count words of \p in into \p out, which may be \p in
+        static void scramble( const uint32_t* in, uint32_t* out, const size_t& count ) {
+            size_t done = cpu::features().avx2 ? scrambleAVX2( in, out, count ) : 0;
+
+            for( size_t i = done; i < count; ++i ) {
+                out[i] = scramble( in[i] );
+            }
+        }
+
+        //! unscrambles \p count words of \p in into \p out, which may be \p in
+        static void unscramble( const uint32_t* in, uint32_t* out, const size_t& count ) {
+            size_t done = cpu::features().avx2 ? unscrambleAVX2( in, out, count ) : 0;
+
+            for( size_t i = done; i < count; ++i ) {
+                out[i] = unscramble( in[i] );
+            }
+        }
+
         // spread result for equal bits distribution
         static uint32_t scramble( uint32_t a ) {
             a ^= ( a >> 11 );
@@ -141,19 +221,173 @@ class Mersenne {
 
             return a;
         }
+        //! the next word of the recurrence from \p current, \p next and \p far = state[i + 397]
+        static uint32_t twist( const uint32_t& current, const uint32_t& next, const uint32_t& far ) {
+            uint32_t y = ( current & upper ) | ( next & lower );
+            return far ^ ( y >> 1 ) ^ ( ( 0 - ( y & 1 ) ) & matrix );
+        }
+
     private:
+        //! regenerates the words [ \p from, \p to ), the first 227 words read old words ahead,
+        //! the others words regenerated already
+        static void twist( uint32_t* x, size_t from, const size_t& to ) {
+            for( ; from < to; ++from ) {
+                size_t far = from < size - shift ? from + shift : from + shift - size;
+                x[from] = twist( x[from], x[from + 1], x[far] );
+            }
+        }
+
+        //! the characteristic polynomial of the one word transition of the 19937 bit state,
+        //! computed once from a bit of the outputs with the Berlekamp-Massey algorithm
+        static const gf2::Polynomial& characteristic() {
+            static const gf2::Polynomial m = [] {
+                const size_t degree = size * 32 - 31;
+                const size_t length = 2 * degree;
+                Mersenne mersenne( 5489u );
+                gf2::Polynomial bits( length / 64 + 1 );
+
+                for( size_t i = 0; i < length; ++i ) {
+                    bits[i / 64] |= static_cast<uint64_t>( mersenne.get() >> 31 ) << ( i % 64 );
+                }
+
+                gf2::Polynomial minimal = gf2::minimalPolynomial( bits, length );
+
+                if( gf2::degree( minimal ) != static_cast<int64_t>( degree ) ) {
+                    LOG( "Error: Characteristic polynomial of degree " << gf2::degree( minimal ) );
+                }
+
+                return minimal;
+            }();
+            return m;
+        }
+
+        static const gf2::Modulus& modulus() {
+            static const gf2::Modulus m( characteristic() );
+            return m;
+        }
+
+        //! \returns p( S )( \p x ) = sum of p_i S^i( \p x ) by Horner's rule, with S the one word step of the state \p x
+        static State transform( const State& x, const gf2::Polynomial& p ) {
+            State sum = {};
+            size_t r = 0;
+
+            for( int64_t i = gf2::degree( p ); i >= 0; --i ) {
+                // the ring starts at r, its first word becomes the one 624 words later
+                sum[r] = twist( sum[r], sum[r + 1 < size ? r + 1 : 0], sum[r + shift < size ? r + shift : r + shift - size] );
+                r = r + 1 < size ? r + 1 : 0;
+
+                if( gf2::coefficient( p, i ) ) {
+                    for( size_t j = 0; j < size - r; ++j ) {
+                        sum[r + j] ^= x[j];
+                    }
+
+                    for( size_t j = size - r; j < size; ++j ) {
+                        sum[r + j - size] ^= x[j];
+                    }
+                }
+            }
+
+            std::rotate( sum.begin(), sum.begin() + r, sum.end() );
+            return sum;
+        }
 
         // generate new state of 624 numbers
-        void shuffle() {
+        void twist() {
+            uint32_t* x = state.data();
 
-            for( size_t i = 0; i < size; ++i ) {
-                uint32_t h = state[i] - state[i] % twopow31 + state[i + 1] % twopow31;
-                state[i + size] = state[i + size - 227] ^ h / 2 ^ ( ( h % 2 ) * 0x9908b0df );
+            if( cpu::features().avx2 ) {
+                twistAVX2( x );
+            } else {
+                twist( x, 0, size - 1 );
             }
 
-            std::memcpy( &state[0], &state[size], size * sizeof( uint32_t ) );
+            // the last word wraps around to the regenerated first one
+            x[size - 1] = twist( x[size - 1], x[0], x[shift - 1] );
         }
+
+        //! the same as twist( x, 0, size - 1 ), 8 words at a time
+        CPU_TARGET( "avx2" )
+        static void twistAVX2( uint32_t* x ) {
+            const size_t lanes = 8;
+            size_t i = 0;
+
+            // the lanes never read a word regenerated in the same step, [i + 1, i + 8] is still old
+            for( ; i + lanes <= size - shift; i += lanes ) {
+                twistAVX2( x + i, x + i + shift );
+            }
+
+            twist( x, i, size - shift );
+
+            // and i - 227 + 7 < i is regenerated already
+            for( i = size - shift; i + lanes <= size - 1; i += lanes ) {
+                twistAVX2( x + i, x + i + shift - size );
+            }
+
+            twist( x, i, size - 1 );
+        }
+
+        CPU_TARGET( "avx2" )
+        static void twistAVX2( uint32_t* x, const uint32_t* far ) {
+            __m256i current = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( x ) );
+            __m256i next = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( x + 1 ) );
+            __m256i y = _mm256_or_si256( _mm256_and_si256( current, _mm256_set1_epi32( upper ) ),
+                                         _mm256_and_si256( next, _mm256_set1_epi32( lower ) ) );
+            __m256i odd = _mm256_sub_epi32( _mm256_setzero_si256(), _mm256_and_si256( y, _mm256_set1_epi32( 1 ) ) );
+            __m256i v = _mm256_xor_si256( _mm256_loadu_si256( reinterpret_cast<const __m256i*>( far ) ), _mm256_srli_epi32( y, 1 ) );
+            v = _mm256_xor_si256( v, _mm256_and_si256( odd, _mm256_set1_epi32( matrix ) ) );
+            _mm256_storeu_si256( reinterpret_cast<__m256i*>( x ), v );
+        }
+
+        //! \returns the number of words done, a multiple of 8
+        CPU_TARGET( "avx2" )
+        static size_t scrambleAVX2( const uint32_t* in, uint32_t* out, const size_t& count ) {
+            size_t i = 0;
+
+            for( ; i + 8 <= count; i += 8 ) {
+                __m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( in + i ) );
+                a = _mm256_xor_si256( a, _mm256_srli_epi32( a, 11 ) );
+                a = _mm256_xor_si256( a, _mm256_and_si256( _mm256_slli_epi32( a, 7 ), _mm256_set1_epi32( 0x9D2C5680 ) ) );
+                a = _mm256_xor_si256( a, _mm256_and_si256( _mm256_slli_epi32( a, 15 ), _mm256_set1_epi32( 0xEFC60000 ) ) );
+                a = _mm256_xor_si256( a, _mm256_srli_epi32( a, 18 ) );
+                _mm256_storeu_si256( reinterpret_cast<__m256i*>( out + i ), a );
+            }
+
+            return i;
+        }
+
+        //! inverts the steps of scramble() in reverse order, the shifts by 7 and 11 by fixed point iteration
+        CPU_TARGET( "avx2" )
+        static size_t unscrambleAVX2( const uint32_t* in, uint32_t* out, const size_t& count ) {
+            size_t i = 0;
+
+            for( ; i + 8 <= count; i += 8 ) {
+                __m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( in + i ) );
+                a = _mm256_xor_si256( a, _mm256_srli_epi32( a, 18 ) );
+                a = _mm256_xor_si256( a, _mm256_and_si256( _mm256_slli_epi32( a, 15 ), _mm256_set1_epi32( 0xEFC60000 ) ) );
+
+                // every round fixes 7 more bits
+                __m256i b = a;
+
+                for( size_t round = 0; round < 4; ++round ) {
+                    b = _mm256_xor_si256( a, _mm256_and_si256( _mm256_slli_epi32( b, 7 ), _mm256_set1_epi32( 0x9D2C5680 ) ) );
+                }
+
+                // every round fixes 11 more bits
+                a = b;
+
+                for( size_t round = 0; round < 2; ++round ) {
+                    b = _mm256_xor_si256( a, _mm256_srli_epi32( b, 11 ) );
+                }
+
+                _mm256_storeu_si256( reinterpret_cast<__m256i*>( out + i ), b );
+            }
+
+            return i;
+        }
+
     private:
+        //! up to this many twists jump() just twists, about the cost of the polynomial power
+        static const uint64_t jumpTwists = 1 << 14;
         size_t pos = size;
         State state;
 };
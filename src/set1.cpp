@@ -32,6 +32,11 @@ void challenge1_2() {
     std::string expected = "746865206b696420646f6e277420706c6179";
     std::string calculated = crypto::XOR( first, second );
     CHECK_EQ( expected, calculated );
+
+    // in place
+    Bytes data = converter::hexToBinary( first );
+    crypto::XOR( data, converter::hexToBinary( second ), data.data() );
+    CHECK_EQ( converter::binaryToHex( data ), expected );
 }
 
 void challenge1_3() {
@@ -122,15 +127,15 @@ void challenge1_6() {
     // e.g. the Millikan way of science ;) (https://hsm.stackexchange.com/a/2759)
     float normFactor = 1.20f;
 
-    for( int i = 2; i < 40; ++i ) {
-        Bytes first  = Bytes( text.cbegin() + 0 * i, text.cbegin() + 1 * i );
-        Bytes second = Bytes( text.cbegin() + 1 * i, text.cbegin() + 2 * i );
-        Bytes third  = Bytes( text.cbegin() + 2 * i, text.cbegin() + 3 * i );
-        Bytes fourth = Bytes( text.cbegin() + 3 * i, text.cbegin() + 4 * i );
+    for( size_t i = 2; i < 40; ++i ) {
+        ByteView first  = ByteView( text ).subspan( 0 * i, i );
+        ByteView second = ByteView( text ).subspan( 1 * i, i );
+        ByteView third  = ByteView( text ).subspan( 2 * i, i );
+        ByteView fourth = ByteView( text ).subspan( 3 * i, i );
 
-        size_t hamming1 = utils::hammingDistance<Bytes>( first, second );
-        size_t hamming2 = utils::hammingDistance<Bytes>( second, third );
-        size_t hamming3 = utils::hammingDistance<Bytes>( third, fourth );
+        size_t hamming1 = utils::hammingDistance( first, second );
+        size_t hamming2 = utils::hammingDistance( second, third );
+        size_t hamming3 = utils::hammingDistance( third, fourth );
 
         float normalized = ( float )( hamming1 + hamming2 + hamming3 ) / std::pow( i, normFactor );
 
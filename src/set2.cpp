@@ -4,10 +4,16 @@
 
 #include "utils.hpp"
 #include "crypto.hpp"
+#include "aes.hpp"
+#include "random.hpp"
 #include "cracker.hpp"
 #include "converter.hpp"
 #include "log.hpp"
 
+#ifdef WITH_OPENSSL
+#include "openssl.hpp"
+#endif
+
 void challenge2_9() {
     std::string text = "YELLOW SUBMARINE";
 
@@ -52,6 +58,122 @@ void challenge2_10() {
         CHECK_EQ( vPlain, decrypted );
     }
 
+    // streaming in uneven chunks gives the same result as one shot
+    {
+        auto stream = []( crypto::CipherStream && cipher, const Bytes & data, const size_t & chunk ) {
+            Bytes rv;
+
+            for( size_t i = 0; i < data.size(); i += chunk ) {
+                Bytes part( data.cbegin() + i, data.cbegin() + std::min( i + chunk, data.size() ) );
+                Bytes out = cipher.update( part );
+                rv.insert( rv.end(), out.cbegin(), out.cend() );
+            }
+
+            Bytes out = cipher.final();
+            rv.insert( rv.end(), out.cbegin(), out.cend() );
+            return rv;
+        };
+
+        crypto::AesKey128 aesKey( vkey.data() );
+        Bytes ecb = crypto::encryptAES128ECB( vPlain, vkey );
+        Bytes cbc = crypto::encryptAES128CBC( vPlain, vkey, viv );
+
+        for( size_t chunk : { 1, 7, 16, 33, 100 } ) {
+            CHECK_EQ( stream( crypto::ECBEncryptor( aesKey ), vPlain, chunk ), ecb );
+            CHECK_EQ( stream( crypto::ECBDecryptor( aesKey ), ecb, chunk ), vPlain );
+            CHECK_EQ( stream( crypto::CBCEncryptor( aesKey, viv ), vPlain, chunk ), cbc );
+            CHECK_EQ( stream( crypto::CBCDecryptor( aesKey, viv ), cbc, chunk ), vPlain );
+        }
+
+        CHECK_THROW( stream( crypto::CBCDecryptor( aesKey, viv ), Bytes( cbc.cbegin(), cbc.cend() - 1 ), 16 ) );
+    }
+
+    // in place into a caller provided buffer
+    {
+        crypto::AesKey128 aesKey( vkey.data() );
+        Bytes buffer( crypto::paddedSize( vPlain.size() ) );
+        std::copy( vPlain.cbegin(), vPlain.cend(), buffer.begin() );
+
+        size_t encrypted = crypto::encryptAES128CBC( ByteView( buffer.data(), vPlain.size() ), aesKey, viv, buffer.data() );
+        CHECK_EQ( buffer, crypto::encryptAES128CBC( vPlain, vkey, viv ) );
+        size_t decrypted = crypto::decryptAES128CBC( ByteView( buffer.data(), encrypted ), aesKey, viv, buffer.data() );
+        CHECK_EQ( Bytes( buffer.cbegin(), buffer.cbegin() + decrypted ), vPlain );
+
+        std::copy( vPlain.cbegin(), vPlain.cend(), buffer.begin() );
+        encrypted = crypto::encryptAES128ECB( ByteView( buffer.data(), vPlain.size() ), aesKey, buffer.data() );
+        CHECK_EQ( buffer, crypto::encryptAES128ECB( vPlain, vkey ) );
+        decrypted = crypto::decryptAES128ECB( ByteView( buffer.data(), encrypted ), aesKey, buffer.data() );
+        CHECK_EQ( Bytes( buffer.cbegin(), buffer.cbegin() + decrypted ), vPlain );
+    }
+
+    // every AES backend this machine supports gives the same results, long enough for the wide kernels
+    {
+        crypto::AesKey128 aesKey( vkey.data() );
+        Bytes big;
+
+        for( size_t i = 0; i < 83; ++i ) {
+            big.insert( big.end(), vPlain.cbegin(), vPlain.cend() );
+        }
+
+        aes::Backend initial = aes::backend();
+        Bytes ecb, cbc, ctr;
+
+        for( aes::Backend backend : aes::supportedBackends() ) {
+            CHECK( aes::setBackend( backend ) );
+
+            Bytes ecb2 = crypto::encryptAES128ECB( big, aesKey );
+            Bytes cbc2 = crypto::encryptAES128CBC( big, aesKey, viv );
+            Bytes ctr2 = crypto::encryptAES128CTR( big, aesKey, 42 );
+
+            if( ecb.empty() ) {
+                ecb = ecb2;
+                cbc = cbc2;
+                ctr = ctr2;
+            }
+
+            CHECK_EQ( ecb2, ecb );
+            CHECK_EQ( cbc2, cbc );
+            CHECK_EQ( ctr2, ctr );
+            CHECK_EQ( crypto::decryptAES128ECB( ecb2, aesKey ), big );
+            CHECK_EQ( crypto::decryptAES128CBC( cbc2, aesKey, viv ), big );
+            CHECK_EQ( crypto::decryptAES128CTR( ctr2, aesKey, 42 ), big );
+        }
+
+        aes::setBackend( initial );
+    }
+
+#ifdef WITH_OPENSSL
+    // the cached EVP contexts against aesni, alternating keys force the key schedule to be redone
+    if( aes::isSupported( aes::Backend::AesNi ) ) {
+        std::vector<crypto::AesKey128> keys = { crypto::AesKey128( vkey.data() ), crypto::AesKey128( crypto::genKey().data() ) };
+
+        for( size_t i = 0; i < 20; ++i ) {
+            const crypto::AesKey128& key = keys[i % 3 % 2];
+            Bytes plain = randombuffer::get( crypto::blockSize * crypto::randSize( 0, 300 ) );
+            Bytes iv = crypto::genKey();
+            Bytes expected( plain.size() + crypto::blockSize );
+            Bytes actual( plain.size() + crypto::blockSize );
+
+            aesni::encryptAES128ECB( plain.data(), expected.data(), plain.size(), key );
+            openssl::encryptAES128ECB( plain.data(), actual.data(), plain.size(), key );
+            CHECK_EQ( actual, expected );
+            CHECK_EQ( openssl::decryptAES128ECB( actual.data(), actual.data(), plain.size(), key ), plain.size() );
+            CHECK( std::equal( plain.cbegin(), plain.cend(), actual.cbegin() ) );
+
+            aesni::encryptAES128CBC( plain.data(), expected.data(), plain.size(), key, iv.data() );
+            openssl::encryptAES128CBC( plain.data(), actual.data(), plain.size(), key, iv.data() );
+            CHECK_EQ( actual, expected );
+            openssl::decryptAES128CBC( actual.data(), actual.data(), plain.size(), key, iv.data() );
+            CHECK( std::equal( plain.cbegin(), plain.cend(), actual.cbegin() ) );
+
+            size_t odd = plain.size() - std::min<size_t>( plain.size(), i );
+            aesni::cryptAES128CTR( plain.data(), expected.data(), odd, key, i, i << 40 );
+            openssl::cryptAES128CTR( plain.data(), actual.data(), odd, key, i, i << 40 );
+            CHECK( std::equal( actual.cbegin(), actual.cbegin() + odd, expected.cbegin() ) );
+        }
+    }
+#endif
+
     // challenge itself
     {
         // base64 -d 2_10.txt | openssl enc -d -aes-128-cbc -K "$(echo -n 'YELLOW SUBMARINE' | xxd -p)" -iv "00000000000000000000000000000000"
@@ -116,17 +238,27 @@ void challenge2_12() {
 
     size_t guessed = 0;
 
+    // all candidates for one byte go to the oracle in one batch
+    const crypto::ECBOracle& oracle = crypto::secretSuffixOracle();
+    std::vector<Bytes> candidates( 256 );
+
     // 4,5,6 guess one byte after another
     for( size_t i = 0; i < blocks; ++i ) {
         for( size_t j = 1; j <= guess.blockSize; ++j ) {
 
             // 000000000000000S UFFIX
             Bytes data2( guess.blockSize - j, 0 );
-            Bytes enc1 = crypto::encryptECBWithSecretSuffix( data2 );
+            Bytes enc1 = oracle.encrypt( data2 );
+
+            for( size_t sec = 0; sec < candidates.size(); ++sec ) {
+                candidates[sec] = data3;
+                candidates[sec].back() = static_cast<uint8_t>( sec );
+            }
+
+            std::vector<Bytes> encrypted = oracle.encrypt( candidates );
 
-            for( uint8_t sec = 0; sec != std::numeric_limits<uint8_t>::max(); ++sec ) {
-                data3.back() = sec;
-                Bytes enc2 = crypto::encryptECBWithSecretSuffix( data3 );
+            for( size_t sec = 0; sec < candidates.size(); ++sec ) {
+                const Bytes& enc2 = encrypted[sec];
 
                 Bytes first1( enc1.cbegin() + guess.blockSize * i, enc1.cbegin() + guess.blockSize * ( i + 1 ) );
                 Bytes first2( enc2.cbegin(), enc2.cbegin() + guess.blockSize );
@@ -135,6 +267,7 @@ void challenge2_12() {
                     // LOG( "[" << ( char )sec << "]" );
                     secret.push_back( ( char )sec );
                     // shift forward
+                    data3 = candidates[sec];
                     std::rotate( data3.begin(), data3.begin() + 1, data3.end() );
                     break;
                 }
@@ -266,17 +399,27 @@ void challenge2_14() {
 
     size_t guessed = 0;
 
+    // all candidates for one byte go to the oracle in one batch
+    const crypto::ECBOracle& oracle = crypto::randomPrefixAndSecretSuffixOracle();
+    std::vector<Bytes> candidates( 256 );
+
     // guess one byte after another
     for( size_t i = 0; i < blocks; ++i ) {
         for( size_t j = 1; j <= guess.blockSize; ++j ) {
 
             // PREFIX0000000000 000000000000000S UFFIX
             Bytes data2( rest + guess.blockSize - j, 0 );
-            Bytes enc1 = crypto::encryptECBWithRandomPrefixAndSecretSuffix( data2 );
+            Bytes enc1 = oracle.encrypt( data2 );
+
+            for( size_t sec = 0; sec < candidates.size(); ++sec ) {
+                candidates[sec] = data3;
+                candidates[sec].back() = static_cast<uint8_t>( sec );
+            }
+
+            std::vector<Bytes> encrypted = oracle.encrypt( candidates );
 
-            for( uint8_t sec = 0; sec != std::numeric_limits<uint8_t>::max(); ++sec ) {
-                data3.back() = sec;
-                Bytes enc2 = crypto::encryptECBWithRandomPrefixAndSecretSuffix( data3 );
+            for( size_t sec = 0; sec < candidates.size(); ++sec ) {
+                const Bytes& enc2 = encrypted[sec];
 
                 Bytes first1( enc1.cbegin() + guess.blockSize * ( offset + i + 0 ),
                               enc1.cbegin() + guess.blockSize * ( offset + i + 1 ) );
@@ -287,6 +430,7 @@ void challenge2_14() {
                     // LOG( "[" << ( char )sec << "]" );
                     secret.push_back( ( char )sec );
                     // shift forward
+                    data3 = candidates[sec];
                     std::rotate( data3.begin(), data3.begin() + 1, data3.end() );
                     break;
                 }
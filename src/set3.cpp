@@ -1,7 +1,9 @@
 #include "set3.hpp"
 #include "random.hpp"
 #include "crypto.hpp"
+#include "cracker.hpp"
 #include "converter.hpp"
+#include "ghash.hpp"
 #include "threadpool.hpp"
 
 #include <vector>
@@ -196,6 +198,49 @@ void challenge3_18() {
 
     Bytes reencrypted = crypto::encryptAES128CTR( vdecrypted, vkey, 0 );
     CHECK_EQ( reencrypted, encrypted );
+
+    // streaming in uneven chunks
+    for( size_t chunk : { 1, 5, 16, 17 } ) {
+        crypto::CTRDecryptor decryptor( crypto::AesKey128( vkey.data() ), 0 );
+        Bytes streamed;
+
+        for( size_t i = 0; i < encrypted.size(); i += chunk ) {
+            Bytes part( encrypted.cbegin() + i, encrypted.cbegin() + std::min( i + chunk, encrypted.size() ) );
+            Bytes out = decryptor.update( part );
+            streamed.insert( streamed.end(), out.cbegin(), out.cend() );
+        }
+
+        CHECK( decryptor.final().empty() );
+        CHECK_EQ( streamed, vdecrypted );
+    }
+
+    // GCM on top of the CTR keystream, test case 4 of the GCM specification
+    crypto::AesKey128 gcmKey( converter::hexToBinary( "feffe9928665731c6d6a8f9467308308" ).data() );
+    Bytes iv = converter::hexToBinary( "cafebabefacedbaddecaf888" );
+    Bytes aad = converter::hexToBinary( "feedfacedeadbeeffeedfacedeadbeefabaddad2" );
+    Bytes plain = converter::hexToBinary( "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+                                          "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39" );
+    Bytes sealed = crypto::encryptAES128GCM( plain, gcmKey, iv, aad );
+    CHECK_EQ( converter::binaryToHex( sealed ), "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+              "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091"
+              "5bc94fbc3221a5db94fae95ae7121a47" );
+    CHECK_EQ( crypto::decryptAES128GCM( sealed, gcmKey, iv, aad ), plain );
+
+    sealed[3] ^= 1;
+    CHECK_THROW( crypto::decryptAES128GCM( sealed, gcmKey, iv, aad ) );
+    sealed[3] ^= 1;
+    CHECK_THROW( crypto::decryptAES128GCM( sealed, gcmKey, iv, {} ) );
+
+    // the aggregated carry-less GHASH against the bitwise one
+    if( cpu::features().pclmul && cpu::features().ssse3 ) {
+        ghash::Key hashKey( iv.data() );
+        Bytes data = randombuffer::get( 1000 );
+        uint8_t software[ghash::blockSize] = {};
+        uint8_t clmul[ghash::blockSize] = {};
+        ghash::updateSoftware( software, data.data(), data.size(), hashKey );
+        ghash::updateClmul( clmul, data.data(), data.size(), hashKey );
+        CHECK( std::equal( software, software + ghash::blockSize, clmul ) );
+    }
 }
 
 std::tuple<std::vector<Bytes>, std::vector<Bytes>> encryptedStrings( const std::string& filename ) {
@@ -370,6 +415,17 @@ void challenge3_21() {
     for( size_t i = 0; i < 2000; ++i ) {
         CHECK_EQ( mersenne.get(), gen() );
     }
+
+    // bulk output across twists, continuing the same sequence
+    std::vector<uint32_t> bulk( 3000 );
+
+    for( size_t count : { 1, 623, 624, 1000 } ) {
+        mersenne.fill( bulk.data(), count );
+
+        for( size_t i = 0; i < count; ++i ) {
+            CHECK_EQ( bulk[i], gen() );
+        }
+    }
 }
 
 void challenge3_22() {
@@ -394,14 +450,32 @@ void challenge3_22() {
         uint32_t first = secret.get();
 
         // map first rng output to seed
-        std::map<uint32_t, uint32_t> lookup;
+        cracker::SeedIndex index( t, t + 1000 );
+        std::vector<uint32_t> seeds = index.seeds( first );
+        CHECK_EQ( seeds.size(), 1 );
+        CHECK_EQ( t2, seeds.empty() ? 0 : seeds.front() );
+
+        // the same from the file, and batched against single lookups
+        std::string filename = "seeds.idx";
+        CHECK( index.save( filename ) );
+        cracker::SeedIndex mapped( filename );
+        CHECK_EQ( mapped.size(), 1001 );
+        CHECK( mapped.seeds( first ) == seeds );
+
+        std::vector<uint32_t> outputs;
+
+        for( size_t i = 0; i < 100; ++i ) {
+            outputs.push_back( i % 2 ? Mersenne( t + randomnumber::get( 1001 ) ).get() : randomnumber::get() );
+        }
 
-        for( size_t i = 0; i < 1000; ++i ) {
-            Mersenne mersenne( t + i );
-            lookup.emplace( mersenne.get(), t + i );
+        std::vector<std::vector<uint32_t>> batch = mapped.seeds( outputs );
+
+        for( size_t i = 0; i < outputs.size(); ++i ) {
+            CHECK( batch[i] == index.seeds( outputs[i] ) );
+            CHECK( i % 2 == 0 || batch[i].size() == 1 );
         }
 
-        CHECK_EQ( t2, lookup[first] );
+        std::remove( filename.c_str() );
     }
 }
 
@@ -412,6 +486,19 @@ void challenge3_23() {
     CHECK( r != s );
     CHECK_EQ( r, r2 );
 
+    {
+        // bulk versions against the single word ones
+        std::vector<uint32_t> words( 1000 ), scrambled( words.size() ), unscrambled( words.size() );
+        std::generate( words.begin(), words.end(), [] { return randomnumber::get(); } );
+        Mersenne::scramble( words.data(), scrambled.data(), words.size() );
+        Mersenne::unscramble( scrambled.data(), unscrambled.data(), words.size() );
+        CHECK( unscrambled == words );
+
+        for( size_t i = 0; i < words.size(); ++i ) {
+            CHECK_EQ( scrambled[i], Mersenne::scramble( words[i] ) );
+        }
+    }
+
     Mersenne original( 18748 );
 
     // drop between 100..200 first outputs
@@ -423,10 +510,8 @@ void challenge3_23() {
 
     // feed copy with 624 random numbers to copy internal state
     Mersenne::Init init;
-
-    for( auto& num : init ) {
-        num = Mersenne::unscramble( original.get() );
-    }
+    original.fill( init.data(), init.size() );
+    Mersenne::unscramble( init.data(), init.data(), init.size() );
 
     Mersenne copy( init );
 
@@ -437,6 +522,49 @@ void challenge3_23() {
         CHECK_EQ( a, b );
     }
 
+    // jumps against single steps, short ones twist, far ones use the polynomial
+    for( uint64_t steps : { 0, 1, 623, 624, 625, 5000, 20 * 1000 * 1000 } ) {
+        Mersenne stepped( 1234 );
+        Mersenne jumped( 1234 );
+        stepped.get();
+        jumped.get();
+
+        std::vector<uint32_t> skipped( 1 << 20 );
+
+        for( uint64_t done = 0; done < steps; done += skipped.size() ) {
+            stepped.fill( skipped.data(), std::min<uint64_t>( skipped.size(), steps - done ) );
+        }
+
+        jumped.jump( steps );
+
+        for( size_t i = 0; i < 1000; ++i ) {
+            CHECK_EQ( stepped.get(), jumped.get() );
+        }
+    }
+
+    // clone from outputs at a known offset to earlier and later outputs
+    {
+        Mersenne reference( 4711 );
+        std::vector<uint32_t> outputs( 100000 );
+        reference.fill( outputs.data(), outputs.size() );
+        const uint64_t offset = 50000;
+
+        for( uint64_t target : { 0, 1000, 50000, 60000 } ) {
+            Mersenne cloned = Mersenne::clone( &outputs[offset], offset, target );
+
+            for( size_t i = 0; i < 100; ++i ) {
+                CHECK_EQ( cloned.get(), outputs[target + i] );
+            }
+        }
+
+        const uint64_t far = 1ull << 40;
+        Mersenne cloned = Mersenne::clone( &outputs[offset], offset, far );
+        reference.jump( far - outputs.size() );
+
+        for( size_t i = 0; i < 100; ++i ) {
+            CHECK_EQ( cloned.get(), reference.get() );
+        }
+    }
 }
 
 void challenge3_24() {
@@ -448,6 +576,22 @@ void challenge3_24() {
         Bytes decrypted = crypto::decryptMersenneCTR( encrypted, key );
 
         CHECK_EQ( clear, decrypted );
+
+        // longer than one twist and in place, against the generator word by word
+        Bytes big = randombuffer::get( 10001 );
+        Bytes inplace = big;
+        crypto::cryptMersenneCTR( inplace, key, inplace.data() );
+        Mersenne mersenne( key );
+
+        for( size_t i = 0; i < big.size(); i += sizeof( uint32_t ) ) {
+            uint32_t r = mersenne.get();
+
+            for( size_t j = 0; j < sizeof( uint32_t ) && i + j < big.size(); ++j ) {
+                big[i + j] ^= static_cast<uint8_t>( r >> ( 8 * j ) );
+            }
+        }
+
+        CHECK_EQ( inplace, big );
     }
 
     // guess mersenne seed by iterating all 16 bit values
@@ -457,43 +601,70 @@ void challenge3_24() {
         Bytes encrypted = crypto::encryptMersenneCTR( clear, key );
         Bytes encryptedSuffix( encrypted.cend() - suffix.size(), encrypted.cend() );
 
-        Bytes tmp = randombuffer::get( encrypted.size() - suffix.size() ) + suffix;
-        CHECK_EQ( clear.size(), tmp.size() );
-
-        uint16_t guess = 0;
-        uint16_t iter = 0;
-        {
-            Threadpool pool;
-            bool found = false;
-
-            // tmp and clear are the same length and end both with the same bytes if encrypted with the same key
-            // -> just try all keys
-            while( --iter ) {
-                pool.add( [iter, &guess, &found, &tmp, &suffix, &encryptedSuffix] {
-                    if( !found ) {
-                        Bytes encrypted2 = crypto::encryptMersenneCTR( tmp, iter );
-                        Bytes encryptedSuffix2( encrypted2.cend() - suffix.size(), encrypted2.cend() );
-
-                        if( encryptedSuffix == encryptedSuffix2 ) {
-                            found = true;
-                            guess = iter;
-                            LOG( "Guessed key is " << guess );
-                        }
-                    }
-                } );
-            }
-        }
+        // the known suffix reveals the keystream at its end -> outputs of Mersenne( key ) to check the seeds against
+        std::vector<cracker::KnownOutput> known = cracker::knownOutputs( clear.size() - suffix.size(), crypto::XOR( encryptedSuffix, suffix ) );
+        std::optional<uint32_t> guess = cracker::findMersenneSeed( known, 0, 0xffff );
+        CHECK( guess );
+        CHECK_EQ( key, guess.value_or( 0 ) );
+    }
+
+    // the same for 32 bit seeds, a 2^20 window of them
+    {
+        uint32_t seed = randomnumber::get();
+        const uint32_t window = 1 << 20;
+        // kept below 2^32 - window, so the last seed doesn't wrap around
+        uint32_t first = std::min( seed - std::min( seed, randomnumber::get( window ) ), 0xffffffff - ( window - 1 ) );
+        Mersenne mersenne( seed );
+        std::vector<uint32_t> outputs( Mersenne::size - 1 );
+        mersenne.fill( outputs.data(), outputs.size() );
 
-        CHECK_EQ( key, guess );
+        // words of all three twist ranges, one only partially known
+        std::vector<cracker::KnownOutput> known = { { 100, outputs[100] }, { 400, outputs[400] }, { 600, outputs[600], 0xff00ff00 } };
+        std::optional<uint32_t> guess = cracker::findMersenneSeed( known, first, first + ( window - 1 ) );
+        CHECK( guess );
+        CHECK_EQ( seed, guess.value_or( 0 ) );
+
+        std::atomic_bool cancel = true;
+        CHECK( !cracker::findMersenneSeed( known, 0, 0xffffffff, &cancel ) );
     }
 
-    // sub exercise: check, if a mersenne generated token is a mersenne generated token
-    // ???
+    // sub exercise: check, if a token is the output of a mersenne seeded with a timestamp of the last day
     {
+        const size_t tokenWords = 4;
         uint32_t t = std::time( nullptr );
-        Bytes empty( 18 ); // 144 bit token
-        std::string token = converter::binaryToBase64( crypto::encryptMersenneCTR( empty, t ) );
-        std::string token2 = converter::binaryToBase64( crypto::encryptMersenneCTR( empty, t ) );
-        CHECK_EQ( token, token2 );
+        auto token = []( const uint32_t& seed ) {
+            Mersenne mersenne( seed );
+            Bytes token( tokenWords * sizeof( uint32_t ) );
+            std::vector<uint32_t> words( tokenWords );
+            mersenne.fill( words.data(), words.size() );
+            std::memcpy( token.data(), words.data(), token.size() );
+            return token;
+        };
+
+        cracker::SeedIndex index( t - 24 * 60 * 60, t );
+        std::vector<Bytes> tokens;
+
+        for( size_t i = 0; i < 100; ++i ) {
+            tokens.push_back( i % 2 ? token( t - randomnumber::get( 24 * 60 * 60 ) ) : randombuffer::get( tokenWords * sizeof( uint32_t ) ) );
+        }
+
+        // the first word finds the candidate seeds, the whole token confirms them
+        std::vector<uint32_t> firsts;
+
+        for( const Bytes& candidate : tokens ) {
+            uint32_t first = 0;
+            std::memcpy( &first, candidate.data(), sizeof( first ) );
+            firsts.push_back( first );
+        }
+
+        std::vector<std::vector<uint32_t>> seeds = index.seeds( firsts );
+
+        for( size_t i = 0; i < tokens.size(); ++i ) {
+            bool generated = std::any_of( seeds[i].begin(), seeds[i].end(), [&]( const uint32_t& seed ) {
+                return token( seed ) == tokens[i];
+            } );
+            bool expected = i % 2 == 1;
+            CHECK_EQ( generated, expected );
+        }
     }
 }
@@ -2,11 +2,14 @@
 
 #include <fstream>
 
+#include "cpu.hpp"
+#include "cracker.hpp"
 #include "utils.hpp"
 #include "crypto.hpp"
 #include "random.hpp"
 #include "converter.hpp"
 #include "hash.hpp"
+#include "hashbatch.hpp"
 #include "log.hpp"
 #include "http.hpp"
 #include "stopwatch.hpp"
@@ -39,6 +42,18 @@ void testReplacement() {
 
     Bytes expected( bytes( "Testing hase replacement" ) );
     CHECK_EQ( decrypted, expected );
+
+    // random access, edits in place
+    crypto::CTRStream stream( encrypted, crypto::AesKey128( key.data() ), nonce );
+    CHECK_EQ( stream.read( 8, 4 ), bytes( "text" ) );
+    CHECK( stream.edit( 8, bytes( "hase" ) ) );
+    CHECK_EQ( encrypted, edited );
+    CHECK( stream.seek( 13 ) );
+    CHECK( stream.write( bytes( "REPLACE" ) ) );
+    CHECK_EQ( stream.tell(), 20 );
+    CHECK( stream.seek( 0 ) );
+    CHECK_EQ( stream.read( 100 ), bytes( "Testing hase REPLACEment" ) );
+    CHECK( !stream.edit( 20, bytes( "hasen" ) ) );
 }
 
 void challenge4_25() {
@@ -186,6 +201,9 @@ void challenge4_28() {
     std::map<std::string, std::string> hashes = {
         {"", "da39a3ee5e6b4b0d3255bfef95601890afd80709"},
         {"Hallo", "59d9a6df06b9f610f7db8e036896ed03662d168f"},
+        {std::string( 55, 'A' ), "5021b3d42aa093bffc34eedd7a1455f3624bc552"},
+        {std::string( 56, 'A' ), "6b45e3cf1eb3324b9fd4df3b83d89c4c2c4ca896"},
+        {std::string( 64, 'A' ), "30b86e44e6001403827a62c58b08893e77cf121f"},
         {std::string( 127, 'A' ), "8c8393ac8939430753d7cb568e2f2237bc62d683"},
     };
 
@@ -193,6 +211,41 @@ void challenge4_28() {
         Bytes data = bytes( hash.first );
         Bytes sha1 = hash::sha1( data );
         CHECK_EQ( converter::binaryToHex( sha1 ), hash.second );
+
+        // into a caller provided buffer
+        uint8_t digest[20];
+        char hex[40];
+        hash::sha1( data, digest );
+        CHECK_EQ( std::string( hex, converter::binaryToHex( ByteView( digest ), hex ) ), hash.second );
+    }
+
+    // streaming in random pieces against hashing at once
+    for( size_t size : { 0, 55, 56, 64, 1000 } ) {
+        Bytes data = randombuffer::get( size );
+        Bytes digest( hash::Sha1Ctx::digestSize );
+        hash::Sha1Ctx ctx;
+
+        for( size_t done = 0; done < size; ) {
+            size_t piece = std::min<size_t>( randomnumber::get( 100 ), size - done );
+            ctx.update( ByteView( data ).subspan( done, piece ) );
+            done += piece;
+        }
+
+        ctx.final( digest.data() );
+        CHECK_EQ( digest, hash::sha1( data ) );
+    }
+
+    // the SHA extensions against the unrolled fallback, over runs of blocks
+    if( cpu::features().sha && cpu::features().sse41 ) {
+        Bytes blocks = randombuffer::get( 64 * 5 );
+
+        for( size_t count = 0; count <= 5; ++count ) {
+            hash::Magic<5> scalar = hash::SHA1_MAGICS;
+            hash::Magic<5> shaNi = hash::SHA1_MAGICS;
+            hash::sha1BlocksScalar( scalar, blocks.data(), count );
+            hash::sha1BlocksShaNi( shaNi, blocks.data(), count );
+            CHECK( scalar == shaNi );
+        }
     }
 
     // generate sha1 MAC
@@ -201,24 +254,48 @@ void challenge4_28() {
     Bytes mac = crypto::macSha1( message, key );
 
     // flip every bit of the message and verify its MAC changed
-    for( size_t i = 0; i < 800; ++i ) {
-        size_t pos = i / 8;
-        uint8_t flip = 1 << i % 8;
+    std::vector<Bytes> flipped( 800, message );
 
-        message[pos] ^= flip;
-        Bytes newMac = crypto::macSha1( message, key );
-        CHECK_NE( newMac, mac );
+    for( size_t i = 0; i < flipped.size(); ++i ) {
+        flipped[i][i / 8] ^= 1 << i % 8;
+    }
+
+    std::vector<Bytes> flippedMacs = crypto::macSha1( flipped, key );
 
-        // restore original message
-        message[pos] ^= flip;
+    for( size_t i = 0; i < flipped.size(); ++i ) {
+        CHECK_NE( flippedMacs[i], mac );
     }
 
+    CHECK_EQ( flippedMacs[799], crypto::macSha1( flipped[799], key ) );
+
     // verify, that a random generated key cannot generate the same MAC
-    for( size_t i = 0; i < 1000; ++i ) {
-        Bytes newKey = crypto::genKey();
-        Bytes newMac = crypto::macSha1( message, newKey );
+    std::vector<Bytes> keys( 1000 );
+    std::generate( keys.begin(), keys.end(), crypto::genKey );
+
+    for( const Bytes& newMac : crypto::macSha1( message, keys ) ) {
         CHECK_NE( newMac, mac );
     }
+
+    // empty batches give no MACs
+    CHECK( crypto::macSha1( std::vector<Bytes>{}, key ).empty() );
+    CHECK( crypto::macSha1( message, std::vector<Bytes>{} ).empty() );
+    CHECK( crypto::macMd4( std::vector<Bytes>{}, key ).empty() );
+    CHECK( crypto::macMd4( message, std::vector<Bytes>{} ).empty() );
+
+    // side by side against one at a time, for lengths around the block and padding boundaries
+    std::vector<Bytes> messages;
+
+    for( size_t size = 0; size < 200; ++size ) {
+        messages.push_back( randombuffer::get( size ) );
+    }
+
+    std::vector<Bytes> digests = hash::sha1Batch( messages );
+    std::vector<Bytes> extended = hash::sha1Batch( messages, hash::shaToMagics<Bytes, 5, true>( mac ), 64 );
+
+    for( size_t i = 0; i < messages.size(); ++i ) {
+        CHECK_EQ( digests[i], hash::sha1( messages[i] ) );
+        CHECK_EQ( extended[i], hash::sha1( messages[i], hash::shaToMagics<Bytes, 5, true>( mac ), 64 ) );
+    }
 }
 
 void challenge4_29() {
@@ -228,34 +305,58 @@ void challenge4_29() {
     Bytes mac = crypto::macSha1( message, key );
     LOG( "ORIG   : " << converter::binaryToHex( mac ) );
 
-    // size of message + key is at least size of message
-    size_t guess = message.size();
+    hash::Magic<5> magic = hash::shaToMagics<Bytes, 5, true>( mac );
+    Bytes sha = hash::magicsToSha<Bytes, 5, true>( magic );
+    CHECK_EQ( mac, sha );
 
-    for( ; guess < 1000; ++guess ) {
+    // the server checks a whole batch of forgeries with its key, side by side
+    using Extension = cracker::LengthExtension<hash::Sha1Ctx>;
+    auto server = [&key]( const std::vector<Extension::Forgery>& forgeries ) -> std::optional<size_t> {
+        std::vector<Bytes> messages;
 
-        Bytes padding = hash::sha1MDPadding<Bytes, true>( guess );
-        Bytes attack = message + padding + suffix;
-        Bytes server = crypto::macSha1( attack, key );
+        for( const Extension::Forgery& forgery : forgeries ) {
+            messages.push_back( forgery.message );
+        }
 
-        hash::Magic<5> magic = hash::shaToMagics<Bytes, 5, true>( mac );
-        Bytes sha = hash::magicsToSha<Bytes, 5, true>( magic );
-        CHECK_EQ( mac, sha );
+        std::vector<Bytes> macs = crypto::macSha1( messages, key );
 
-        Bytes fakeKey( guess - message.size(), 0 );
-        size_t hashedSize = guess + padding.size();
-        CHECK( ( hashedSize % 64 ) == 0 );
-        Bytes forged = hash::sha1( fakeKey + attack, magic, hashedSize );
-
-        if( forged == server ) {
-            // we found a message, the server will accept
-            LOG( "GUESS  : " << guess );
-            LOG( "ORIG+  : " << converter::binaryToHex( server ) );
-            LOG( "FORGED : " << converter::binaryToHex( forged ) );
-            break;
+        for( size_t i = 0; i < forgeries.size(); ++i ) {
+            if( macs[i] == forgeries[i].mac ) {
+                return i;
+            }
         }
+
+        return {};
+    };
+
+    // key lengths up to 1000 bytes, a forged MAC per glue alignment
+    Extension extension( message, mac, suffix );
+    std::optional<Extension::Forgery> forgery = extension.forge( 0, 1000, server );
+    CHECK( forgery );
+
+    if( !forgery ) {
+        return;
     }
 
-    CHECK_EQ( guess, key.size() + message.size() );
+    // we found a message, the server will accept
+    LOG( "GUESS  : " << forgery->keyLength );
+    LOG( "FORGED : " << converter::binaryToHex( forgery->mac ) );
+    CHECK_EQ( forgery->keyLength, key.size() );
+    CHECK_EQ( forgery->mac, crypto::macSha1( forgery->message, key ) );
+    CHECK( extension.finished() <= 2 );
+
+    // against hashing the whole forged message from the restored state, with a suffix of whole blocks too
+    Bytes longSuffix = randombuffer::get( 150 );
+    Extension longExtension( message, mac, longSuffix );
+
+    for( size_t keyLength : { 0, 16, 42, 43, 100 } ) {
+        Bytes padding = hash::sha1MDPadding<Bytes, true>( keyLength + message.size() );
+        size_t hashedSize = keyLength + message.size() + padding.size();
+        CHECK( ( hashedSize % 64 ) == 0 );
+        Bytes fakeKey( keyLength, 0 );
+        Bytes forged = hash::sha1( fakeKey + message + padding + longSuffix, magic, hashedSize );
+        CHECK_EQ( longExtension.forge( keyLength ).mac, forged );
+    }
 }
 
 void challenge4_30() {
@@ -270,6 +371,30 @@ void challenge4_30() {
         Bytes data = bytes( hash.first );
         Bytes md4 = hash::md4( data );
         CHECK_EQ( converter::binaryToHex( md4 ), hash.second );
+
+        // the same streamed byte by byte
+        Bytes digest( hash::Md4Ctx::digestSize );
+        hash::Md4Ctx ctx;
+
+        for( size_t i = 0; i < data.size(); ++i ) {
+            ctx.update( ByteView( data ).subspan( i, 1 ) );
+        }
+
+        ctx.final( digest.data() );
+        CHECK_EQ( digest, md4 );
+    }
+
+    // side by side against one at a time
+    std::vector<Bytes> messages;
+
+    for( size_t size = 0; size < 200; ++size ) {
+        messages.push_back( randombuffer::get( size ) );
+    }
+
+    std::vector<Bytes> digests = hash::md4Batch( messages );
+
+    for( size_t i = 0; i < messages.size(); ++i ) {
+        CHECK_EQ( digests[i], hash::md4( messages[i] ) );
     }
 
     // extend hash
@@ -279,34 +404,58 @@ void challenge4_30() {
     Bytes mac = crypto::macMd4( message, key );
     LOG( "ORIG   : " << converter::binaryToHex( mac ) );
 
-    // size of message + key is at least size of message
-    size_t guess = message.size();
+    hash::Magic<4> magic = hash::shaToMagics<Bytes, 4, false>( mac );
+    Bytes sha = hash::magicsToSha<Bytes, 4, false>( magic );
+    CHECK_EQ( mac, sha );
 
-    for( ; guess < 1000; ++guess ) {
+    // the server checks a whole batch of forgeries with its key, side by side
+    using Extension = cracker::LengthExtension<hash::Md4Ctx>;
+    auto server = [&key]( const std::vector<Extension::Forgery>& forgeries ) -> std::optional<size_t> {
+        std::vector<Bytes> messages;
 
-        Bytes padding = hash::sha1MDPadding<Bytes, false>( guess );
-        Bytes attack = message + padding + suffix;
-        Bytes server = crypto::macMd4( attack, key );
+        for( const Extension::Forgery& forgery : forgeries ) {
+            messages.push_back( forgery.message );
+        }
 
-        hash::Magic<4> magic = hash::shaToMagics<Bytes, 4, false>( mac );
-        Bytes sha = hash::magicsToSha<Bytes, 4, false>( magic );
-        CHECK_EQ( mac, sha );
+        std::vector<Bytes> macs = crypto::macMd4( messages, key );
 
-        Bytes fakeKey( guess - message.size(), 0 );
-        size_t hashedSize = guess + padding.size();
-        CHECK( ( hashedSize % 64 ) == 0 );
-        Bytes forged = hash::md4( fakeKey + attack, magic, hashedSize );
-
-        if( forged == server ) {
-            // we found a message, the server will accept
-            LOG( "GUESS  : " << guess );
-            LOG( "ORIG+  : " << converter::binaryToHex( server ) );
-            LOG( "FORGED : " << converter::binaryToHex( forged ) );
-            break;
+        for( size_t i = 0; i < forgeries.size(); ++i ) {
+            if( macs[i] == forgeries[i].mac ) {
+                return i;
+            }
         }
+
+        return {};
+    };
+
+    // key lengths up to 1000 bytes, a forged MAC per glue alignment
+    Extension extension( message, mac, suffix );
+    std::optional<Extension::Forgery> forgery = extension.forge( 0, 1000, server );
+    CHECK( forgery );
+
+    if( !forgery ) {
+        return;
     }
 
-    CHECK_EQ( guess, key.size() + message.size() );
+    // we found a message, the server will accept
+    LOG( "GUESS  : " << forgery->keyLength );
+    LOG( "FORGED : " << converter::binaryToHex( forgery->mac ) );
+    CHECK_EQ( forgery->keyLength, key.size() );
+    CHECK_EQ( forgery->mac, crypto::macMd4( forgery->message, key ) );
+    CHECK( extension.finished() <= 2 );
+
+    // against hashing the whole forged message from the restored state, with a suffix of whole blocks too
+    Bytes longSuffix = randombuffer::get( 150 );
+    Extension longExtension( message, mac, longSuffix );
+
+    for( size_t keyLength : { 0, 16, 42, 43, 100 } ) {
+        Bytes padding = hash::sha1MDPadding<Bytes, false>( keyLength + message.size() );
+        size_t hashedSize = keyLength + message.size() + padding.size();
+        CHECK( ( hashedSize % 64 ) == 0 );
+        Bytes fakeKey( keyLength, 0 );
+        Bytes forged = hash::md4( fakeKey + message + padding + longSuffix, magic, hashedSize );
+        CHECK_EQ( longExtension.forge( keyLength ).mac, forged );
+    }
 }
 
 // view with
@@ -386,6 +535,31 @@ void challenge4_31() {
         Bytes text( bytes( "Text, which will be hmac'ed" ) );
         Bytes expected = converter::hexToBinary( "ad04d03f084ce2c18ab48ca350c08513ea08caeb" );
         CHECK_EQ( crypto::hmacSha1( text, key ), expected );
+
+        // with the pad states precomputed, streamed in pieces and verified
+        crypto::HmacSha1Key hmacKey( key );
+        CHECK_EQ( hmacKey.mac( text ), expected );
+        CHECK_EQ( hmacKey.mac( Bytes() ), converter::hexToBinary( "9cebf939db4b08d80e783ef95a032f4c37b4d286" ) );
+
+        crypto::HmacSha1Ctx ctx( hmacKey );
+        Bytes streamed( crypto::HmacSha1Key::macSize );
+
+        for( size_t i = 0; i < 2; ++i ) {
+            ctx.update( ByteView( text ).first( 5 ) );
+            ctx.update( ByteView( text ).subspan( 5 ) );
+            ctx.final( streamed.data() );
+            CHECK_EQ( streamed, expected );
+            ctx.init();
+        }
+
+        CHECK( hmacKey.verify( text, expected ) );
+        CHECK( !hmacKey.verify( text, ByteView( expected ).first( 19 ) ) );
+        expected[19] ^= 1;
+        CHECK( !hmacKey.verify( text, expected ) );
+
+        // keys longer than a block are hashed first
+        Bytes longKey( 100, 'K' );
+        CHECK_EQ( crypto::HmacSha1Key( longKey ).mac( text ), converter::hexToBinary( "040a32fa10368001f067fe761ca21e2271af4cfc" ) );
     }
 
     std::string prefix = "http://localhost:9000/test?file=foo&signature=";
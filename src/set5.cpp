@@ -1,8 +1,15 @@
 #include "set5.hpp"
 
+#include <map>
+#include <sstream>
+
 #include "random.hpp"
 #include "utils.hpp"
 #include "bignum.hpp"
+#include "converter.hpp"
+#include "cpu.hpp"
+#include "crypto.hpp"
+#include "hash.hpp"
 
 void challenge5_33() {
     // simple diffie-hellman
@@ -43,6 +50,93 @@ void challenge5_33() {
         BigNum s2 = BigNum::modpow( A, b, p );
 
         CHECK_EQ( s, s2 );
+
+        // both sides derive the same MAC key from the shared secret
+        std::ostringstream secret;
+        std::ostringstream secret2;
+        secret << s;
+        secret2 << s2;
+        Bytes key = hash::sha256( bytes( secret.str() ) );
+        CHECK_EQ( key, hash::sha256( bytes( secret2.str() ) ) );
+        CHECK_EQ( crypto::hmacSha256( bytes( "message" ), key ), crypto::HmacSha256Key( key ).mac( bytes( "message" ) ) );
+    }
+
+    // SHA-256
+    {
+        // python3 -c "import hashlib; print(hashlib.sha256(b'A' * 55).hexdigest())"
+        std::map<std::string, std::string> hashes = {
+            {"", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+            {"abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+            {std::string( 55, 'A' ), "8963cc0afd622cc7574ac2011f93a3059b3d65548a77542a1559e3d202e6ab00"},
+            {std::string( 56, 'A' ), "6ea719cefa4b31862035a7fa606b7cc3602f46231117d135cc7119b3c1412314"},
+            {std::string( 64, 'A' ), "d53eda7a637c99cc7fb566d96e9fa109bf15c478410a3f5eb4d4c4e26cd081f6"},
+            {std::string( 127, 'A' ), "026134f6117e45a37c5c2dc2f330bdd274c6dc087526b91ecec4d6dac9bb7346"},
+            {std::string( 1000, 'A' ), "c2e686823489ced2017f6059b8b239318b6364f6dcd835d0a519105a1eadd6e4"},
+        };
+
+        for( auto&& hash : hashes ) {
+            Bytes data = bytes( hash.first );
+            CHECK_EQ( converter::binaryToHex( hash::sha256( data ) ), hash.second );
+
+            // from the midstate after the whole blocks
+            size_t whole = data.size() / 64 * 64;
+            hash::Sha256Ctx ctx;
+            ctx.update( ByteView( data ).first( whole ) );
+            Bytes resumed = hash::sha256( data, ctx.magics(), whole );
+            CHECK_EQ( converter::binaryToHex( resumed ), hash.second );
+        }
+
+        // the SHA extensions against the fallback, over runs of blocks
+        if( cpu::features().sha && cpu::features().sse41 ) {
+            Bytes blocks = randombuffer::get( 64 * 5 );
+
+            for( size_t count = 0; count <= 5; ++count ) {
+                hash::Magic<8> scalar = hash::SHA256_MAGICS;
+                hash::Magic<8> shaNi = hash::SHA256_MAGICS;
+                hash::sha256BlocksScalar( scalar, blocks.data(), count );
+                hash::sha256BlocksShaNi( shaNi, blocks.data(), count );
+                CHECK( scalar == shaNi );
+            }
+        }
+
+        // length extension of a secret prefix MAC from its digest
+        Bytes key = crypto::genKey();
+        Bytes message = bytes( "user=alice" );
+        Bytes suffix = bytes( ";admin=true" );
+        Bytes mac = hash::sha256( key + message );
+        Bytes glue = hash::sha1MDPadding<Bytes, true>( key.size() + message.size() );
+        size_t hashed = key.size() + message.size() + glue.size();
+        Bytes forged = hash::sha256( Bytes( hashed ) + suffix, hash::shaToMagics<Bytes, 8, true>( mac ), hashed );
+        CHECK_EQ( forged, hash::sha256( key + message + glue + suffix ) );
+    }
+
+    // HMAC-SHA256
+    // https://tools.ietf.org/html/rfc4231
+    {
+        Bytes key( 20, 0x0b );
+        Bytes expected = converter::hexToBinary( "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7" );
+        CHECK_EQ( crypto::hmacSha256( bytes( "Hi There" ), key ), expected );
+
+        crypto::HmacSha256Key jefe( bytes( "Jefe" ) );
+        Bytes text = bytes( "what do ya want for nothing?" );
+        Bytes jefeMac = converter::hexToBinary( "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843" );
+        CHECK_EQ( jefe.mac( text ), jefeMac );
+        CHECK( jefe.verify( text, jefeMac ) );
+        jefeMac[0] ^= 1;
+        CHECK( !jefe.verify( text, jefeMac ) );
+
+        // streamed in pieces
+        crypto::HmacSha256Ctx ctx( jefe );
+        Bytes streamed( crypto::HmacSha256Key::macSize );
+        ctx.update( ByteView( text ).first( 10 ) );
+        ctx.update( ByteView( text ).subspan( 10 ) );
+        ctx.final( streamed.data() );
+        CHECK_EQ( streamed, jefe.mac( text ) );
+
+        // keys longer than a block are hashed first
+        Bytes longKey( 131, 0xaa );
+        Bytes longExpected = converter::hexToBinary( "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54" );
+        CHECK_EQ( crypto::hmacSha256( bytes( "Test Using Larger Than Block-Size Key - Hash Key First" ), longKey ), longExpected );
     }
 
     // BigNum tests
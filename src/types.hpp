@@ -2,10 +2,14 @@
 
 #include <vector>
 #include <string>
+#include <span>
 
 using Bytes = std::vector<uint8_t>;
 using Byte = uint8_t;
 
+//! non-owning view on bytes, e.g. a single block of a Bytes buffer
+using ByteView = std::span<const uint8_t>;
+
 inline std::string str( const Bytes& bytes ) {
     return std::string( bytes.cbegin(), bytes.cend() );
 }
@@ -3,7 +3,8 @@
 #include <map>
 #include <cmath>
 #include <fstream>
-#include <bitset>
+#include <bit>
+#include <cstring>
 #include <algorithm>
 
 #include "converter.hpp"
@@ -197,8 +198,7 @@ std::vector<std::string> utils::linesFromFile( const std::string& filename ) {
     return rv;
 }
 
-template<class Container>
-size_t utils::hammingDistance( const Container& first, const Container& second ) {
+size_t utils::hammingDistance( ByteView first, ByteView second ) {
     size_t size = first.size();
     size_t distance = 0;
 
@@ -207,13 +207,29 @@ size_t utils::hammingDistance( const Container& first, const Container& second )
         return 0;
     }
 
-    for( size_t i = 0; i < size ; ++i ) {
-        distance += std::bitset<8>( first[i] ^ second[i] ).count();
+    size_t i = 0;
+
+    // 8 bytes at once
+    for( ; i + sizeof( uint64_t ) <= size; i += sizeof( uint64_t ) ) {
+        uint64_t a, b;
+        std::memcpy( &a, first.data() + i, sizeof( uint64_t ) );
+        std::memcpy( &b, second.data() + i, sizeof( uint64_t ) );
+        distance += std::popcount( a ^ b );
+    }
+
+    for( ; i < size ; ++i ) {
+        distance += std::popcount( static_cast<uint8_t>( first[i] ^ second[i] ) );
     }
 
     return distance;
 }
 
+template<class Container>
+size_t utils::hammingDistance( const Container& first, const Container& second ) {
+    return hammingDistance( ByteView( reinterpret_cast<const uint8_t*>( first.data() ), first.size() ),
+                            ByteView( reinterpret_cast<const uint8_t*>( second.data() ), second.size() ) );
+}
+
 template size_t utils::hammingDistance<Bytes>( const Bytes& first, const Bytes& second );
 template size_t utils::hammingDistance<std::string>( const std::string& first, const std::string& second );
 
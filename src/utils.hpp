@@ -47,6 +47,7 @@ Bytes fromBase64File( const std::string& filename );
 //! \returns the sum of bitwise differences of two arrays
 template<class Container>
 size_t hammingDistance( const Container& first, const Container& second );
+size_t hammingDistance( ByteView first, ByteView second );
 
 //! \returns the shannon entropy of data
 //! \sa https://rosettacode.org/wiki/Entropy#C.2B.2B
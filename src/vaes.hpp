@@ -0,0 +1,362 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include "aesni.hpp"
+
+//! VAES kernels with 4 (AVX-512) or 2 (AVX2) blocks per register and 16 blocks in flight,
+//! same interfaces and round keys as the aesni kernels, which take over the tails
+//! \note CBC encryption is serial, there is no wide kernel for it
+namespace vaes {
+
+//! blocks per loop iteration
+const size_t parallel = 16;
+
+namespace avx512 {
+
+//! blocks per register
+const size_t lanes = 4;
+
+// the unmasked broadcast, alignr and extract intrinsics trip -Wuninitialized in GCC 12
+const __mmask16 full = 0xffff;
+const size_t registers = parallel / lanes;
+
+CPU_TARGET( "aes,vaes,avx512f" )
+inline void broadcastKeys( const __m128i* keys, __m512i* wide ) {
+    for( size_t j = 0; j <= aesni::rounds; ++j ) {
+        wide[j] = _mm512_maskz_broadcast_i32x4( full, keys[j] );
+    }
+}
+
+CPU_TARGET( "aes,vaes,avx512f" )
+inline void encryptBlocks( __m512i* b, const __m512i* k ) {
+    for( size_t r = 0; r < registers; ++r ) {
+        b[r] = _mm512_xor_si512( b[r], k[0] );
+    }
+
+    for( size_t j = 1; j < aesni::rounds; ++j ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = _mm512_aesenc_epi128( b[r], k[j] );
+        }
+    }
+
+    for( size_t r = 0; r < registers; ++r ) {
+        b[r] = _mm512_aesenclast_epi128( b[r], k[aesni::rounds] );
+    }
+}
+
+CPU_TARGET( "aes,vaes,avx512f" )
+inline void decryptBlocks( __m512i* b, const __m512i* k ) {
+    for( size_t r = 0; r < registers; ++r ) {
+        b[r] = _mm512_xor_si512( b[r], k[0] );
+    }
+
+    for( size_t j = 1; j < aesni::rounds; ++j ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = _mm512_aesdec_epi128( b[r], k[j] );
+        }
+    }
+
+    for( size_t r = 0; r < registers; ++r ) {
+        b[r] = _mm512_aesdeclast_epi128( b[r], k[aesni::rounds] );
+    }
+}
+
+CPU_TARGET( "aes,vaes,avx512f" )
+inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const aesni::AesKey128& key ) {
+    size_t blocks = length / aesni::blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    __m512i k[aesni::rounds + 1];
+    __m512i b[registers];
+    broadcastKeys( key.enc, k );
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = _mm512_loadu_si512( plaintext + ( i + r * lanes ) * aesni::blockSize );
+        }
+
+        encryptBlocks( b, k );
+
+        for( size_t r = 0; r < registers; ++r ) {
+            _mm512_storeu_si512( ciphertext + ( i + r * lanes ) * aesni::blockSize, b[r] );
+        }
+    }
+
+    size_t done = pipelined * aesni::blockSize;
+    aesni::encryptAES128ECB( plaintext + done, ciphertext + done, length - done, key );
+
+    return length;
+}
+
+CPU_TARGET( "aes,vaes,avx512f" )
+inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const aesni::AesKey128& key ) {
+    size_t blocks = length / aesni::blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    __m512i k[aesni::rounds + 1];
+    __m512i b[registers];
+    broadcastKeys( key.dec, k );
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = _mm512_loadu_si512( ciphertext + ( i + r * lanes ) * aesni::blockSize );
+        }
+
+        decryptBlocks( b, k );
+
+        for( size_t r = 0; r < registers; ++r ) {
+            _mm512_storeu_si512( plaintext + ( i + r * lanes ) * aesni::blockSize, b[r] );
+        }
+    }
+
+    size_t done = pipelined * aesni::blockSize;
+    aesni::decryptAES128ECB( ciphertext + done, plaintext + done, length - done, key );
+
+    return length;
+}
+
+//! same interface as aesni::decryptAES128CBC, \p ciphertext and \p plaintext may be the same
+CPU_TARGET( "aes,vaes,avx512f" )
+inline size_t decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length,
+                                const aesni::AesKey128& key, const uint8_t* iv ) {
+    size_t blocks = length / aesni::blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    __m512i k[aesni::rounds + 1];
+    __m512i b[registers];
+    __m512i c[registers];
+    broadcastKeys( key.dec, k );
+
+    // only the last lane of previous is used, it holds the ciphertext block before the current ones
+    __m512i previous = _mm512_maskz_broadcast_i32x4( full, _mm_loadu_si128( ( const __m128i* )iv ) );
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            c[r] = _mm512_loadu_si512( ciphertext + ( i + r * lanes ) * aesni::blockSize );
+            b[r] = c[r];
+        }
+
+        decryptBlocks( b, k );
+
+        for( size_t r = 0; r < registers; ++r ) {
+            __m512i shifted = _mm512_maskz_alignr_epi64( 0xff, c[r], r ? c[r - 1] : previous, 6 );
+            _mm512_storeu_si512( plaintext + ( i + r * lanes ) * aesni::blockSize, _mm512_xor_si512( b[r], shifted ) );
+        }
+
+        previous = c[registers - 1];
+    }
+
+    alignas( 16 ) uint8_t chain[aesni::blockSize];
+    _mm_store_si128( ( __m128i* )chain, _mm512_maskz_extracti32x4_epi32( 0xf, previous, 3 ) );
+
+    size_t done = pipelined * aesni::blockSize;
+    aesni::decryptAES128CBC( ciphertext + done, plaintext + done, length - done, key, chain );
+
+    return length;
+}
+
+//! same interface and counter layout as aesni::cryptAES128CTR
+CPU_TARGET( "aes,vaes,avx512f" )
+inline void cryptAES128CTR( const uint8_t* in, uint8_t* out, const size_t length,
+                            const aesni::AesKey128& key, const uint64_t& nonce, const uint64_t& counter = 0 ) {
+    size_t blocks = length / aesni::blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    __m512i k[aesni::rounds + 1];
+    __m512i b[registers];
+    broadcastKeys( key.enc, k );
+
+    __m128i first = _mm_set_epi64x( static_cast<long long>( counter ), static_cast<long long>( nonce ) );
+    __m512i ctr = _mm512_add_epi64( _mm512_maskz_broadcast_i32x4( full, first ), _mm512_set_epi64( 3, 0, 2, 0, 1, 0, 0, 0 ) );
+    const __m512i step = _mm512_set_epi64( 4, 0, 4, 0, 4, 0, 4, 0 );
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = ctr;
+            ctr = _mm512_add_epi64( ctr, step );
+        }
+
+        encryptBlocks( b, k );
+
+        for( size_t r = 0; r < registers; ++r ) {
+            const uint8_t* src = in + ( i + r * lanes ) * aesni::blockSize;
+            _mm512_storeu_si512( out + ( i + r * lanes ) * aesni::blockSize, _mm512_xor_si512( b[r], _mm512_loadu_si512( src ) ) );
+        }
+    }
+
+    size_t done = pipelined * aesni::blockSize;
+    aesni::cryptAES128CTR( in + done, out + done, length - done, key, nonce, counter + pipelined );
+}
+
+}
+
+namespace avx2 {
+
+//! blocks per register
+const size_t lanes = 2;
+const size_t registers = parallel / lanes;
+
+CPU_TARGET( "aes,vaes,avx2" )
+inline void broadcastKeys( const __m128i* keys, __m256i* wide ) {
+    for( size_t j = 0; j <= aesni::rounds; ++j ) {
+        wide[j] = _mm256_broadcastsi128_si256( keys[j] );
+    }
+}
+
+CPU_TARGET( "aes,vaes,avx2" )
+inline void encryptBlocks( __m256i* b, const __m256i* k ) {
+    for( size_t r = 0; r < registers; ++r ) {
+        b[r] = _mm256_xor_si256( b[r], k[0] );
+    }
+
+    for( size_t j = 1; j < aesni::rounds; ++j ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = _mm256_aesenc_epi128( b[r], k[j] );
+        }
+    }
+
+    for( size_t r = 0; r < registers; ++r ) {
+        b[r] = _mm256_aesenclast_epi128( b[r], k[aesni::rounds] );
+    }
+}
+
+CPU_TARGET( "aes,vaes,avx2" )
+inline void decryptBlocks( __m256i* b, const __m256i* k ) {
+    for( size_t r = 0; r < registers; ++r ) {
+        b[r] = _mm256_xor_si256( b[r], k[0] );
+    }
+
+    for( size_t j = 1; j < aesni::rounds; ++j ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = _mm256_aesdec_epi128( b[r], k[j] );
+        }
+    }
+
+    for( size_t r = 0; r < registers; ++r ) {
+        b[r] = _mm256_aesdeclast_epi128( b[r], k[aesni::rounds] );
+    }
+}
+
+CPU_TARGET( "aes,vaes,avx2" )
+inline size_t encryptAES128ECB( const uint8_t* plaintext, uint8_t* ciphertext, const size_t length, const aesni::AesKey128& key ) {
+    size_t blocks = length / aesni::blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    __m256i k[aesni::rounds + 1];
+    __m256i b[registers];
+    broadcastKeys( key.enc, k );
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = _mm256_loadu_si256( ( const __m256i* )( plaintext + ( i + r * lanes ) * aesni::blockSize ) );
+        }
+
+        encryptBlocks( b, k );
+
+        for( size_t r = 0; r < registers; ++r ) {
+            _mm256_storeu_si256( ( __m256i* )( ciphertext + ( i + r * lanes ) * aesni::blockSize ), b[r] );
+        }
+    }
+
+    size_t done = pipelined * aesni::blockSize;
+    aesni::encryptAES128ECB( plaintext + done, ciphertext + done, length - done, key );
+
+    return length;
+}
+
+CPU_TARGET( "aes,vaes,avx2" )
+inline size_t decryptAES128ECB( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length, const aesni::AesKey128& key ) {
+    size_t blocks = length / aesni::blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    __m256i k[aesni::rounds + 1];
+    __m256i b[registers];
+    broadcastKeys( key.dec, k );
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = _mm256_loadu_si256( ( const __m256i* )( ciphertext + ( i + r * lanes ) * aesni::blockSize ) );
+        }
+
+        decryptBlocks( b, k );
+
+        for( size_t r = 0; r < registers; ++r ) {
+            _mm256_storeu_si256( ( __m256i* )( plaintext + ( i + r * lanes ) * aesni::blockSize ), b[r] );
+        }
+    }
+
+    size_t done = pipelined * aesni::blockSize;
+    aesni::decryptAES128ECB( ciphertext + done, plaintext + done, length - done, key );
+
+    return length;
+}
+
+//! same interface as aesni::decryptAES128CBC, \p ciphertext and \p plaintext may be the same
+CPU_TARGET( "aes,vaes,avx2" )
+inline size_t decryptAES128CBC( const uint8_t* ciphertext, uint8_t* plaintext, const size_t length,
+                                const aesni::AesKey128& key, const uint8_t* iv ) {
+    size_t blocks = length / aesni::blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    __m256i k[aesni::rounds + 1];
+    __m256i b[registers];
+    __m256i c[registers];
+    broadcastKeys( key.dec, k );
+
+    // only the last lane of previous is used, it holds the ciphertext block before the current ones
+    __m256i previous = _mm256_broadcastsi128_si256( _mm_loadu_si128( ( const __m128i* )iv ) );
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            c[r] = _mm256_loadu_si256( ( const __m256i* )( ciphertext + ( i + r * lanes ) * aesni::blockSize ) );
+            b[r] = c[r];
+        }
+
+        decryptBlocks( b, k );
+
+        for( size_t r = 0; r < registers; ++r ) {
+            __m256i shifted = _mm256_permute2x128_si256( r ? c[r - 1] : previous, c[r], 0x21 );
+            _mm256_storeu_si256( ( __m256i* )( plaintext + ( i + r * lanes ) * aesni::blockSize ), _mm256_xor_si256( b[r], shifted ) );
+        }
+
+        previous = c[registers - 1];
+    }
+
+    alignas( 16 ) uint8_t chain[aesni::blockSize];
+    _mm_store_si128( ( __m128i* )chain, _mm256_extracti128_si256( previous, 1 ) );
+
+    size_t done = pipelined * aesni::blockSize;
+    aesni::decryptAES128CBC( ciphertext + done, plaintext + done, length - done, key, chain );
+
+    return length;
+}
+
+//! same interface and counter layout as aesni::cryptAES128CTR
+CPU_TARGET( "aes,vaes,avx2" )
+inline void cryptAES128CTR( const uint8_t* in, uint8_t* out, const size_t length,
+                            const aesni::AesKey128& key, const uint64_t& nonce, const uint64_t& counter = 0 ) {
+    size_t blocks = length / aesni::blockSize;
+    size_t pipelined = blocks - blocks % parallel;
+    __m256i k[aesni::rounds + 1];
+    __m256i b[registers];
+    broadcastKeys( key.enc, k );
+
+    __m128i first = _mm_set_epi64x( static_cast<long long>( counter ), static_cast<long long>( nonce ) );
+    __m256i ctr = _mm256_add_epi64( _mm256_broadcastsi128_si256( first ), _mm256_set_epi64x( 1, 0, 0, 0 ) );
+    const __m256i step = _mm256_set_epi64x( 2, 0, 2, 0 );
+
+    for( size_t i = 0; i < pipelined; i += parallel ) {
+        for( size_t r = 0; r < registers; ++r ) {
+            b[r] = ctr;
+            ctr = _mm256_add_epi64( ctr, step );
+        }
+
+        encryptBlocks( b, k );
+
+        for( size_t r = 0; r < registers; ++r ) {
+            const uint8_t* src = in + ( i + r * lanes ) * aesni::blockSize;
+            _mm256_storeu_si256( ( __m256i* )( out + ( i + r * lanes ) * aesni::blockSize ), _mm256_xor_si256( b[r], _mm256_loadu_si256( ( const __m256i* )src ) ) );
+        }
+    }
+
+    size_t done = pipelined * aesni::blockSize;
+    aesni::cryptAES128CTR( in + done, out + done, length - done, key, nonce, counter + pipelined );
+}
+
+}
+
+}